@@ -7,6 +7,8 @@
 #include <eng/assets/loaders.hpp>
 #include <eng/assets/serialization.hpp>
 #include <eng/assets/compression.hpp>
+#include <eng/assets/vertex_compression.hpp>
+#include <eng/common/hash.hpp>
 
 namespace eng
 {
@@ -107,7 +109,6 @@ void deserialize<assets::Asset>(assets::Asset& dst, std::span<const std::byte> s
     deserialize(image_count, src, out_bytes_written);
     dst.images.resize(image_count);
     assets::ParsedImageData imgd{};
-    auto* mip_cmd = gfx::get_renderer().current_data->cmdpool->begin();
     for(auto i = 0u; i < image_count; ++i)
     {
         // don't use deserialize() here, because it would double the image data for no reason, we can read from the stream
@@ -222,208 +223,1094 @@ void AssetManager::init()
         }
     }
     std::sort(engb_paths.begin(), engb_paths.end(), [](const auto& a, const auto& b) { return b < a; });
-    m_engb_containers_vec.reserve(engb_paths.size());
     for(const auto& p : engb_paths)
     {
         m_engb_containers_vec.emplace_back(get_engine().fs->open_file(p, fs::OpenMode::TRY_READ_WRITE_BYTES_BEG));
     }
+    // shipped ones come after the loose ones, so assets imported again locally shadow them
+    auto packed_paths = get_engine().fs->list_mounted_files("/assets");
+    std::erase_if(packed_paths, [](const fs::Path& p) { return p.extension() != ".engb"; });
+    std::sort(packed_paths.begin(), packed_paths.end(), [](const auto& a, const auto& b) { return b < a; });
+    for(const auto& p : packed_paths)
+    {
+        m_engb_containers_vec.emplace_back(get_engine().fs->open_file(p, fs::OpenMode::TRY_READ_BYTES_BEG));
+    }
+    // from the oldest, so newer containers overwrite
+    for(auto i = (u32)m_engb_containers_vec.size(); i > 0; --i)
+    {
+        for(const auto& [hash, list] : m_engb_containers_vec[i - 1].m_lists_index)
+        {
+            m_engb_index[hash] = i - 1;
+        }
+    }
+
+    streaming.on_image_replaced = [this](u64 hash, Handle<gfx::Image> old_image, Handle<gfx::Image> new_image) {
+        on_image_replaced(hash, old_image, new_image);
+    };
+
+    // imports run their own parallel loops, so a couple of threads is enough to keep the queue moving
+    const auto thread_count = std::clamp(std::thread::hardware_concurrency() / 4u, 1u, 4u);
+    for(auto i = 0u; i < thread_count; ++i)
+    {
+        m_loading_threads.emplace_back([this](std::stop_token stop) { loading_thread(stop); });
+    }
+}
+
+void AssetManager::update()
+{
+    streaming.update();
+    {
+        std::scoped_lock lock{ m_queue_mutex };
+        m_uploads.insert(m_uploads.end(), m_finished_loads.begin(), m_finished_loads.end());
+        m_finished_loads.clear();
+    }
+    if(m_uploads.empty()) { return; }
+
+    std::stable_sort(m_uploads.begin(), m_uploads.end(),
+                     [](const AssetRequest* a, const AssetRequest* b) { return a->priority > b->priority; });
+    auto budget = upload_budget;
+    u32 finished = 0;
+    for(auto* req : m_uploads)
+    {
+        if(budget == 0) { break; }
+        // cancel could have come when loading was already finishing
+        if(req->cancel_requested && req->state == AssetRequestState::UPLOADING && req->uploaded_images == 0 &&
+           req->uploaded_geometries == 0)
+        {
+            req->state = AssetRequestState::CANCELLED;
+        }
+        if(req->state == AssetRequestState::UPLOADING && !upload_request(*req, budget)) { break; }
+        finish_request(*req);
+        ++finished;
+    }
+    m_uploads.erase(m_uploads.begin(), m_uploads.begin() + finished);
 }
 
 const Asset& AssetManager::get_asset(const fs::Path& file_path)
 {
-    if(auto it = m_loaded_assets_map.find(file_path); it != m_loaded_assets_map.end()) { return it->second; }
+    const auto handle = request_asset(file_path, SYNC_PRIORITY);
+    auto& req = *m_requests[*handle];
 
-    const auto ext = file_path.extension();
+    // if no loading thread got to it yet, it's loaded right here instead of waiting for one
+    load_request(req);
+    req.state.wait(AssetRequestState::LOADING);
+    if(req.state == AssetRequestState::UPLOADING)
+    {
+        usize budget = ~0ull;
+        upload_request(req, budget);
+    }
+    finish_request(req);
+    std::erase(m_uploads, &req);
+    return req.state == AssetRequestState::LOADED ? req.asset : s_null_asset;
+}
+
+Handle<AssetRequest> AssetManager::request_asset(const fs::Path& file_path, i32 priority,
+                                                 Callback<void(const Asset&)> on_loaded)
+{
+    if(auto it = m_requests_map.find(file_path); it != m_requests_map.end())
+    {
+        auto& req = *m_requests[*it->second];
+        if(on_loaded)
+        {
+            // finished requests are not processed anymore, so the callback is queued to be called on the next update
+            if(req.state == AssetRequestState::LOADED && std::ranges::find(m_uploads, &req) == m_uploads.end())
+            {
+                m_uploads.push_back(&req);
+            }
+            req.on_loaded.push_back(std::move(on_loaded));
+        }
+        std::scoped_lock lock{ m_queue_mutex };
+        req.priority = std::max(req.priority, priority);
+        return it->second;
+    }
+
+    const auto handle = Handle<AssetRequest>{ (u32)m_requests.size() };
+    auto& req = *m_requests.emplace_back(std::make_unique<AssetRequest>());
+    req.path = file_path;
+    req.priority = priority;
+    if(on_loaded) { req.on_loaded.push_back(std::move(on_loaded)); }
+    m_requests_map.emplace(file_path, handle);
+    {
+        std::scoped_lock lock{ m_queue_mutex };
+        m_load_queue.push_back(&req);
+    }
+    m_queue_cv.notify_one();
+    return handle;
+}
+
+AssetRequestState AssetManager::get_state(Handle<AssetRequest> request) const
+{
+    return m_requests.at(*request)->state;
+}
+
+const Asset* AssetManager::try_get_asset(Handle<AssetRequest> request) const
+{
+    const auto& req = *m_requests.at(*request);
+    return req.state == AssetRequestState::LOADED ? &req.asset : nullptr;
+}
+
+bool AssetManager::cancel(Handle<AssetRequest> request)
+{
+    auto& req = *m_requests.at(*request);
+    auto state = AssetRequestState::QUEUED;
+    if(!req.state.compare_exchange_strong(state, AssetRequestState::CANCELLED))
+    {
+        if(state == AssetRequestState::LOADING) { req.cancel_requested = true; }
+        else if(state != AssetRequestState::UPLOADING || req.uploaded_images > 0 || req.uploaded_geometries > 0)
+        {
+            return false;
+        }
+        else { req.state = AssetRequestState::CANCELLED; }
+    }
+    req.on_loaded.clear();
+    // the request stays, but the path can be requested anew
+    m_requests_map.erase(req.path);
+    return true;
+}
 
-    if(auto assetopt = try_deserialize_asset(file_path); assetopt)
+void AssetManager::release(Handle<AssetRequest> request)
+{
+    auto& req = *m_requests.at(*request);
+    if(req.state != AssetRequestState::LOADED) { return; }
+
+    const auto release_shared = [](auto& shared_map, u64 hash, auto&& on_unused) {
+        auto it = shared_map.find(hash);
+        if(it == shared_map.end() || --it->second.refs > 0) { return; }
+        on_unused(it->second.handle);
+        shared_map.erase(it);
+    };
+    for(auto hash : req.image_hashes)
     {
-        auto it = m_loaded_assets_map.emplace(file_path, std::move(*assetopt));
-        return it.first->second;
+        release_shared(m_shared_images, hash, [this, hash](Handle<gfx::Image>) { streaming.remove_image(hash); });
     }
+    for(auto hash : req.geometry_hashes)
+    {
+        release_shared(m_shared_geometries, hash, [this, hash](Handle<gfx::Geometry>) { streaming.remove_geometry(hash); });
+    }
+    for(auto hash : req.material_hashes)
+    {
+        release_shared(m_shared_materials, hash, [](Handle<gfx::Material>) {});
+    }
+    req.image_hashes.clear();
+    req.geometry_hashes.clear();
+    req.material_hashes.clear();
+    req.asset = Asset{};
+    req.state = AssetRequestState::RELEASED;
+    m_requests_map.erase(req.path);
+}
 
-    if(ext == ".glb" || ext == ".gltf")
+void AssetManager::loading_thread(std::stop_token stop)
+{
+    for(;;)
     {
-        auto asset = AssetLoaderGLTF::load_from_file(get_engine().fs->make_rel_path(file_path), ImportSettings::KEEP_DATA_BIT);
-        if(!asset)
+        AssetRequest* req{};
         {
-            ENG_WARN("Couldn't load asset {}", file_path.string());
-            return s_null_asset;
+            std::unique_lock lock{ m_queue_mutex };
+            if(!m_queue_cv.wait(lock, stop, [this] { return !m_load_queue.empty(); })) { return; }
+            auto it = std::max_element(m_load_queue.begin(), m_load_queue.end(),
+                                       [](const AssetRequest* a, const AssetRequest* b) { return a->priority < b->priority; });
+            req = *it;
+            m_load_queue.erase(it);
         }
-        asset->path = file_path;
-        auto it = m_loaded_assets_map.emplace(file_path, std::move(*asset));
+        load_request(*req);
+    }
+}
 
-        if(get_engine().settings.serialize_to_enbc)
+void AssetManager::load_request(AssetRequest& req)
+{
+    // whoever moves it out of the queued state loads it; cancelled and already taken requests are skipped
+    auto state = AssetRequestState::QUEUED;
+    if(!req.state.compare_exchange_strong(state, AssetRequestState::LOADING)) { return; }
+
+    auto asset = try_deserialize_asset(req.path);
+    if(!asset) { asset = import_asset(req.path); }
+    if(req.cancel_requested) { req.state = AssetRequestState::CANCELLED; }
+    else if(!asset) { req.state = AssetRequestState::FAILED; }
+    else
+    {
+        req.asset = std::move(*asset);
+        // hashing is the slow part of finding shared resources, so it's done here and not during the upload;
+        // payloads go through xxh64, which runs at memory speed, and only the small fields through ENG_HASH
+        const auto hash_payload = [](u64 seed, std::initializer_list<std::span<const std::byte>> parts) {
+            hash::Xxh64Stream stream{ seed };
+            for(const auto& part : parts)
+            {
+                stream.update(part.data(), part.size());
+            }
+            return stream.digest();
+        };
+        for(const auto& imgd : req.asset.image_data)
         {
-            m_serializing_threads.push_back(std::make_unique<std::jthread>(std::jthread{
-                &AssetManager::serialize_asset_to_enbc_thread, this, std::ref(it.first->second) }));
+            const auto data = imgd.get_data();
+            const auto seed = ENG_HASH(imgd.width, imgd.height, imgd.format, imgd.mips, data.size());
+            req.image_hashes.push_back(hash_payload(seed, { data }));
         }
+        for(const auto& gdf : req.asset.geometry_data_futures)
+        {
+            const auto& gd = gdf.get();
+            // sizes are in the seed, so the parts can't shift into each other
+            const auto seed = ENG_HASH(gd.vertex_layout, gd.positions.size(), gd.attributes.size(), gd.indices.size(),
+                                       gd.meshlets.size(), gd.lods.size());
+            req.geometry_hashes.push_back(hash_payload(seed, { std::as_bytes(std::span{ gd.positions }),
+                                                               std::as_bytes(std::span{ gd.attributes }),
+                                                               std::as_bytes(std::span{ gd.indices }),
+                                                               std::as_bytes(std::span{ gd.meshlets }),
+                                                               std::as_bytes(std::span{ gd.lods }) }));
+        }
+        req.state = AssetRequestState::UPLOADING;
+    }
+    {
+        std::scoped_lock lock{ m_queue_mutex };
+        m_finished_loads.push_back(&req);
+    }
+    req.state.notify_all();
+}
 
-        return it.first->second;
+// Makes renderer objects from the cpu data. Returns false if it ran out of budget and has to be continued later.
+bool AssetManager::upload_request(AssetRequest& req, usize& budget)
+{
+    auto& asset = req.asset;
+    for(; req.uploaded_images < asset.images.size(); ++req.uploaded_images)
+    {
+        if(budget == 0) { return false; }
+        auto& img = asset.images[req.uploaded_images];
+        auto& shared = m_shared_images[req.image_hashes[req.uploaded_images]];
+        if(shared.handle)
+        {
+            img = shared.handle;
+            ++shared.refs;
+            continue;
+        }
+        auto& imgd = asset.image_data[req.uploaded_images];
+        const auto name = imgd.name;
+        // an image over the budget still goes in whole; it just uses up the rest of it
+        budget -= std::min(budget, imgd.get_data().size());
+        img = streaming.add_image(req.image_hashes[req.uploaded_images], std::move(imgd));
+        if(!img)
+        {
+            ENG_WARN("Failed to create image {}", name.empty() ? "EMPTY IMAGE NAME" : name.as_view());
+            m_shared_images.erase(req.image_hashes[req.uploaded_images]);
+        }
+        else { shared = SharedResource<gfx::Image>{ img, 1u }; }
+    }
+    for(; req.uploaded_geometries < asset.geometries.size(); ++req.uploaded_geometries)
+    {
+        if(budget == 0) { return false; }
+        auto& shared = m_shared_geometries[req.geometry_hashes[req.uploaded_geometries]];
+        if(shared.handle)
+        {
+            asset.geometries[req.uploaded_geometries] = shared.handle;
+            ++shared.refs;
+            continue;
+        }
+        const auto& gdf = asset.geometry_data_futures[req.uploaded_geometries];
+        const auto& geom = gdf.get();
+        budget -= std::min(budget, (geom.positions.size() + geom.attributes.size()) * sizeof(float) +
+                                       geom.indices.size() * sizeof(u16));
+        auto& handle = asset.geometries[req.uploaded_geometries];
+        handle = streaming.add_geometry(req.geometry_hashes[req.uploaded_geometries], gdf);
+        if(!handle)
+        {
+            ENG_WARN("Failed to create geometry {} of {}", req.uploaded_geometries, req.path.string());
+            m_shared_geometries.erase(req.geometry_hashes[req.uploaded_geometries]);
+        }
+        else { shared = SharedResource<gfx::Geometry>{ handle, 1u }; }
     }
 
-    ENG_ERROR("Extension not supported {}", file_path.string());
-    return s_null_asset;
+    // placeholder handles are indices into the asset's vectors
+    const auto get_image = [&asset](Handle<gfx::Image> placeholder) {
+        return *placeholder < asset.images.size() ? asset.images[*placeholder] : Handle<gfx::Image>{};
+    };
+    for(auto& txt : asset.textures)
+    {
+        txt.image = get_image(txt.image);
+    }
+    // streaming replaces images, so materials are found by contents of their images, and not by their handles
+    const auto get_texture_hash = [&req](const gfx::ImageView& txt) {
+        return txt && *txt.image < req.image_hashes.size() ? ENG_HASH(req.image_hashes[*txt.image], txt.type, txt.format) : 0ull;
+    };
+    for(auto i = 0u; i < asset.materials.size(); ++i)
+    {
+        auto mat = asset.material_data[i];
+        const auto hash = ENG_HASH(mat.mode, mat.alpha_cutoff, mat.base_color_factor, get_texture_hash(mat.base_color_texture),
+                                   get_texture_hash(mat.normal_texture), get_texture_hash(mat.metallic_roughness_texture));
+        for(auto* txt : { &mat.base_color_texture, &mat.normal_texture, &mat.metallic_roughness_texture })
+        {
+            if(*txt) { txt->image = get_image(txt->image); }
+        }
+        mat.mesh_pass = {};
+        auto& shared = m_shared_materials[hash];
+        if(!shared.handle) { shared.handle = gfx::get_renderer().make_material(mat); }
+        ++shared.refs;
+        asset.materials[i] = shared.handle;
+        req.material_hashes.push_back(hash);
+    }
+    for(auto i = 0u; i < asset.meshes.size(); ++i)
+    {
+        const auto& mesh = asset.mesh_data[i];
+        const auto geometry = mesh.geometry ? asset.geometries[*mesh.geometry] : Handle<gfx::Geometry>{};
+        asset.meshes[i] = gfx::get_renderer().make_mesh(gfx::MeshDescriptor{
+            .geometry = geometry, .material = mesh.material ? asset.materials[*mesh.material] : Handle<gfx::Material>{} });
+        if(!geometry || !mesh.material) { continue; }
+        const auto& mat = asset.material_data[*mesh.material];
+        for(const auto* txt : { &mat.base_color_texture, &mat.normal_texture, &mat.metallic_roughness_texture })
+        {
+            if(*txt && *txt->image < req.image_hashes.size()) { streaming.add_image_user(req.image_hashes[*txt->image], geometry); }
+        }
+    }
+
+    asset.geometry_data.clear();
+    asset.geometry_data_futures.clear();
+    asset.image_data.clear();
+    asset.material_data.clear();
+    asset.mesh_data.clear();
+    req.state = AssetRequestState::LOADED;
+    return true;
 }
 
-serialization::engb::Container& AssetManager::get_latest_container()
+void AssetManager::on_image_replaced(u64 hash, Handle<gfx::Image> old_image, Handle<gfx::Image> new_image)
 {
-    if(m_engb_containers_vec.empty())
+    if(auto it = m_shared_images.find(hash); it != m_shared_images.end()) { it->second.handle = new_image; }
+    for(auto& req : m_requests)
     {
-        m_engb_containers_vec.emplace_back(get_engine().fs->open_file("/assets/assets0.engb",
-                                                                      fs::OpenMode::READ_WRITE_BYTES_CREATE_DISCARD));
+        // requests being uploaded still have placeholders past uploaded images, and in their textures
+        const auto loaded = req->state == AssetRequestState::LOADED;
+        if(!loaded && req->state != AssetRequestState::UPLOADING) { continue; }
+        const auto image_count = loaded ? req->asset.images.size() : req->uploaded_images;
+        for(auto i = 0u; i < image_count; ++i)
+        {
+            if(req->asset.images[i] == old_image) { req->asset.images[i] = new_image; }
+        }
+        if(!loaded) { continue; }
+        for(auto& txt : req->asset.textures)
+        {
+            if(txt.image == old_image) { txt = gfx::ImageView::init(new_image, txt.format, txt.type); }
+        }
     }
-    return m_engb_containers_vec.front();
 }
 
-std::optional<serialization::engb::List> AssetManager::try_find_list_by_hash(u64 hash, serialization::engb::Container** out_container)
+void AssetManager::finish_request(AssetRequest& req)
 {
-    std::shared_lock lock{ m_engbc_vec_mutex };
-    for(auto& c : m_engb_containers_vec)
+    if(req.state == AssetRequestState::FAILED)
     {
-        const auto list = c.get_asset_list(hash);
-        if(list)
+        // unless it was already finished and the path requested again
+        if(auto it = m_requests_map.find(req.path); it != m_requests_map.end() && m_requests[*it->second].get() == &req)
         {
-            if(out_container) { *out_container = &c; }
-            return list;
+            ENG_WARN("Couldn't load asset {}", req.path.string());
+            m_requests_map.erase(it);
         }
     }
-    return std::nullopt;
+    const auto& asset = req.state == AssetRequestState::LOADED ? req.asset : s_null_asset;
+    const auto callbacks = std::move(req.on_loaded);
+    req.on_loaded.clear();
+    if(req.state == AssetRequestState::CANCELLED) { return; }
+    for(const auto& cb : callbacks)
+    {
+        cb(asset);
+    }
 }
 
-std::optional<Asset> AssetManager::try_deserialize_asset(const fs::Path& file_path)
+std::optional<Asset> AssetManager::import_asset(const fs::Path& file_path)
 {
+    const auto ext = file_path.extension();
+    if(ext != ".glb" && ext != ".gltf")
     {
-        u32 head{};
-        while(m_serializing_threads.size())
+        ENG_WARN("Extension not supported {}", file_path.string());
+        return std::nullopt;
+    }
+
+    // read through the file system, so gltf files and everything they reference can come from pack archives
+    const auto read_file = [](const fs::Path& path) -> std::optional<std::vector<std::byte>> {
+        const auto file = get_engine().fs->open_file(path, fs::OpenMode::TRY_READ_BYTES_BEG);
+        if(!file->is_open()) { return std::nullopt; }
+        std::vector<std::byte> bytes(file->get_size());
+        usize n_bytes_read = 0;
+        file->read(bytes.data(), bytes.size(), n_bytes_read, 0);
+        if(n_bytes_read != bytes.size()) { return std::nullopt; }
+        return bytes;
+    };
+    auto asset = AssetLoaderGLTF::load_from_file(file_path, ImportSettings::HEADLESS_BIT | ImportSettings::QUANTIZE_VERTICES_BIT,
+                                                 {}, read_file);
+    if(!asset) { return std::nullopt; }
+    asset->path = file_path;
+    // serialized before the upload, which replaces the placeholder handles serialization maps to indices
+    if(get_engine().settings.serialize_to_enbc) { write_asset_to_container(*asset); }
+    return asset;
+}
+
+serialization::engb::Container& AssetManager::get_latest_container()
+{
+    if(m_engb_containers_vec.empty() || !m_engb_containers_vec.front().is_writable())
+    {
+        // there are only containers from pack archives, which can't be written
+        m_engb_containers_vec.emplace_front(get_engine().fs->open_file("/assets/assets0.engb",
+                                                                       fs::OpenMode::READ_WRITE_BYTES_CREATE_DISCARD));
+        for(auto& [hash, index] : m_engb_index)
         {
-            if(m_serializing_threads[head]->joinable()) { break; }
-            ++head;
+            ++index;
         }
-        m_serializing_threads.erase(m_serializing_threads.begin(), m_serializing_threads.begin() + head);
     }
+    return m_engb_containers_vec.front();
+}
+
+std::optional<serialization::engb::List> AssetManager::try_find_list_by_hash(u64 hash, serialization::engb::Container** out_container)
+{
+    std::shared_lock lock{ m_engbc_vec_mutex };
+    const auto it = m_engb_index.find(hash);
+    if(it == m_engb_index.end()) { return std::nullopt; }
+    auto& c = m_engb_containers_vec[it->second];
+    const auto list = c.get_asset_list(hash);
+    if(list && out_container) { *out_container = &c; }
+    return list;
+}
+
+std::optional<Asset> AssetManager::try_deserialize_asset(const fs::Path& file_path)
+{
     serialization::engb::Container* container{};
-    const auto listopt = try_find_list_by_hash(ENG_HASH(file_path.string()), &container);
+    const auto path_hash = ENG_HASH(file_path.string());
+    const auto listopt = try_find_list_by_hash(path_hash, &container);
     if(!listopt) { return std::nullopt; }
     ENG_ASSERT(container);
     const auto& list = *listopt;
 
-    if(list.version != 0)
-    {
-        ENG_WARN("Asset {} has invalid version {}", file_path.string(), list.version);
+    // invalid entries are imported again by the caller; until then, nothing looks them up anymore
+    const auto invalidate = [this, path_hash] {
+        std::scoped_lock lock{ m_engbc_vec_mutex };
+        m_engb_index.erase(path_hash);
         return std::nullopt;
+    };
+
+    if(list.version != Asset::VERSION || list.schema_hash != Asset::get_schema_hash())
+    {
+        ENG_WARN("Asset {} is stale (version {}, schema {:x}); importing it again", file_path.string(), list.version,
+                 list.schema_hash);
+        return invalidate();
     }
 
-    ENG_TIMER_SCOPED("Deserializing {}", file_path.string());
-    std::shared_lock lock{ m_engbc_vec_mutex };
+    // missing sources are fine, e.g. when only cooked containers are shipped
+    const auto source_path = get_engine().fs->make_rel_path(file_path);
+    if(auto stamp = engb::SourceStamp::init(source_path, false);
+       stamp && !list.source.is_empty() && !stamp->has_same_times(list.source))
+    {
+        // touched; read only if it could still be the same
+        if(stamp->size == list.source.size) { stamp = engb::SourceStamp::init(source_path, true); }
+        if(!stamp || stamp->size != list.source.size || stamp->hash != list.source.hash)
+        {
+            ENG_WARN("Source of asset {} changed; importing it again", file_path.string());
+            return invalidate();
+        }
+        std::scoped_lock lock{ m_engbc_vec_mutex };
+        // entries in pack archives keep their stamps, and their sources are hashed again on every start
+        if(container->is_writable()) { container->restamp_asset(list.custom_hash, *stamp); }
+    }
 
-    std::vector<std::byte> asset_bytes;
-    if(list.flags.test(engb::ListFlags::CONTENT_COMPRESSED_BIT))
+    ENG_TIMER_SCOPED("Deserializing {}", file_path.string());
+    const auto compressed = list.flags.test(engb::ListFlags::CONTENT_COMPRESSED_BIT);
+    std::span<const std::byte> stored_bytes;
+    engb::AssetMetadata metadata;
+    fs::MappedFilePtr mapping;
+    {
+        // metadata of mapped assets is in the mapping too; read under the same lock, as writers change the container
+        std::shared_lock lock{ m_engbc_vec_mutex };
+        mapping = container->get_asset_bytes(list, stored_bytes);
+        if(mapping) { metadata = container->get_asset_metadata(list); }
+    }
+    std::vector<std::byte> read_bytes; // stored bytes, if they couldn't be viewed in the mapping
+    fs::Path container_path;
+    auto is_written = false;
+    if(!mapping && container->m_file)
+    {
+        std::shared_lock lock{ m_engbc_vec_mutex };
+        container_path = container->m_file->get_path();
+        is_written = container->is_asset_written(list);
+    }
+    if(is_written)
     {
-        std::vector<std::byte> file_buf(compression::ZLIB_SCRATCH_SIZE);
-        usize asset_read_offset = 0;
-        u64 uncompressed_size = 0;
+        // read with the metadata, and without the container's stream, so loading threads don't wait for each other
+        const auto metadata_bytes = engb::Container::get_metadata_bytes(list);
+        read_bytes.resize(metadata_bytes + list.asset_size);
+        std::promise<bool> read_done;
+        const fs::AsyncRead read{ .path = container_path,
+                                  .offset = engb::N_HEADER_BYTES + list.asset_start - metadata_bytes,
+                                  .dst = read_bytes,
+                                  .on_complete = [&read_done](const fs::AsyncRead& r, usize n_bytes_read, bool success) {
+                                      read_done.set_value(success && n_bytes_read == r.dst.size());
+                                  } };
+        get_engine().fs->read_async(std::span{ &read, 1 });
+        if(!read_done.get_future().get())
+        {
+            ENG_WARN("Could not read asset bytes of {}", file_path.string());
+            return invalidate();
+        }
+        metadata = engb::Container::parse_asset_metadata(list, std::span{ read_bytes }.first(metadata_bytes));
+        stored_bytes = std::span{ read_bytes }.subspan(metadata_bytes);
+    }
+    else if(!mapping)
+    {
+        // not in the file yet; containers are read through a single stream each, so loading threads can't read them
+        // at the same time
         usize n_bytes_read = 0;
+        {
+            std::scoped_lock lock{ m_engbc_vec_mutex };
+            metadata = container->get_asset_metadata(list);
+            read_bytes.resize(list.asset_size);
+            n_bytes_read = container->get_asset_data(list, std::span{ read_bytes }, 0);
+        }
+        if(n_bytes_read != list.asset_size)
+        {
+            ENG_WARN("Could not read asset bytes of {}", file_path.string());
+            return invalidate();
+        }
+        stored_bytes = read_bytes;
+    }
 
-        // Add N_HEADER_BYTES to convert payload-relative offset to absolute file offset
-        const u64 meta_offset = serialization::engb::v0::N_HEADER_BYTES + list.asset_start - sizeof(u64);
-        container->m_file->read(reinterpret_cast<std::byte*>(&uncompressed_size), sizeof(u64), n_bytes_read, meta_offset);
-
-        asset_bytes.reserve(uncompressed_size);
-        auto success = compression::zlib_inflate(
-            [&](usize size) {
-                const auto file_read = container->get_asset_data(list, std::span{ file_buf.data(), size }, asset_read_offset);
-                asset_read_offset += file_read;
-                const auto bytes_to_process = std::min(file_read, size);
-                auto span = std::span<const std::byte>{ file_buf.data(), bytes_to_process };
-                return span;
-            },
-            [&](std::span<const std::byte> data) { asset_bytes.insert(asset_bytes.end(), data.begin(), data.end()); });
-        if(!success)
+    // compressed assets are validated by checksums of their chunks while decompressing, which only goes over the
+    // compressed bytes; uncompressed ones by checksums of their chunks too, but only of those which are read, so
+    // mapped image data is checked when it's uploaded, and mips which are never streamed in are never read
+    std::vector<std::byte> asset_bytes;
+    std::shared_ptr<serialization::ChunkChecksums> checksums;
+    if(compressed)
+    {
+        asset_bytes.resize(metadata.uncompressed_size);
+        if(!compression::decompress_chunked(stored_bytes, asset_bytes))
         {
-            ENG_WARN("Failed to decompress serialized data {}", file_path.string());
-            return std::nullopt;
+            ENG_WARN("Asset {} is corrupted (failed to decompress); importing it again", file_path.string());
+            return invalidate();
         }
     }
-    else
+    else if(list.flags.test(engb::ListFlags::CHUNK_CHECKSUMS_BIT))
     {
-        asset_bytes.resize(list.asset_size);
-        const auto n_bytesread = container->get_asset_data(list, std::span{ asset_bytes }, 0);
-        if(n_bytesread != list.asset_size)
+        if(!engb::Container::validate_chunk_checksums(list, metadata.chunk_checksums))
         {
-            ENG_WARN("Could not read asset bytes.");
-            return std::nullopt;
+            ENG_WARN("Asset {} is corrupted (content hash mismatch); importing it again", file_path.string());
+            return invalidate();
         }
+        checksums = std::make_shared<serialization::ChunkChecksums>(stored_bytes, std::move(metadata.chunk_checksums));
+    }
+    else if(!engb::Container::validate_asset_bytes(list, stored_bytes))
+    {
+        ENG_WARN("Asset {} is corrupted (content hash mismatch); importing it again", file_path.string());
+        return invalidate();
     }
 
     Asset asset{};
-    serialization::Context ctx(std::span{ asset_bytes }, 0);
+    // uncompressed assets are deserialized straight from the mapping, and their image data is not copied at all
+    serialization::Context ctx{ compressed ? std::span<const std::byte>{ asset_bytes } : stored_bytes, 0 };
+    if(!compressed) { ctx.m_mapping = mapping; }
+    ctx.m_checksums = checksums;
     asset.deserialize(ctx);
+    if(ctx.m_corrupted)
+    {
+        ENG_WARN("Asset {} is corrupted (chunk checksum mismatch or undecodable data); importing it again",
+                 file_path.string());
+        return invalidate();
+    }
     return asset;
 }
 
-void AssetManager::serialize_asset_to_enbc_thread(Asset& asset)
+void AssetManager::write_asset_to_container(const Asset& asset)
 {
     if(asset.geometry_data_futures.empty())
     {
-        ENG_WARN("Cannot serialize asset without geometries");
+        ENG_WARN("Cannot serialize asset {} without geometries", asset.path.string());
         return;
     }
 
-    for(auto& signal : asset.geometry_data_futures)
-    {
-        signal.wait();
-    }
-
     ENG_TIMER_SCOPED("Serializing asset {}", asset.path.string());
 
-    // empty context to calc the size required.
-    serialization::Context ctx{std::span<std::byte>{}, 0};
-    asset.serialize(ctx);
-    const usize required_size = ctx.m_offset;
+    const auto asset_bytes = serialize_asset(asset);
+    const usize required_size = asset_bytes.size();
 
     if(required_size > 0)
     {
-        // 2. Real serialization pass
-        std::vector<std::byte> asset_bytes(required_size);
-        serialization::Context ctx(std::span{ asset_bytes }, 0);
-        asset.serialize(ctx);
-        ENG_ASSERT(ctx.m_offset == required_size);
+        // compressed in parallel chunks before taking the lock, as it's the slow part
+        std::vector<std::byte> compressed_bytes;
+        if(compress_assets) { compressed_bytes = compression::compress_chunked(asset_bytes); }
+        const auto stored_bytes = compress_assets ? std::span<const std::byte>{ compressed_bytes } : std::span{ asset_bytes };
+        const auto source = engb::SourceStamp::init(get_engine().fs->make_rel_path(asset.path), true);
 
         std::scoped_lock lock{ m_engbc_vec_mutex };
         auto& engbc = get_latest_container();
+        engbc.add_asset(Asset::VERSION, Asset::get_schema_hash(), ENG_HASH(asset.path.string()),
+                        compress_assets ? engb::ListFlags::CONTENT_COMPRESSED_BIT : Flags<engb::ListFlags>{},
+                        stored_bytes, engb::AssetMetadata{ .uncompressed_size = asset_bytes.size() },
+                        source.value_or(engb::SourceStamp{}));
+        m_engb_index[ENG_HASH(asset.path.string())] = 0; // latest container is the first one
+    }
 
-#if 0
-        // Clean streaming compression implementation
-        engbc.add_asset(0, ENG_HASH(asset.path.string()), engb::ListFlags::CONTENT_COMPRESSED_BIT, {}, 
-                        engb::AssetMetadata{ .uncompressed_size = asset_bytes.size() });
-        
-        usize bytes_read = 0;
-        usize bytes_left = asset_bytes.size();
-        const auto res = compression::zlib_deflate(
-            [&](usize size) {
-                const auto bytes_to_process = std::min(bytes_left, size);
-                auto span = std::span<const std::byte>{ asset_bytes.data() + bytes_read, bytes_to_process };
-                bytes_read += bytes_to_process;
-                bytes_left -= bytes_to_process;
-                return span;
-            },
-            [&](std::span<const std::byte> data) {
-                engbc.append_asset_bytes(data, false);
-            });
-
-        ENG_ASSERT(res, "Zlib compression failed {}", asset.path.string());
-        engbc.append_asset_bytes({}, true);
-#else
-        engbc.add_asset(0, ENG_HASH(asset.path.string()), {}, {}, engb::AssetMetadata{ .uncompressed_size = asset_bytes.size() });
-        engbc.append_asset_bytes(std::span{ asset_bytes }, true);
-#endif
+    ENG_LOG("Serializing asset {} finished. Written {} bytes.", asset.path.string(), required_size);
+}
+
+Handle<gfx::Image> make_image_from_data(std::string_view name, u32 width, u32 height, gfx::ImageFormat format,
+                                        u32 stored_mips, std::span<const std::byte> data)
+{
+    const auto usage = gfx::ImageUsage::SAMPLED_BIT | gfx::ImageUsage::TRANSFER_DST_BIT;
+    const auto img = gfx::get_renderer().make_image(
+        name, gfx::Image::init(width, height, 0, format, usage, stored_mips, 1, gfx::ImageLayout::READ_ONLY));
+    if(!img) { return img; }
+
+    usize offset = 0;
+    for(auto mip = 0u; mip < stored_mips; ++mip)
+    {
+        ENG_ASSERT(offset < data.size());
+        offset += gfx::get_renderer().staging->copy(img.get(), data.data() + offset, 0, mip, true,
+                                                    gfx::DiscardContents::YES);
     }
+    ENG_ASSERT(offset == data.size());
+    return img;
+}
 
-    asset.geometry_data.resize(0);
-    asset.geometry_data_futures.resize(0);
-    asset.image_data.resize(0);
+Handle<gfx::Image> StreamingManager::add_image(u64 hash, ParsedImageData&& data)
+{
+    StreamedImage img{ .hash = hash, .data = std::move(data) };
+    const auto block_data = gfx::get_block_data(img.data.format);
+    img.mip_offsets.push_back(0);
+    for(auto mip = 0u; mip < img.data.mips; ++mip)
+    {
+        const auto width = std::max(img.data.width >> mip, 1u);
+        const auto height = std::max(img.data.height >> mip, 1u);
+        const auto blocks_x = (width + block_data.texel_extent.x - 1) / block_data.texel_extent.x;
+        const auto blocks_y = (height + block_data.texel_extent.y - 1) / block_data.texel_extent.y;
+        img.mip_offsets.push_back(img.mip_offsets.back() + (usize)blocks_x * blocks_y * block_data.bytes_per_texel);
+        if(std::max(width, height) > min_resident_extent) { img.min_mip = std::min(mip + 1, img.data.mips - 1); }
+    }
+    ENG_ASSERT(img.mip_offsets.back() == img.data.get_data().size());
+    if(!img.data.validate(img.data.get_data().subspan(img.mip_offsets[img.min_mip])))
+    {
+        ENG_WARN("Image {} is corrupted (chunk checksum mismatch)", img.data.name.as_view());
+        return {};
+    }
+    img.resident_mip = img.wanted_mip = img.min_mip;
+    img.image = make_image_from_data(img.data.name.as_view(), std::max(img.data.width >> img.min_mip, 1u),
+                                     std::max(img.data.height >> img.min_mip, 1u), img.data.format,
+                                     img.data.mips - img.min_mip, img.data.get_data().subspan(img.mip_offsets[img.min_mip]));
+    if(!img.image) { return {}; }
+    m_resident_bytes += get_image_bytes(img, img.min_mip);
+    return m_images.insert_or_assign(hash, std::move(img)).first->second.image;
+}
 
-    ENG_LOG("Serializing asset {} finished. Written {} bytes.", asset.path.string(), required_size);
+void StreamingManager::remove_image(u64 hash)
+{
+    auto it = m_images.find(hash);
+    if(it == m_images.end()) { return; }
+    m_resident_bytes -= get_image_bytes(it->second, it->second.resident_mip);
+    gfx::get_renderer().queue_destroy(it->second.image);
+    m_images.erase(it);
+}
+
+Handle<gfx::Geometry> StreamingManager::add_geometry(u64 hash, const std::shared_future<ParsedGeometryData>& data)
+{
+    const auto& gd = data.get();
+    StreamedGeometry geom{ .data = data };
+    const auto lod_count = std::clamp((u32)gd.lods.size(), 1u, gfx::Geometry::MAX_LODS);
+    const auto vertex_bytes =
+        gd.positions.empty() ? 0 : (gd.positions.size() + gd.attributes.size()) * sizeof(float) / (gd.positions.size() / 3);
+    geom.lod_bytes.resize(lod_count + 1);
+    for(auto lod = (i32)std::min((u32)gd.lods.size(), lod_count) - 1; lod >= 0; --lod)
+    {
+        usize bytes = 0;
+        const auto range = gd.lods[lod].meshlet_range;
+        for(auto i = range.offset; i < range.offset + range.size; ++i)
+        {
+            const auto& mlt = gd.meshlets[i];
+            bytes += mlt.vertex_count * vertex_bytes + mlt.index_count * sizeof(u16) + sizeof(gfx::Meshlet) + sizeof(glm::vec4);
+        }
+        geom.lod_bytes[lod] = geom.lod_bytes[lod + 1] + bytes;
+    }
+    geom.wanted_lod = lod_count - 1;
+    geom.geometry = gfx::get_renderer().make_geometry(gfx::GeometryDescriptor{ .flags = {},
+                                                                               .vertex_layout = gd.vertex_layout,
+                                                                               .index_format = gfx::IndexFormat::U16,
+                                                                               .vertices = gd.positions,
+                                                                               .attributes = gd.attributes,
+                                                                               .indices = std::as_bytes(std::span{ gd.indices }),
+                                                                               .meshlets = gd.meshlets,
+                                                                               .meshlet_lods = gd.lods,
+                                                                               .bvh = gd.bvh.empty() ? nullptr : &gd.bvh,
+                                                                               .resident_lod = geom.wanted_lod });
+    if(!geom.geometry) { return {}; }
+    m_resident_bytes += geom.lod_bytes[geom.wanted_lod];
+    return m_geometries.insert_or_assign(hash, std::move(geom)).first->second.geometry;
+}
+
+void StreamingManager::remove_geometry(u64 hash)
+{
+    auto it = m_geometries.find(hash);
+    if(it == m_geometries.end()) { return; }
+    auto& geom = it->second;
+    if(geom.geometry->lod_count > 0) { set_geometry_lod(geom, geom.geometry->lod_count - 1); }
+    m_resident_bytes -= geom.lod_bytes[geom.geometry->lod_count > 0 ? geom.geometry->resident_lod : geom.wanted_lod];
+    m_geometries.erase(it);
+}
+
+void StreamingManager::add_image_user(u64 hash, Handle<gfx::Geometry> geometry)
+{
+    auto it = m_images.find(hash);
+    if(it == m_images.end()) { return; }
+    if(std::ranges::find(it->second.users, geometry) == it->second.users.end()) { it->second.users.push_back(geometry); }
+}
+
+void StreamingManager::update()
+{
+    const auto& demands = gfx::get_renderer().mesh_renderer.get_geometry_demand();
+    const auto get_demand = [&demands](Handle<gfx::Geometry> geometry) {
+        return *geometry < demands.size() ? demands[*geometry] : gfx::MeshRenderer::GeometryDemand{};
+    };
+
+    struct Candidate
+    {
+        StreamedImage* image{};
+        StreamedGeometry* geometry{};
+        float demand{};
+    };
+    std::vector<Candidate> stream_in;
+    std::vector<Candidate> stream_out;
+    for(auto& [hash, img] : m_images)
+    {
+        img.demand = 0.0f;
+        for(auto g : img.users)
+        {
+            img.demand = std::max(img.demand, get_demand(g).pixels);
+        }
+        // a texture stretched over the geometry once needs about as many texels as the pixels the geometry covers
+        img.wanted_mip = img.min_mip;
+        if(img.demand > 0.0f)
+        {
+            const auto extent = (float)std::max(img.data.width, img.data.height);
+            const auto mip = std::floor(std::log2(extent / img.demand) + mip_bias);
+            img.wanted_mip = (u32)std::clamp(mip, 0.0f, (float)img.min_mip);
+        }
+        if(img.wanted_mip < img.resident_mip) { stream_in.push_back(Candidate{ .image = &img, .demand = img.demand }); }
+        if(img.resident_mip < img.min_mip) { stream_out.push_back(Candidate{ .image = &img, .demand = img.demand }); }
+    }
+    for(auto& [hash, geom] : m_geometries)
+    {
+        const auto& g = geom.geometry.get();
+        if(g.lod_count == 0) { continue; } // not built yet
+        const auto demand = get_demand(geom.geometry);
+        geom.demand = demand.pixels;
+        geom.wanted_lod = demand.pixels > 0.0f ? std::min(demand.lod, g.lod_count - 1) : g.lod_count - 1;
+        if(geom.wanted_lod < g.resident_lod) { stream_in.push_back(Candidate{ .geometry = &geom, .demand = geom.demand }); }
+        if(g.resident_lod < g.lod_count - 1) { stream_out.push_back(Candidate{ .geometry = &geom, .demand = geom.demand }); }
+    }
+    std::ranges::sort(stream_in, [](const Candidate& a, const Candidate& b) { return a.demand > b.demand; });
+    std::ranges::sort(stream_out, [](const Candidate& a, const Candidate& b) { return a.demand < b.demand; });
+
+    usize streamed = 0;
+    const auto get_bytes = [this](const Candidate& c, std::optional<u32> level = {}) {
+        if(c.image) { return get_image_bytes(*c.image, level.value_or(c.image->resident_mip)); }
+        return c.geometry->lod_bytes[level.value_or(c.geometry->geometry->resident_lod)];
+    };
+    const auto set_level = [this, &streamed](const Candidate& c, u32 level) {
+        if(c.image)
+        {
+            if(set_image_mip(*c.image, level)) { streamed += get_image_bytes(*c.image, level); }
+            return;
+        }
+        const auto bytes = c.geometry->lod_bytes[c.geometry->geometry->resident_lod];
+        set_geometry_lod(*c.geometry, level);
+        streamed += c.geometry->lod_bytes[level] - std::min(bytes, c.geometry->lod_bytes[level]);
+    };
+    // streams out resources demanded less than max_demand until bytes fit in the budget
+    const auto make_room = [&](usize bytes, float max_demand) {
+        for(auto down_to_minimum : { false, true })
+        {
+            for(const auto& c : stream_out)
+            {
+                if(m_resident_bytes + bytes <= residency_budget) { return true; }
+                if(c.demand >= max_demand) { break; }
+                const auto level = c.image ? (down_to_minimum ? c.image->min_mip : c.image->wanted_mip)
+                                           : (down_to_minimum ? c.geometry->geometry->lod_count - 1 : c.geometry->wanted_lod);
+                const auto resident = c.image ? c.image->resident_mip : c.geometry->geometry->resident_lod;
+                if(level > resident) { set_level(c, level); }
+            }
+        }
+        return m_resident_bytes + bytes <= residency_budget;
+    };
+
+    // budget could have been lowered
+    make_room(0, std::numeric_limits<float>::max());
+    for(const auto& c : stream_in)
+    {
+        if(streamed >= stream_budget) { break; }
+        const auto wanted = c.image ? c.image->wanted_mip : c.geometry->wanted_lod;
+        const auto resident = c.image ? c.image->resident_mip : c.geometry->geometry->resident_lod;
+        if(wanted >= resident) { continue; } // was streamed in when making room
+        const auto bytes = get_bytes(c, wanted) - get_bytes(c);
+        // less demanded ones may still fit
+        if(!make_room(bytes, c.demand)) { continue; }
+        set_level(c, wanted);
+    }
+}
+
+bool StreamingManager::set_image_mip(StreamedImage& img, u32 mip)
+{
+    if(!img.data.validate(img.data.get_data().subspan(img.mip_offsets[mip])))
+    {
+        ENG_WARN("Image {} is corrupted (chunk checksum mismatch); mip {} is not streamed in", img.data.name.as_view(),
+                 mip);
+        return false;
+    }
+    const auto old_image = img.image;
+    const auto new_image = make_image_from_data(img.data.name.as_view(), std::max(img.data.width >> mip, 1u),
+                                                std::max(img.data.height >> mip, 1u), img.data.format,
+                                                img.data.mips - mip, img.data.get_data().subspan(img.mip_offsets[mip]));
+    if(!new_image)
+    {
+        ENG_WARN("Failed to stream image {} to mip {}", img.data.name.as_view(), mip);
+        return false;
+    }
+    m_resident_bytes = m_resident_bytes - get_image_bytes(img, img.resident_mip) + get_image_bytes(img, mip);
+    img.image = new_image;
+    img.resident_mip = mip;
+    gfx::get_renderer().replace_image(old_image, new_image);
+    if(on_image_replaced) { on_image_replaced(img.hash, old_image, new_image); }
+    return true;
+}
+
+void StreamingManager::set_geometry_lod(StreamedGeometry& geom, u32 lod)
+{
+    const auto resident_lod = geom.geometry->resident_lod;
+    if(lod < resident_lod) { gfx::get_renderer().stream_in_geometry_lods(geom.geometry, geom.data.get(), lod); }
+    else if(lod > resident_lod) { gfx::get_renderer().stream_out_geometry_lods(geom.geometry, lod); }
+    m_resident_bytes = m_resident_bytes - geom.lod_bytes[resident_lod] + geom.lod_bytes[geom.geometry->resident_lod];
+}
+
+std::vector<std::byte> serialize_asset(const Asset& asset)
+{
+    for(const auto& signal : asset.geometry_data_futures)
+    {
+        signal.wait();
+    }
+
+    // most of it is image data, which is known up front
+    usize image_bytes = 0;
+    for(const auto& imgd : asset.image_data)
+    {
+        image_bytes += imgd.get_data().size();
+    }
+    std::vector<std::byte> asset_bytes;
+    asset_bytes.reserve(image_bytes);
+    serialization::Context ctx{ asset_bytes };
+    asset.serialize(ctx);
+    asset_bytes.resize(ctx.m_offset);
+    return asset_bytes;
+}
+
+void ParsedImageData::serialize(serialization::Context& ctx) const
+{
+    ctx.serialize(name);
+    ctx.serialize(width);
+    ctx.serialize(height);
+    ctx.serialize(format);
+    ctx.serialize(mips);
+    // the same as serialized std::vector<std::byte>
+    const auto bytes = get_data();
+    ctx.serialize((u64)bytes.size());
+    ctx.safe_write(bytes.data(), bytes.size());
+}
+
+void ParsedImageData::deserialize(serialization::Context& ctx)
+{
+    ctx.deserialize(name);
+    ctx.deserialize(width);
+    ctx.deserialize(height);
+    ctx.deserialize(format);
+    ctx.deserialize(mips);
+    u64 size = 0;
+    ctx.deserialize(size);
+    // image data is stored the way it's uploaded, so it can be staged straight from the page cache
+    if(ctx.m_mapping)
+    {
+        data.clear();
+        mapped_data = ctx.view((usize)size);
+        mapping = ctx.m_mapping;
+        checksums = ctx.m_checksums;
+    }
+    else
+    {
+        mapped_data = {};
+        mapping.reset();
+        checksums.reset();
+        data.resize((usize)size);
+        ctx.safe_read(data.data(), data.size());
+    }
+}
+
+static void serialize_geometry(serialization::Context& ctx, const ParsedGeometryData& gd, VertexEncoding encoding)
+{
+    static constexpr auto ATTRIBUTE_FLOATS = 9ull;
+    const u64 vertex_count = gd.positions.size() / 3;
+    const u64 index_count = gd.indices.size();
+    const bool has_attributes = !gd.attributes.empty();
+    ENG_ASSERT(!has_attributes || gd.attributes.size() == vertex_count * ATTRIBUTE_FLOATS);
+    ctx.serialize(gd.vertex_layout);
+    ctx.serialize(encoding);
+    ctx.serialize(vertex_count);
+    ctx.serialize(index_count);
+    ctx.serialize(has_attributes);
+
+    if(encoding == VertexEncoding::QUANTIZED)
+    {
+        physics::AABB aabb{ glm::vec3{ 0.0f }, glm::vec3{ 0.0f } };
+        if(vertex_count > 0) { aabb = physics::AABB{}; }
+        for(auto i = 0ull; i < vertex_count; ++i)
+        {
+            aabb.grow(glm::vec3{ gd.positions[i * 3 + 0], gd.positions[i * 3 + 1], gd.positions[i * 3 + 2] });
+        }
+        ctx.serialize(aabb.min);
+        ctx.serialize(aabb.max);
+
+        std::vector<compression::QuantizedPosition> qpositions(vertex_count);
+        compression::quantize_positions(gd.positions, aabb.min, aabb.max, qpositions);
+        ctx.serialize(compression::encode_vertex_buffer(std::as_bytes(std::span{ qpositions }),
+                                                        sizeof(compression::QuantizedPosition)));
+        if(has_attributes)
+        {
+            std::vector<compression::QuantizedAttribute> qattributes(vertex_count);
+            compression::quantize_attributes(gd.attributes, qattributes);
+            ctx.serialize(compression::encode_vertex_buffer(std::as_bytes(std::span{ qattributes }),
+                                                            sizeof(compression::QuantizedAttribute)));
+        }
+    }
+    else
+    {
+        ctx.serialize(compression::encode_vertex_buffer(std::as_bytes(std::span{ gd.positions }), 3 * sizeof(float)));
+        if(has_attributes)
+        {
+            ctx.serialize(compression::encode_vertex_buffer(std::as_bytes(std::span{ gd.attributes }),
+                                                            ATTRIBUTE_FLOATS * sizeof(float)));
+        }
+    }
+
+    // meshlet indices are local to meshlet's vertices and padded between meshlets. the codec wants one triangle list,
+    // which compresses best when new vertices come in order, so the indices are made global for it.
+    std::vector<u32> triangles;
+    triangles.reserve(index_count);
+    for(const auto& mlt : gd.meshlets)
+    {
+        for(auto i = 0u; i < mlt.index_count; ++i)
+        {
+            triangles.push_back(mlt.vertex_offset + gd.indices[mlt.index_offset + i]);
+        }
+    }
+    ctx.serialize(compression::encode_index_buffer(triangles, vertex_count));
+    ctx.serialize(gd.meshlets);
+    ctx.serialize(gd.lods);
+    ctx.serialize(gd.bvh);
+}
+
+// Returns false if any of the streams failed to decode, or is corrupted.
+static bool deserialize_geometry(serialization::Context& ctx, ParsedGeometryData& gd)
+{
+    static constexpr auto ATTRIBUTE_FLOATS = 9ull;
+    VertexEncoding encoding{};
+    u64 vertex_count = 0;
+    u64 index_count = 0;
+    bool has_attributes = false;
+    ctx.deserialize(gd.vertex_layout);
+    ctx.deserialize(encoding);
+    ctx.deserialize(vertex_count);
+    ctx.deserialize(index_count);
+    ctx.deserialize(has_attributes);
+    gd.positions.resize(vertex_count * 3);
+    gd.attributes.resize(has_attributes ? vertex_count * ATTRIBUTE_FLOATS : 0);
+
+    // encoded streams are decoded straight from the serialized bytes, which may be the container's mapping; views
+    // aren't checked by the context, and these are decoded right away, so they are checked here
+    const auto view_encoded = [&ctx] {
+        u64 size = 0;
+        ctx.deserialize(size);
+        const auto offset = ctx.m_offset;
+        const auto bytes = ctx.view((usize)size);
+        if(bytes.size() != size || (ctx.m_checksums && !ctx.m_checksums->validate(offset, (usize)size)))
+        {
+            ctx.m_corrupted = true;
+        }
+        return ctx.m_corrupted ? std::span<const std::byte>{} : bytes;
+    };
+    std::span<const std::byte> encoded;
+    bool ok = true;
+    if(encoding == VertexEncoding::QUANTIZED)
+    {
+        glm::vec3 aabb_min, aabb_max;
+        ctx.deserialize(aabb_min);
+        ctx.deserialize(aabb_max);
+
+        std::vector<compression::QuantizedPosition> qpositions(vertex_count);
+        encoded = view_encoded();
+        ok &= compression::decode_vertex_buffer(encoded, sizeof(compression::QuantizedPosition),
+                                                std::as_writable_bytes(std::span{ qpositions }));
+        compression::dequantize_positions(qpositions, aabb_min, aabb_max, gd.positions);
+        if(has_attributes)
+        {
+            std::vector<compression::QuantizedAttribute> qattributes(vertex_count);
+            encoded = view_encoded();
+            ok &= compression::decode_vertex_buffer(encoded, sizeof(compression::QuantizedAttribute),
+                                                    std::as_writable_bytes(std::span{ qattributes }));
+            compression::dequantize_attributes(qattributes, gd.attributes);
+        }
+    }
+    else
+    {
+        encoded = view_encoded();
+        ok &= compression::decode_vertex_buffer(encoded, 3 * sizeof(float),
+                                                std::as_writable_bytes(std::span{ gd.positions }));
+        if(has_attributes)
+        {
+            encoded = view_encoded();
+            ok &= compression::decode_vertex_buffer(encoded, ATTRIBUTE_FLOATS * sizeof(float),
+                                                    std::as_writable_bytes(std::span{ gd.attributes }));
+        }
+    }
+
+    encoded = view_encoded();
+    ctx.deserialize(gd.meshlets);
+    ctx.deserialize(gd.lods);
+    ctx.deserialize(gd.bvh);
+
+    u64 triangle_index_count = 0;
+    for(const auto& mlt : gd.meshlets)
+    {
+        triangle_index_count += mlt.index_count;
+    }
+    std::vector<u32> triangles(triangle_index_count);
+    ok &= compression::decode_index_buffer(encoded, triangles);
+    gd.indices.assign(index_count, 0);
+    auto tri = 0ull;
+    for(const auto& mlt : gd.meshlets)
+    {
+        if(!ok || (u64)mlt.index_offset + mlt.index_count > index_count || tri + mlt.index_count > triangles.size())
+        {
+            ok = false;
+            break;
+        }
+        for(auto i = 0u; i < mlt.index_count; ++i)
+        {
+            gd.indices[mlt.index_offset + i] = (u16)(triangles[tri++] - mlt.vertex_offset);
+        }
+    }
+    return ok && !ctx.m_corrupted;
+}
+
+template <typename T> using HandleIndices = std::unordered_map<Handle<T>, u32>;
+
+// Duplicate handles resolve to the first of them.
+template <typename T> static HandleIndices<T> make_handle_indices(const std::vector<Handle<T>>& handles)
+{
+    HandleIndices<T> indices;
+    indices.reserve(handles.size());
+    for(auto i = 0u; i < handles.size(); ++i)
+    {
+        indices.emplace(handles[i], i);
+    }
+    return indices;
+}
+
+template <typename T> static u32 get_handle_index(const HandleIndices<T>& indices, Handle<T> handle, u32 not_found)
+{
+    const auto it = indices.find(handle);
+    return it != indices.end() ? it->second : not_found;
 }
 
 void Asset::serialize(serialization::Context& ctx) const
@@ -443,13 +1330,16 @@ void Asset::serialize(serialization::Context& ctx) const
     ENG_ASSERT(images.size() == image_data.size());
     ctx.serialize(image_data);
 
+    // handles are serialized as indices into their vectors
+    const auto image_indices = make_handle_indices(images);
+    const auto geometry_indices = make_handle_indices(geometries);
+    const auto material_indices = make_handle_indices(materials);
+
     const u64 tex_count = textures.size();
     ctx.serialize(tex_count);
     for(auto txt : textures)
     {
-        auto it = std::ranges::find(images, txt.image);
-        ENG_ASSERT(it != images.end());
-        *txt.image = (u64)std::distance(images.begin(), it);
+        *txt.image = get_handle_index(image_indices, txt.image, (u32)images.size());
         ENG_ASSERT(*txt.image < images.size());
         ctx.serialize(txt);
     }
@@ -459,44 +1349,40 @@ void Asset::serialize(serialization::Context& ctx) const
     ctx.serialize(geom_count);
     for(const auto& gdf : geometry_data_futures)
     {
-        const auto& gd = gdf.get();
-        ctx.serialize(gd);
+        serialize_geometry(ctx, gdf.get(), vertex_encoding);
     }
 
-    const u64 mat_count = materials.size();
+    ENG_ASSERT(materials.size() == material_data.size());
+    const u64 mat_count = material_data.size();
     ctx.serialize(mat_count);
-    for(const auto& math : materials)
+    for(auto mat : material_data)
     {
-        auto mat = math.get();
         if(mat.base_color_texture)
         {
-            auto idx = std::distance(images.begin(), std::ranges::find(images, mat.base_color_texture.image));
+            const auto idx = get_handle_index(image_indices, mat.base_color_texture.image, (u32)images.size());
             *mat.base_color_texture.image = idx;
             if(idx == images.size()) { mat.base_color_texture.image = {}; }
         }
         if(mat.normal_texture)
         {
-            *mat.normal_texture.image = std::distance(images.begin(), std::ranges::find(images, mat.normal_texture.image));
+            *mat.normal_texture.image = get_handle_index(image_indices, mat.normal_texture.image, (u32)images.size());
         }
         if(mat.metallic_roughness_texture)
         {
             *mat.metallic_roughness_texture.image =
-                std::distance(images.begin(), std::ranges::find(images, mat.metallic_roughness_texture.image));
+                get_handle_index(image_indices, mat.metallic_roughness_texture.image, (u32)images.size());
         }
         mat.mesh_pass = {};
         ctx.serialize(mat);
     }
 
-    const u64 mesh_count = meshes.size();
+    ENG_ASSERT(meshes.size() == mesh_data.size());
+    const u64 mesh_count = mesh_data.size();
     ctx.serialize(mesh_count);
-    for(const auto& meshh : meshes)
+    for(auto mesh : mesh_data)
     {
-        auto mesh = meshh.get();
-        *mesh.geometry = (u64)std::distance(geometries.begin(), std::ranges::find(geometries, mesh.geometry));
-        if(mesh.material)
-        {
-            *mesh.material = (u64)std::distance(materials.begin(), std::ranges::find(materials, mesh.material));
-        }
+        *mesh.geometry = get_handle_index(geometry_indices, mesh.geometry, (u32)geometries.size());
+        if(mesh.material) { *mesh.material = get_handle_index(material_indices, mesh.material, (u32)materials.size()); }
         ctx.serialize(mesh);
     }
 
@@ -505,6 +1391,18 @@ void Asset::serialize(serialization::Context& ctx) const
     ctx.serialize(root_nodes);
 }
 
+u64 Asset::get_schema_hash()
+{
+    // everything serialized through get_struct_fields; the rest is covered by VERSION
+    static constexpr auto schema_hash =
+        ENG_HASH(VERSION, serialization::get_schema_hash<gfx::ImageView>(), serialization::get_schema_hash<gfx::Material>(),
+                 serialization::get_schema_hash<gfx::Mesh>(), serialization::get_schema_hash<gfx::Meshlet>(),
+                 serialization::get_schema_hash<gfx::GeometryLOD>(), serialization::get_schema_hash<Node>());
+    return schema_hash;
+}
+
+// Reads only the cpu data; handles are placeholder indices into it, the same as after headless import.
+// AssetManager makes renderer objects from it later.
 void Asset::deserialize(serialization::Context& ctx)
 {
     std::string pathstr;
@@ -512,98 +1410,47 @@ void Asset::deserialize(serialization::Context& ctx)
     path = pathstr;
     ENG_ASSERT(!path.empty());
 
-    u64 image_count = 0;
-    ctx.deserialize(image_count);
-    images.resize(image_count);
-    assets::ParsedImageData imgd{};
-    auto* mip_cmd = gfx::get_renderer().current_data->cmdpool->begin();
-    for(auto i = 0u; i < image_count; ++i)
+    ctx.deserialize(image_data);
+    images.resize(image_data.size());
+    for(auto i = 0u; i < images.size(); ++i)
     {
-        u64 pixel_data_size = 0;
-        ctx.deserialize(imgd.name);
-        ctx.deserialize(imgd.width);
-        ctx.deserialize(imgd.height);
-        ctx.deserialize(imgd.format);
-        ctx.deserialize(pixel_data_size);
-
-        images[i] = gfx::get_renderer().make_image(imgd.name, gfx::Image::init(imgd.width, imgd.height, 0, imgd.format,
-                                                                               gfx::ImageUsage::SAMPLED_BIT | gfx::ImageUsage::TRANSFER_DST_BIT |
-                                                                                   gfx::ImageUsage::TRANSFER_SRC_BIT,
-                                                                               0, 1, gfx::ImageLayout::READ_ONLY));
-        if(!images[i])
-        {
-            ENG_WARN("Failed to create image {}", imgd.name.empty() ? "EMPTY IMAGE NAME" : imgd.name.as_view());
-            ctx.m_offset += pixel_data_size;
-            continue;
-        }
-        else
-        {
-            // Zero-copy read directly from the streaming context buffer
-            gfx::get_renderer().staging->copy(images[i].get(), ctx.m_bytes.data() + ctx.m_offset, 0, 0, false,
-                                              gfx::DiscardContents::YES);
-            mip_cmd->generate_mips(images[i].get());
-        }
-        ctx.m_offset += pixel_data_size;
+        images[i] = Handle<gfx::Image>{ i };
     }
-    gfx::get_renderer().current_data->cmdpool->end(mip_cmd);
-    auto* mip_sync = gfx::get_renderer().current_data->get_sync();
-    mip_cmd->wait_sync(gfx::get_renderer().staging->flush(true), gfx::PipelineStage::TRANSFER_BIT);
-    mip_cmd->signal_sync(mip_sync, gfx::PipelineStage::FRAGMENT_BIT);
-    gfx::get_renderer().gq->with_cmd_buf(mip_cmd).submit();
-    gfx::get_renderer().current_data->wait_syncs.push_back(mip_sync);
 
-    u64 texture_count = 0;
-    ctx.deserialize(texture_count);
-    textures.resize(texture_count);
-    for(auto& txt : textures)
-    {
-        ctx.deserialize(txt);
-        txt.image = images[(u32)*txt.image];
-    }
+    // serialized with indices of images, which are the placeholders
+    ctx.deserialize(textures);
 
     u64 geom_count = 0;
     ctx.deserialize(geom_count);
     geometries.resize(geom_count);
-    assets::ParsedGeometryData geom;
     for(u64 i = 0; i < geom_count; ++i)
     {
-        ctx.deserialize(geom);
-        geometries[i] =
-            gfx::get_renderer().make_geometry(gfx::GeometryDescriptor{ .flags = {},
-                                                                       .vertex_layout = geom.vertex_layout,
-                                                                       .index_format = gfx::IndexFormat::U16,
-                                                                       .vertices = geom.positions,
-                                                                       .attributes = geom.attributes,
-                                                                       .indices = std::as_bytes(std::span{ geom.indices }),
-                                                                       .meshlets = geom.meshlets });
+        assets::ParsedGeometryData geom;
+        if(!deserialize_geometry(ctx, geom))
+        {
+            // the caller imports the asset again, instead of uploading broken geometry
+            ENG_WARN("Failed to decode geometry {} of asset {}", i, path.string());
+            ctx.m_corrupted = true;
+            return;
+        }
+        geometries[i] = Handle<gfx::Geometry>{ (u32)i };
+        auto& signal = geometry_data.emplace_back();
+        signal.set_value(std::move(geom));
+        geometry_data_futures.push_back(signal.get_future().share());
     }
 
-    u64 material_count = 0;
-    ctx.deserialize(material_count);
-    materials.resize(material_count);
-    gfx::Material mat;
-    for(u64 i = 0; i < material_count; ++i)
+    ctx.deserialize(material_data);
+    materials.resize(material_data.size());
+    for(auto i = 0u; i < materials.size(); ++i)
     {
-        ctx.deserialize(mat);
-        if(mat.base_color_texture) { mat.base_color_texture = textures[(u32)*mat.base_color_texture.image]; }
-        if(mat.normal_texture) { mat.normal_texture = textures[(u32)*mat.normal_texture.image]; }
-        if(mat.metallic_roughness_texture)
-        {
-            mat.metallic_roughness_texture = textures[(u32)*mat.metallic_roughness_texture.image];
-        }
-        materials[i] = gfx::get_renderer().make_material(mat);
+        materials[i] = Handle<gfx::Material>{ i };
     }
 
-    u64 mesh_count = 0;
-    ctx.deserialize(mesh_count);
-    meshes.resize(mesh_count);
-    gfx::Mesh mesh;
-    for(u64 i = 0; i < mesh_count; ++i)
+    ctx.deserialize(mesh_data);
+    meshes.resize(mesh_data.size());
+    for(auto i = 0u; i < meshes.size(); ++i)
     {
-        ctx.deserialize(mesh);
-        if(mesh.material) { mesh.material = materials[(u32)*mesh.material]; }
-        if(mesh.geometry) { mesh.geometry = geometries[(u32)*mesh.geometry]; }
-        meshes[i] = gfx::get_renderer().make_mesh(gfx::MeshDescriptor{ mesh.geometry, mesh.material });
+        meshes[i] = Handle<gfx::Mesh>{ i };
     }
 
     ctx.deserialize(nodes);
@@ -4,12 +4,16 @@
 #include <mutex>
 #include <shared_mutex>
 #include <future>
+#include <condition_variable>
+#include <limits>
+#include <eng/common/callback.hpp>
 
 #include <eng/common/handle.hpp>
 #include <eng/common/types.hpp>
 #include <eng/ecs/components.hpp>
 #include <eng/fs/fs.hpp>
 #include <eng/assets/serialization.hpp>
+#include <eng/physics/bvh.hpp>
 
 namespace eng
 {
@@ -31,43 +35,60 @@ struct Node
     Range32u children{};
 };
 
+// How vertices of ParsedGeometryData are stored in engb. Either way the streams are compressed with
+// meshoptimizer codecs, and loaded geometry always gets float vertices back.
+enum class VertexEncoding : u8
+{
+    FLOAT,
+    QUANTIZED, // see eng/assets/vertex_compression.hpp
+};
+
 struct ParsedGeometryData
 {
-    static constexpr auto get_struct_fields()
-    {
-        return std::make_tuple(serialization::StructField{ &ParsedGeometryData::vertex_layout },
-                               serialization::StructField{ &ParsedGeometryData::positions },
-                               serialization::StructField{ &ParsedGeometryData::attributes },
-                               serialization::StructField{ &ParsedGeometryData::indices },
-                               serialization::StructField{ &ParsedGeometryData::meshlets });
-    }
     Flags<gfx::VertexComponent> vertex_layout;
     std::vector<float> positions{};
     std::vector<float> attributes{};
     std::vector<u16> indices{};
     std::vector<gfx::Meshlet> meshlets{};
+    std::vector<gfx::GeometryLOD> lods{}; // meshlets of each level of detail, from the full one
+    physics::BVH bvh{};                   // built over meshletized positions of the full level of detail
 };
 using ParsedGeometryReadySignal = std::promise<ParsedGeometryData>;
 
 struct ParsedImageData
 {
-    static constexpr auto get_struct_fields()
-    {
-        return std::make_tuple(serialization::StructField{ &ParsedImageData::name },
-                               serialization::StructField{ &ParsedImageData::width },
-                               serialization::StructField{ &ParsedImageData::height },
-                               serialization::StructField{ &ParsedImageData::format },
-                               serialization::StructField{ &ParsedImageData::data });
-    }
+    void serialize(serialization::Context& ctx) const;
+    // Views the mips in the context's mapping, if it has one, instead of copying them into data.
+    void deserialize(serialization::Context& ctx);
+
+    std::span<const std::byte> get_data() const { return mapping ? mapped_data : std::span<const std::byte>{ data }; }
+    // Checks a part of get_data() against checksums of the engb entry it's viewed in, before it's used.
+    bool validate(std::span<const std::byte> bytes) const { return !checksums || checksums->validate(bytes); }
+
     StackString<128> name;
     u32 width{};
     u32 height{};
     gfx::ImageFormat format{};
-    std::vector<std::byte> data;
+    u32 mips{ 1 };
+    std::vector<std::byte> data;            // mips one after another
+    std::span<const std::byte> mapped_data; // in place of data, when read from a mapped engb container
+    fs::MappedFilePtr mapping;              // keeps mapped_data valid
+    std::shared_ptr<serialization::ChunkChecksums> checksums; // of the entry with mapped_data; null if it's checked
 };
 
+// Makes sampled image with stored_mips mips and uploads them from data, where they are stored one after another.
+// Mips are made at import, so nothing is generated on the gpu.
+Handle<gfx::Image> make_image_from_data(std::string_view name, u32 width, u32 height, gfx::ImageFormat format,
+                                        u32 stored_mips, std::span<const std::byte> data);
+
 struct Asset
 {
+    // version of the serialized representation in engb containers; bump when it changes
+    inline static constexpr u8 VERSION = 4;
+    // Of the layout of types serialized through get_struct_fields, combined with VERSION. Entries in engb containers
+    // with a different one are stale, and are imported again.
+    static u64 get_schema_hash();
+
     Asset() noexcept = default;
     Asset(const Asset&) = delete;
     Asset& operator=(const Asset&) = delete;
@@ -87,28 +108,179 @@ struct Asset
     std::vector<Node> nodes;
     std::vector<u32> root_nodes;
 
+    VertexEncoding vertex_encoding{ VertexEncoding::FLOAT }; // of geometry_data when serializing
     std::deque<assets::ParsedGeometryReadySignal> geometry_data;
     std::deque<std::shared_future<assets::ParsedGeometryData>> geometry_data_futures;
     std::vector<assets::ParsedImageData> image_data;
+    std::vector<gfx::Material> material_data; // as imported, with textures of this asset; serialized instead of renderer's copies
+    std::vector<gfx::Mesh> mesh_data;
+};
+
+// Serializes the asset into bytes stored in engb containers. Waits for all the geometry data.
+std::vector<std::byte> serialize_asset(const Asset& asset);
+
+enum class AssetRequestState : u8
+{
+    QUEUED,    // waiting for a loading thread
+    LOADING,   // being read from engb or imported on a loading thread
+    UPLOADING, // cpu data is ready; renderer objects are made from it over a few updates
+    LOADED,
+    FAILED,
+    CANCELLED,
+    RELEASED,
+};
+
+/*
+    Asset loads in two phases. Loading threads read it from engb, or import it, into an asset
+    holding only cpu data, with handles being placeholder indices into it (see ImportSettings::HEADLESS_BIT).
+    Then AssetManager::update makes renderer objects from it on the main thread, within upload budget.
+*/
+struct AssetRequest
+{
+    fs::Path path;
+    i32 priority{}; // higher loads first; guarded by queue mutex
+    std::atomic<AssetRequestState> state{ AssetRequestState::QUEUED };
+    std::atomic<bool> cancel_requested{};
+    Asset asset;
+    u32 uploaded_images{};
+    u32 uploaded_geometries{};
+    // content hashes of the asset's resources, keys into AssetManager's shared resources
+    std::vector<u64> image_hashes;
+    std::vector<u64> geometry_hashes;
+    std::vector<u64> material_hashes;
+    std::vector<Callback<void(const Asset&)>> on_loaded; // called on the main thread; with null asset if loading failed
+};
+
+/*
+    Texture and geometry streaming. Images start with only their smallest mips, and geometries with only their
+    coarsest level of detail. Every update, demand for each of them is found from projected sizes of the geometries
+    mesh renderer draws, and the most demanded ones are streamed in towards it first. When that would go over the
+    residency budget, the least demanded ones are streamed out, first down to what they are demanded at, and then
+    down to their smallest mips or coarsest level. Mips and levels of detail stay on cpu, so streaming out frees only
+    gpu memory. Images change mips by being made anew, so their handles change.
+*/
+class StreamingManager
+{
+  public:
+    // Makes the image with mips from the first one not bigger than min_resident_extent. Returns null if it failed.
+    Handle<gfx::Image> add_image(u64 hash, ParsedImageData&& data);
+    // Destroys the image, whatever its handle is by now.
+    void remove_image(u64 hash);
+    // Makes the geometry with only its coarsest level of detail; data has to be ready.
+    Handle<gfx::Geometry> add_geometry(u64 hash, const std::shared_future<ParsedGeometryData>& data);
+    // Streams out all but the coarsest level of detail, which stays, as renderer never frees geometries.
+    void remove_geometry(u64 hash);
+    // Image's demand is the biggest demand of geometries drawn with it.
+    void add_image_user(u64 hash, Handle<gfx::Geometry> geometry);
+    // Streams in and out within stream_budget bytes of uploads.
+    void update();
+    usize get_resident_bytes() const { return m_resident_bytes; }
+
+    usize residency_budget{ 1024ull * 1024 * 1024 }; // bytes of image and geometry data on the gpu
+    usize stream_budget{ 32ull * 1024 * 1024 };      // bytes uploaded per update
+    u32 min_resident_extent{ 64 };                   // mips at most this big are always resident
+    float mip_bias{};                                // added to demanded mip
+    // called for every image made anew with different mips
+    Callback<void(u64 hash, Handle<gfx::Image> old_image, Handle<gfx::Image> new_image)> on_image_replaced;
+
+  private:
+    struct StreamedImage
+    {
+        u64 hash{};
+        ParsedImageData data;
+        std::vector<usize> mip_offsets; // into data, with its size last
+        Handle<gfx::Image> image;
+        std::vector<Handle<gfx::Geometry>> users;
+        u32 min_mip{};      // biggest of the mips that are always resident
+        u32 resident_mip{}; // biggest resident mip
+        u32 wanted_mip{};
+        float demand{}; // pixels
+    };
+    struct StreamedGeometry
+    {
+        std::shared_future<ParsedGeometryData> data;
+        Handle<gfx::Geometry> geometry;
+        std::vector<usize> lod_bytes; // bytes of levels of detail from i to the coarsest one
+        u32 wanted_lod{};
+        float demand{}; // pixels
+    };
+
+    usize get_image_bytes(const StreamedImage& img, u32 mip) const { return img.data.get_data().size() - img.mip_offsets[mip]; }
+    bool set_image_mip(StreamedImage& img, u32 mip);
+    void set_geometry_lod(StreamedGeometry& geom, u32 lod);
+
+    std::unordered_map<u64, StreamedImage> m_images;
+    std::unordered_map<u64, StreamedGeometry> m_geometries;
+    usize m_resident_bytes{};
 };
 
 class AssetManager
 {
   public:
+    static constexpr i32 SYNC_PRIORITY = std::numeric_limits<i32>::max();
+
     void init();
+    // Processes finished loads; makes renderer objects of at most upload_budget bytes and calls completion callbacks.
+    void update();
+
+    // Blocks until the asset is loaded and uploaded.
     const Asset& get_asset(const fs::Path& file_path);
+    // Queues the asset for loading on the loading threads. Requesting the same path again returns the same request,
+    // raising its priority if the new one is higher.
+    Handle<AssetRequest> request_asset(const fs::Path& file_path, i32 priority = 0,
+                                       Callback<void(const Asset&)> on_loaded = {});
+    AssetRequestState get_state(Handle<AssetRequest> request) const;
+    // Returns null until the asset is loaded.
+    const Asset* try_get_asset(Handle<AssetRequest> request) const;
+    // Succeeds only until renderer objects start being made. Callbacks of cancelled requests are not called.
+    bool cancel(Handle<AssetRequest> request);
+    // Drops the loaded asset's references to shared resources. Images nothing else uses are destroyed; geometries and
+    // materials are only forgotten, as renderer never frees them.
+    void release(Handle<AssetRequest> request);
+
+    usize upload_budget{ 64ull * 1024 * 1024 }; // bytes of image and geometry data per update
+    // Compresses assets written to engb containers. Uncompressed ones are read without copies, but are much bigger.
+    bool compress_assets{ true };
+    StreamingManager streaming;
 
   private:
     serialization::engb::Container& get_latest_container();
     std::optional<serialization::engb::List> try_find_list_by_hash(u64 hash, serialization::engb::Container** out_container = nullptr);
 
     std::optional<Asset> try_deserialize_asset(const fs::Path& file_path);
-    void serialize_asset_to_enbc_thread(Asset& asset);
+    std::optional<Asset> import_asset(const fs::Path& file_path);
+    void write_asset_to_container(const Asset& asset);
+
+    void loading_thread(std::stop_token stop);
+    void load_request(AssetRequest& request);
+    bool upload_request(AssetRequest& request, usize& budget);
+    void finish_request(AssetRequest& request);
+    void on_image_replaced(u64 hash, Handle<gfx::Image> old_image, Handle<gfx::Image> new_image);
+
+    // Identical resources of all the loaded assets, found by content hash, resolve to one renderer object.
+    template <typename T> struct SharedResource
+    {
+        Handle<T> handle;
+        u32 refs{};
+    };
+
+    std::vector<std::unique_ptr<AssetRequest>> m_requests; // indexed by request handles; main thread only
+    std::unordered_map<fs::Path, Handle<AssetRequest>> m_requests_map;
+    std::vector<AssetRequest*> m_load_queue;
+    std::vector<AssetRequest*> m_finished_loads; // loaded on cpu, failed or cancelled by loading threads
+    std::mutex m_queue_mutex;
+    std::condition_variable_any m_queue_cv;
+    std::vector<AssetRequest*> m_uploads; // main thread only
+    std::unordered_map<u64, SharedResource<gfx::Image>> m_shared_images;
+    std::unordered_map<u64, SharedResource<gfx::Geometry>> m_shared_geometries;
+    std::unordered_map<u64, SharedResource<gfx::Material>> m_shared_materials;
 
-    std::unordered_map<fs::Path, Asset> m_loaded_assets_map;
-    std::vector<serialization::engb::Container> m_engb_containers_vec; // assetN, assetN-1, assetN-2; from newest to oldest
+    // loose ones from newest to oldest (assetN, assetN-1, ...), then read-only ones from mounted pack archives;
+    // a deque, so containers stay in place when a loose one is put in front of packed ones
+    std::deque<serialization::engb::Container> m_engb_containers_vec;
+    std::unordered_map<u64, u32> m_engb_index; // path hash to the newest of m_engb_containers_vec having the asset
     std::shared_mutex m_engbc_vec_mutex;
-    std::vector<std::unique_ptr<std::jthread>> m_serializing_threads;
+    std::vector<std::jthread> m_loading_threads; // last, so they are stopped before anything they use is destroyed
 };
 
 } // namespace assets
@@ -0,0 +1,141 @@
+#include "compression.hpp"
+#include <eng/common/hash.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <zlib/zlib.h>
+
+namespace eng
+{
+namespace compression
+{
+
+static constexpr usize CHUNKED_HEADER_BYTES = 1 + 3 + 4 + 4;
+
+bool compress_chunk(Codec codec, std::span<const std::byte> src, std::span<std::byte> out, usize& out_size)
+{
+    out_size = 0;
+    switch(codec)
+    {
+    case Codec::ZLIB:
+    {
+        // meant to stay on for everything, so the fastest level is used; decompression is as fast for all of them
+        uLongf size = (uLongf)out.size();
+        const auto ret = compress2((Bytef*)out.data(), &size, (const Bytef*)src.data(), (uLong)src.size(), Z_BEST_SPEED);
+        out_size = size;
+        return ret == Z_OK;
+    }
+    default:
+    {
+        return false;
+    }
+    }
+}
+
+bool decompress_chunk(Codec codec, std::span<const std::byte> src, std::span<std::byte> out)
+{
+    switch(codec)
+    {
+    case Codec::STORE:
+    {
+        if(src.size() != out.size()) { return false; }
+        std::memcpy(out.data(), src.data(), src.size());
+        return true;
+    }
+    case Codec::ZLIB:
+    {
+        uLongf size = (uLongf)out.size();
+        const auto ret = uncompress((Bytef*)out.data(), &size, (const Bytef*)src.data(), (uLong)src.size());
+        return ret == Z_OK && size == out.size();
+    }
+    default:
+    {
+        return false;
+    }
+    }
+}
+
+std::vector<std::byte> compress_chunked(std::span<const std::byte> src, Codec codec, usize chunk_size)
+{
+    ENG_ASSERT(chunk_size > 0 && chunk_size <= std::numeric_limits<u32>::max());
+    const auto chunk_count = (u32)((src.size() + chunk_size - 1) / chunk_size);
+    std::vector<u32> chunk_ids(chunk_count);
+    std::iota(chunk_ids.begin(), chunk_ids.end(), 0u);
+
+    // every chunk is compressed in place of its uncompressed bytes, so stored ones fit as well
+    std::vector<std::byte> chunks(src.size());
+    std::vector<u32> sizes(chunk_count);
+    std::vector<u64> checksums(chunk_count);
+    std::for_each(std::execution::par, chunk_ids.begin(), chunk_ids.end(), [&](u32 i) {
+        const auto chunk = src.subspan(i * chunk_size, std::min(chunk_size, src.size() - i * chunk_size));
+        const auto slot = std::span{ chunks }.subspan(i * chunk_size, chunk.size());
+        // it has to get smaller, as stored chunks are told apart by their size
+        usize size = 0;
+        if(compress_chunk(codec, chunk, slot.first(chunk.size() - 1), size)) { sizes[i] = (u32)size; }
+        else
+        {
+            std::memcpy(slot.data(), chunk.data(), chunk.size());
+            sizes[i] = (u32)chunk.size();
+        }
+        checksums[i] = hash::xxh64(slot.data(), sizes[i]);
+    });
+
+    const auto total_size = std::accumulate(sizes.begin(), sizes.end(), 0ull);
+    const auto table_size = chunk_count * (sizeof(u32) + sizeof(u64));
+    std::vector<std::byte> out(CHUNKED_HEADER_BYTES + table_size + total_size);
+    out[0] = (std::byte)codec;
+    const auto chunk_size32 = (u32)chunk_size;
+    std::memcpy(&out[4], &chunk_size32, sizeof(u32));
+    std::memcpy(&out[8], &chunk_count, sizeof(u32));
+    std::memcpy(&out[CHUNKED_HEADER_BYTES], sizes.data(), chunk_count * sizeof(u32));
+    std::memcpy(&out[CHUNKED_HEADER_BYTES + chunk_count * sizeof(u32)], checksums.data(), chunk_count * sizeof(u64));
+    auto offset = CHUNKED_HEADER_BYTES + table_size;
+    for(auto i = 0u; i < chunk_count; ++i)
+    {
+        std::memcpy(&out[offset], &chunks[i * chunk_size], sizes[i]);
+        offset += sizes[i];
+    }
+    return out;
+}
+
+bool decompress_chunked(std::span<const std::byte> src, std::span<std::byte> out)
+{
+    if(src.size() < CHUNKED_HEADER_BYTES) { return false; }
+    const auto codec = (Codec)src[0];
+    u32 chunk_size = 0;
+    u32 chunk_count = 0;
+    std::memcpy(&chunk_size, &src[4], sizeof(u32));
+    std::memcpy(&chunk_count, &src[8], sizeof(u32));
+    if(chunk_size == 0 || (usize)chunk_count != (out.size() + chunk_size - 1) / chunk_size) { return false; }
+    const auto table_size = (usize)chunk_count * (sizeof(u32) + sizeof(u64));
+    if(src.size() < CHUNKED_HEADER_BYTES + table_size) { return false; }
+
+    std::vector<u32> sizes(chunk_count);
+    std::vector<u64> checksums(chunk_count);
+    std::memcpy(sizes.data(), &src[CHUNKED_HEADER_BYTES], chunk_count * sizeof(u32));
+    std::memcpy(checksums.data(), &src[CHUNKED_HEADER_BYTES + chunk_count * sizeof(u32)], chunk_count * sizeof(u64));
+    std::vector<usize> offsets(chunk_count);
+    std::exclusive_scan(sizes.begin(), sizes.end(), offsets.begin(), CHUNKED_HEADER_BYTES + table_size);
+    if(chunk_count > 0 && offsets.back() + sizes.back() > src.size()) { return false; }
+
+    std::vector<u32> chunk_ids(chunk_count);
+    std::iota(chunk_ids.begin(), chunk_ids.end(), 0u);
+    std::atomic<bool> success{ true };
+    std::for_each(std::execution::par, chunk_ids.begin(), chunk_ids.end(), [&](u32 i) {
+        const auto chunk = out.subspan((usize)i * chunk_size, std::min((usize)chunk_size, out.size() - (usize)i * chunk_size));
+        const auto stored = src.subspan(offsets[i], sizes[i]);
+        if(hash::xxh64(stored.data(), stored.size()) != checksums[i])
+        {
+            success = false;
+            return;
+        }
+        if(!decompress_chunk(stored.size() == chunk.size() ? Codec::STORE : codec, stored, chunk)) { success = false; }
+    });
+    return success;
+}
+
+} // namespace compression
+} // namespace eng
@@ -1,96 +1,39 @@
 #pragma once
 
-#include <type_traits>
 #include <cstddef>
 #include <span>
-#include <zlib/zlib.h>
+#include <vector>
+#include <eng/common/types.hpp>
 
 namespace eng
 {
 namespace compression
 {
 
-inline constexpr size_t ZLIB_SCRATCH_SIZE = 256 * 1024;
-
-template <typename InputCallback, typename OutputCallback>
-inline bool zlib_deflate(const InputCallback& input_callback, const OutputCallback& output_callback)
-    requires(std::is_invocable_r_v<std::span<const std::byte>, InputCallback, size_t> &&
-             std::is_invocable_v<OutputCallback, std::span<const std::byte>>)
+/*
+    Chunked compression of engb payloads. Data is split into fixed-size chunks compressed independently, so they
+    are compressed and decompressed in parallel. Chunks that don't get smaller are stored as they are.
+    Every chunk has an xxh64 checksum of its stored bytes, checked by the thread decompressing it, so corrupted
+    data is found when it's read, at the cost of a pass over the compressed bytes only.
+    Layout: 1B codec, 3B padding, 4B chunk size, 4B chunk count, 4B stored size of every chunk,
+    8B checksum of every chunk, chunks.
+*/
+enum class Codec : u8
 {
-    z_stream strm{};
-    if(deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) { return false; }
-
-    unsigned char scratch[ZLIB_SCRATCH_SIZE];
-    bool success = true;
-    int flush = Z_NO_FLUSH;
-
-    while(true)
-    {
-        std::span<const std::byte> input = input_callback(ZLIB_SCRATCH_SIZE);
-        strm.next_in = (Bytef*)input.data();
-        strm.avail_in = input.size();
-        if(input.empty()) { flush = Z_FINISH; }
+    STORE, // no compression
+    ZLIB,
+};
 
-        int ret;
-        do
-        {
-            strm.next_out = scratch;
-            strm.avail_out = ZLIB_SCRATCH_SIZE;
-            ret = deflate(&strm, flush);
-            if(ret == Z_STREAM_ERROR)
-            {
-                success = false;
-                break;
-            }
-            const auto have = ZLIB_SCRATCH_SIZE - strm.avail_out;
-            if(have > 0) { output_callback(std::as_bytes(std::span{ scratch, have })); }
-        }
-        while(strm.avail_out == 0);
-        if(flush == Z_FINISH && ret == Z_STREAM_END) { break; }
-        if(!success) { break; }
-    }
-
-    deflateEnd(&strm);
-    return success;
-}
-
-template <typename InputCallback, typename OutputCallback>
-inline bool zlib_inflate(const InputCallback& input_callback, const OutputCallback& output_callback)
-    requires(std::is_invocable_r_v<std::span<const std::byte>, InputCallback, size_t> &&
-             std::is_invocable_v<OutputCallback, std::span<const std::byte>>)
-{
-    z_stream strm{};
-    if(inflateInit(&strm) != Z_OK) { return false; }
+inline constexpr usize CHUNK_SIZE = 1024 * 1024;
 
-    unsigned char scratch[ZLIB_SCRATCH_SIZE];
-    int ret = Z_OK;
-    bool success = true;
+// Single chunk codecs. compress_chunk returns false if the chunk didn't fit in out, which is then left to be stored.
+bool compress_chunk(Codec codec, std::span<const std::byte> src, std::span<std::byte> out, usize& out_size);
+bool decompress_chunk(Codec codec, std::span<const std::byte> src, std::span<std::byte> out);
 
-    while(ret != Z_STREAM_END)
-    {
-        std::span<const std::byte> in_data = input_callback(ZLIB_SCRATCH_SIZE);
-        strm.next_in = (Bytef*)in_data.data();
-        strm.avail_in = in_data.size();
-        if(in_data.empty()) { break; }
-        do
-        {
-            strm.next_out = scratch;
-            strm.avail_out = ZLIB_SCRATCH_SIZE;
-            ret = inflate(&strm, Z_NO_FLUSH);
-            if(ret < 0 && ret != Z_BUF_ERROR)
-            {
-                success = false;
-                break;
-            }
-            const auto have = ZLIB_SCRATCH_SIZE - strm.avail_out;
-            if(have > 0) { output_callback(std::as_bytes(std::span{ scratch, have })); }
-        }
-        while(strm.avail_out == 0);
-        if(!success) { break; }
-    }
-    inflateEnd(&strm);
-    return success && (ret == Z_STREAM_END);
-}
+std::vector<std::byte> compress_chunked(std::span<const std::byte> src, Codec codec = Codec::ZLIB,
+                                        usize chunk_size = CHUNK_SIZE);
+// out has to be exactly the size of uncompressed data. Fails on checksum mismatch as well.
+bool decompress_chunked(std::span<const std::byte> src, std::span<std::byte> out);
 
 } // namespace compression
 } // namespace eng
\ No newline at end of file
@@ -3,17 +3,21 @@
 #include <variant>
 #include <vector>
 #include <cstddef>
+#include <execution>
 
 #include <fastgltf/core.hpp>
 #include <fastgltf/types.hpp>
 #include <fastgltf/tools.hpp>
 #include <stb/stb_image.h>
 #include <stb/stb_image_write.h>
+#include <meshoptimizer/src/meshoptimizer.h>
 
 #include <eng/ecs/components.hpp>
 #include <eng/renderer/renderer.hpp>
 #include <eng/renderer/staging_buffer.hpp>
 #include <eng/renderer/bindlesspool.hpp>
+#include <eng/assets/texture_compression.hpp>
+#include <eng/assets/mipmaps.hpp>
 #include <assets/shaders/common.hlsli>
 
 namespace eng
@@ -24,32 +28,92 @@ namespace assets
 namespace gltf
 {
 
+// Output of cpu-only work that is done in parallel before any renderer objects are made.
+struct ExtractedPrimitive
+{
+    struct LOD
+    {
+        std::vector<u32> indices;
+        float error{}; // object space
+    };
+    Flags<gfx::VertexComponent> vertex_layout;
+    std::vector<float> vertices;
+    std::vector<u32> indices;
+    std::vector<LOD> lods; // lower levels of detail over the same vertices
+};
+
+// Sums of meshoptimizer's analyzer counters, so the ratios can be reported over all primitives of an asset.
+struct GeometryStats
+{
+    GeometryStats& operator+=(const GeometryStats& s)
+    {
+        triangles += s.triangles;
+        vertices += s.vertices;
+        vertices_transformed += s.vertices_transformed;
+        pixels_covered += s.pixels_covered;
+        pixels_shaded += s.pixels_shaded;
+        return *this;
+    }
+    float get_acmr() const { return triangles ? (float)vertices_transformed / (float)triangles : 0.0f; }
+    float get_atvr() const { return vertices ? (float)vertices_transformed / (float)vertices : 0.0f; }
+    float get_overdraw() const { return pixels_covered ? (float)pixels_shaded / (float)pixels_covered : 0.0f; }
+    u64 triangles{};
+    u64 vertices{}; // referenced by indices
+    u64 vertices_transformed{};
+    u64 pixels_covered{};
+    u64 pixels_shaded{};
+};
+
+// Decides block compression format of an image. If an image is used in many ways, the first one wins.
+enum class TextureUsage : u8
+{
+    NONE,
+    BASE_COLOR,
+    NORMAL,
+    METALLIC_ROUGHNESS,
+};
+
+struct ImageImportInfo
+{
+    TextureUsage usage{ TextureUsage::NONE };
+    float alpha_cutoff{ -1.0f }; // of the first alpha masked material sampling the image as base color
+};
+
+struct DecodedImage
+{
+    u32 width{};
+    u32 height{};
+    gfx::ImageFormat format{};
+    u32 mips{};
+    std::vector<std::byte> data; // block compressed mips, one after another; empty if decoding failed
+};
+
 struct Context
 {
     Flags<ImportSettings> import_settings;
+    LODSettings lod_settings;
+    std::vector<std::vector<ExtractedPrimitive>> extracted_meshes; // per gltf mesh; skipped primitives are not stored
+    std::vector<DecodedImage> decoded_images;                      // per gltf image
     std::vector<u32> images;
     std::vector<u32> textures;
     std::vector<Range32u> materials;
     std::vector<Range32u> geometries;
     std::vector<Range32u> meshes;
-    gfx::ICommandBuffer* cmd;
+    gfx::Renderer::BuildGeometryContext headless_geometries; // meshletized after all the nodes are loaded
 };
 
-Range32u load_geometry(Asset& asset, const fastgltf::Asset& gltfasset, size_t gltfmeshidx, Context& ctx)
+std::vector<ExtractedPrimitive> extract_mesh(const fastgltf::Asset& gltfasset, size_t gltfmeshidx)
 {
-    if(ctx.geometries.empty()) { ctx.geometries.insert(ctx.geometries.begin(), gltfasset.meshes.size(), Range32u{}); }
-    if(ctx.geometries[gltfmeshidx].size != 0u) { return ctx.geometries[gltfmeshidx]; }
-
     const fastgltf::Mesh& gltfmesh = gltfasset.meshes[gltfmeshidx];
 
-    Range32u geoms{ (u32)asset.geometries.size(), 0u };
-    std::vector<float> vertices;
-    std::vector<u32> indices;
+    std::vector<ExtractedPrimitive> prims;
+    prims.reserve(gltfmesh.primitives.size());
     for(auto i = 0ull; i < gltfmesh.primitives.size(); ++i)
     {
-        vertices.clear();
-        indices.clear();
         const fastgltf::Primitive& gltfprim = gltfmesh.primitives[i];
+        ExtractedPrimitive prim{};
+        auto& vertices = prim.vertices;
+        auto& indices = prim.indices;
 
         static constexpr const char* FAST_COMPS[]{ "POSITION", "NORMAL", "TANGENT", "TEXCOORD_0" };
         static constexpr gfx::VertexComponent GFX_COMPS[]{ gfx::VertexComponent::POSITION_BIT, gfx::VertexComponent::NORMAL_BIT,
@@ -110,7 +174,7 @@ Range32u load_geometry(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
             auto it = gltfprim.findAttribute(FAST_COMPS[i]);
             auto& acc = gltfasset.accessors.at(it->accessorIndex);
 
-            if(i == 0) { vertices.resize(acc.count * vertex_size); }
+            if(i == 0) { vertices.resize(acc.count * vertex_size / sizeof(float)); }
             fast_iterate(i, acc, GFX_COMPS[i]);
         }
 
@@ -131,16 +195,80 @@ Range32u load_geometry(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
             continue;
         }
 
-        asset.geometries.push_back(gfx::get_renderer().make_geometry(gfx::GeometryDescriptor{
+        prim.vertex_layout = vertex_layout;
+        prims.push_back(std::move(prim));
+    }
+    return prims;
+}
+
+GeometryStats analyze_primitive(const ExtractedPrimitive& prim, usize vertex_count)
+{
+    static constexpr auto CACHE_SIZE = 16u;
+    const auto vertex_size = gfx::get_vertex_layout_size(prim.vertex_layout);
+    const auto cache =
+        meshopt_analyzeVertexCache(prim.indices.data(), prim.indices.size(), vertex_count, CACHE_SIZE, 0, 0);
+    const auto overdraw = meshopt_analyzeOverdraw(prim.indices.data(), prim.indices.size(), prim.vertices.data(),
+                                                  vertex_count, vertex_size);
+    return GeometryStats{ .triangles = prim.indices.size() / 3,
+                          .vertices = vertex_count,
+                          .vertices_transformed = cache.vertices_transformed,
+                          .pixels_covered = overdraw.pixels_covered,
+                          .pixels_shaded = overdraw.pixels_shaded };
+}
+
+// Reorders triangles for the post transform cache, then for less overdraw (keeping most of the cache gains),
+// and finally vertices in order of first use, dropping unreferenced ones. Meshlets are later built in this order.
+void optimize_primitive(ExtractedPrimitive& prim, GeometryStats& out_before, GeometryStats& out_after)
+{
+    static constexpr auto OVERDRAW_THRESHOLD = 1.05f;
+    auto& indices = prim.indices;
+    const auto vertex_size = gfx::get_vertex_layout_size(prim.vertex_layout);
+    const auto vertex_count = prim.vertices.size() * sizeof(float) / vertex_size;
+    if(indices.empty() || vertex_count == 0) { return; }
+
+    out_before = analyze_primitive(prim, vertex_count);
+    meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertex_count);
+    meshopt_optimizeOverdraw(indices.data(), indices.data(), indices.size(), prim.vertices.data(), vertex_count,
+                             vertex_size, OVERDRAW_THRESHOLD);
+    const auto unique_count = meshopt_optimizeVertexFetch(prim.vertices.data(), indices.data(), indices.size(),
+                                                          prim.vertices.data(), vertex_count, vertex_size);
+    prim.vertices.resize(unique_count * vertex_size / sizeof(float));
+    out_after = analyze_primitive(prim, unique_count);
+    out_before.vertices = unique_count;
+}
+
+Range32u load_geometry(Asset& asset, const fastgltf::Asset& gltfasset, size_t gltfmeshidx, Context& ctx)
+{
+    if(ctx.geometries.empty()) { ctx.geometries.insert(ctx.geometries.begin(), gltfasset.meshes.size(), Range32u{}); }
+    if(ctx.geometries[gltfmeshidx].size != 0u) { return ctx.geometries[gltfmeshidx]; }
+
+    Range32u geoms{ (u32)asset.geometries.size(), 0u };
+    std::vector<gfx::GeometryDescriptor::LOD> lods;
+    for(const auto& prim : ctx.extracted_meshes[gltfmeshidx])
+    {
+        lods.clear();
+        for(const auto& lod : prim.lods)
+        {
+            lods.push_back(
+                gfx::GeometryDescriptor::LOD{ .indices = std::as_bytes(std::span{ lod.indices }), .error = lod.error });
+        }
+        const auto desc = gfx::GeometryDescriptor{
             .flags = {},
-            .vertex_layout = vertex_layout,
+            .vertex_layout = prim.vertex_layout,
             .index_format = gfx::IndexFormat::U32,
-            .vertices = vertices,
-            .indices = std::as_bytes(std::span{ indices }),
+            .vertices = prim.vertices,
+            .indices = std::as_bytes(std::span{ prim.indices }),
+            .lods = lods,
             .signal = ctx.import_settings.test(ImportSettings::KEEP_DATA_BIT)
                           ? &asset.geometry_data.emplace_back(assets::ParsedGeometryReadySignal{})
                           : (assets::ParsedGeometryReadySignal*)nullptr,
-        }));
+        };
+        if(ctx.import_settings & ImportSettings::HEADLESS_BIT)
+        {
+            asset.geometries.push_back(Handle<gfx::Geometry>{ (u32)asset.geometries.size() });
+            ctx.headless_geometries.add_descriptor(asset.geometries.back(), desc);
+        }
+        else { asset.geometries.push_back(gfx::get_renderer().make_geometry(desc)); }
         if(ctx.import_settings & ImportSettings::KEEP_DATA_BIT)
         {
             asset.geometry_data_futures.push_back(asset.geometry_data.back().get_future().share());
@@ -152,12 +280,40 @@ Range32u load_geometry(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
     return geoms;
 }
 
-u32 load_image(Asset& asset, const fastgltf::Asset& gltfasset, gfx::ImageFormat format, size_t gltfimgidx, Context& ctx)
+// Simplifies the full level down to reduction^level of its triangles for every level. Starting from the full level
+// every time keeps the reported errors relative to it.
+void generate_lods(ExtractedPrimitive& prim, const LODSettings& settings)
 {
-    // todo: check if image format matches with the currently requested.
-    if(ctx.images.empty()) { ctx.images.insert(ctx.images.begin(), gltfasset.images.size(), ~0u); }
-    if(ctx.images[gltfimgidx] != ~0u) { return ctx.images[gltfimgidx]; }
+    static constexpr auto MIN_INDEX_COUNT = 3u * 32u;
+    const auto vertex_size = gfx::get_vertex_layout_size(prim.vertex_layout);
+    const auto vertex_count = prim.vertices.size() * sizeof(float) / vertex_size;
+    if(prim.indices.empty() || vertex_count == 0) { return; }
+
+    const auto scale = meshopt_simplifyScale(prim.vertices.data(), vertex_count, vertex_size);
+    auto prev_count = prim.indices.size();
+    auto target = (float)prim.indices.size();
+    for(auto lod = 1u; lod < settings.count; ++lod)
+    {
+        target *= settings.reduction;
+        const auto target_count = (usize)target / 3 * 3;
+        if(target_count < MIN_INDEX_COUNT) { break; }
+
+        std::vector<u32> indices(prim.indices.size());
+        auto error = 0.0f;
+        indices.resize(meshopt_simplify(indices.data(), prim.indices.data(), prim.indices.size(), prim.vertices.data(),
+                                        vertex_count, vertex_size, target_count, settings.max_error, 0, &error));
+        // error limit stopped it before getting even halfway to the target, so coarser levels would come out the same
+        if((float)indices.size() > (float)prev_count * (1.0f + settings.reduction) * 0.5f) { break; }
+
+        meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertex_count);
+        prev_count = indices.size();
+        prim.lods.push_back(ExtractedPrimitive::LOD{ .indices = std::move(indices), .error = error * scale });
+    }
+}
 
+DecodedImage decode_image(const fastgltf::Asset& gltfasset, size_t gltfimgidx, const ImageImportInfo& info)
+{
+    const auto usage = info.usage;
     const fastgltf::Image& gltfimg = gltfasset.images[gltfimgidx];
 
     std::span<const std::byte> data;
@@ -178,7 +334,7 @@ u32 load_image(Asset& asset, const fastgltf::Asset& gltfasset, gfx::ImageFormat
     if(data.empty())
     {
         ENG_WARN("Could not load image {}", gltfimg.name.c_str());
-        return ~0u;
+        return {};
     }
 
     int x, y, ch;
@@ -188,39 +344,95 @@ u32 load_image(Asset& asset, const fastgltf::Asset& gltfasset, gfx::ImageFormat
     if(!imgdata)
     {
         ENG_ERROR("Stbi failed for image {}: {}", gltfimg.name.c_str(), stbi_failure_reason());
-        return ~0u;
+        return {};
     }
 
-    const auto img = gfx::get_renderer().make_image(gltfimg.name.c_str(),
-                                                    gfx::Image::init((u32)x, (u32)y, 0, format,
-                                                                     gfx::ImageUsage::SAMPLED_BIT | gfx::ImageUsage::TRANSFER_DST_BIT |
-                                                                         gfx::ImageUsage::TRANSFER_SRC_BIT,
-                                                                     0, 1, gfx::ImageLayout::READ_ONLY));
-    if(!img) { ENG_ERROR("Failed to create image{}", gltfimg.name.c_str()); }
-    else
+    std::vector<std::byte> level(imgdata, imgdata + x * y * 4);
+    stbi_image_free(imgdata);
+
+    // opaque images don't need more than bc1; normals only need two channels, the third is reconstructed
+    const auto opaque = [&level] {
+        for(auto i = 3ull; i < level.size(); i += 4)
+        {
+            if(level[i] != std::byte{ 255 }) { return false; }
+        }
+        return true;
+    }();
+    DecodedImage img{ .width = (u32)x, .height = (u32)y };
+    compression::BCFormat bcformat{};
+    switch(usage)
     {
-        ENG_ASSERT(ctx.cmd);
-        gfx::get_renderer().staging->copy(img.get(), imgdata, 0, 0, false, gfx::DiscardContents::YES);
-        ctx.cmd->generate_mips(img.get());
+    case TextureUsage::NORMAL:
+    {
+        bcformat = compression::BCFormat::BC5;
+        img.format = gfx::ImageFormat::BC5_UNORM;
+        break;
+    }
+    case TextureUsage::BASE_COLOR:
+    {
+        bcformat = opaque ? compression::BCFormat::BC1 : compression::BCFormat::BC7;
+        img.format = opaque ? gfx::ImageFormat::BC1_RGBA_SRGB : gfx::ImageFormat::BC7_SRGB;
+        break;
+    }
+    default:
+    {
+        bcformat = opaque ? compression::BCFormat::BC1 : compression::BCFormat::BC7;
+        img.format = opaque ? gfx::ImageFormat::BC1_RGBA_UNORM : gfx::ImageFormat::BC7_UNORM;
+        break;
+    }
     }
 
-    if(!img) { return ~0u; }
+    // compressed formats can't be blitted, so the whole mip chain is made here
+    const auto mips = generate_mips(level, img.width, img.height,
+                                    MipSettings{ .srgb = usage == TextureUsage::BASE_COLOR,
+                                                 .normal_map = usage == TextureUsage::NORMAL,
+                                                 .alpha_cutoff = info.alpha_cutoff });
+    img.mips = (u32)mips.size();
+    u32 w = img.width, h = img.height;
+    for(const auto& mip : mips)
+    {
+        const auto blocks = compression::bc_encode(bcformat, mip, w, h);
+        img.data.insert(img.data.end(), blocks.begin(), blocks.end());
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+    return img;
+}
+
+u32 load_image(Asset& asset, const fastgltf::Asset& gltfasset, size_t gltfimgidx, Context& ctx)
+{
+    if(ctx.images.empty()) { ctx.images.insert(ctx.images.begin(), gltfasset.images.size(), ~0u); }
+    if(ctx.images[gltfimgidx] != ~0u) { return ctx.images[gltfimgidx]; }
+
+    const fastgltf::Image& gltfimg = gltfasset.images[gltfimgidx];
+    auto& decoded = ctx.decoded_images[gltfimgidx];
+    if(decoded.data.empty()) { return ~0u; }
 
     const u32 imgidx = asset.images.size();
+    const auto img = ctx.import_settings.test(ImportSettings::HEADLESS_BIT)
+                         ? Handle<gfx::Image>{ imgidx }
+                         : make_image_from_data(gltfimg.name.c_str(), decoded.width, decoded.height, decoded.format,
+                                                decoded.mips, decoded.data);
+    if(!img) { return ~0u; }
+
     asset.images.push_back(img);
     ctx.images[gltfimgidx] = imgidx;
 
     if(ctx.import_settings & ImportSettings::KEEP_DATA_BIT)
     {
-        asset.image_data.emplace_back(gltfimg.name.c_str(), (u32)x, (u32)y, format,
-                                      std::vector<std::byte>(imgdata, imgdata + x * y * 4));
+        asset.image_data.push_back(ParsedImageData{ .name = gltfimg.name.c_str(),
+                                                    .width = decoded.width,
+                                                    .height = decoded.height,
+                                                    .format = decoded.format,
+                                                    .mips = decoded.mips,
+                                                    .data = std::move(decoded.data) });
     }
-    stbi_image_free(imgdata);
+    decoded = {};
 
     return imgidx;
 }
 
-u32 load_texture(Asset& asset, const fastgltf::Asset& gltfasset, gfx::ImageFormat format, size_t gltftexidx, Context& ctx)
+u32 load_texture(Asset& asset, const fastgltf::Asset& gltfasset, size_t gltftexidx, Context& ctx)
 {
     if(ctx.textures.empty()) { ctx.textures.insert(ctx.textures.begin(), gltfasset.textures.size(), ~0u); }
     if(ctx.textures[gltftexidx] != ~0u) { return ctx.textures[gltftexidx]; }
@@ -230,11 +442,21 @@ u32 load_texture(Asset& asset, const fastgltf::Asset& gltfasset, gfx::ImageForma
         ENG_ERROR("Texture {} does not have associated image", gltftex.name.c_str());
         return ~0u;
     }
-    u32 image = load_image(asset, gltfasset, format, *gltftex.imageIndex, ctx);
+    u32 image = load_image(asset, gltfasset, *gltftex.imageIndex, ctx);
     if(image == ~0u) { return ~0u; }
 
     u32 texidx = asset.textures.size();
-    asset.textures.push_back(gfx::ImageView::init(asset.images[image], format));
+    if(ctx.import_settings & ImportSettings::HEADLESS_BIT)
+    {
+        // ImageView::init reads the image from the renderer
+        const auto& imgd = asset.image_data[image];
+        asset.textures.push_back(gfx::ImageView{ .image = asset.images[image],
+                                                 .type = gfx::ImageViewType::TYPE_2D,
+                                                 .format = imgd.format,
+                                                 .src_subresource = 0u,
+                                                 .dst_subresource = imgd.mips - 1 });
+    }
+    else { asset.textures.push_back(gfx::ImageView::init(asset.images[image], asset.images[image]->format)); }
     ctx.textures[gltftexidx] = texidx;
     return texidx;
 }
@@ -287,8 +509,7 @@ Range32u load_material(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
 
         if(gltfmat.pbrData.baseColorTexture)
         {
-            u32 texidx = load_texture(asset, gltfasset, gfx::ImageFormat::R8G8B8A8_SRGB,
-                                      gltfmat.pbrData.baseColorTexture->textureIndex, ctx);
+            u32 texidx = load_texture(asset, gltfasset, gltfmat.pbrData.baseColorTexture->textureIndex, ctx);
             if(texidx != ~0u)
             {
                 mat.base_color_texture = asset.textures[ctx.textures[gltfmat.pbrData.baseColorTexture->textureIndex]];
@@ -296,8 +517,7 @@ Range32u load_material(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
         }
         if(gltfmat.normalTexture)
         {
-            u32 texidx =
-                load_texture(asset, gltfasset, gfx::ImageFormat::R8G8B8A8_UNORM, gltfmat.normalTexture->textureIndex, ctx);
+            u32 texidx = load_texture(asset, gltfasset, gltfmat.normalTexture->textureIndex, ctx);
             if(texidx != ~0u)
             {
                 mat.normal_texture = asset.textures[ctx.textures[gltfmat.normalTexture->textureIndex]];
@@ -305,8 +525,7 @@ Range32u load_material(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
         }
         if(gltfmat.pbrData.metallicRoughnessTexture)
         {
-            u32 texidx = load_texture(asset, gltfasset, gfx::ImageFormat::R8G8B8A8_UNORM,
-                                      gltfmat.pbrData.metallicRoughnessTexture->textureIndex, ctx);
+            u32 texidx = load_texture(asset, gltfasset, gltfmat.pbrData.metallicRoughnessTexture->textureIndex, ctx);
             if(texidx != ~0u)
             {
                 mat.metallic_roughness_texture =
@@ -314,7 +533,12 @@ Range32u load_material(Asset& asset, const fastgltf::Asset& gltfasset, size_t gl
             }
         }
 
-        asset.materials.push_back(gfx::get_renderer().make_material(mat));
+        if(ctx.import_settings & ImportSettings::KEEP_DATA_BIT) { asset.material_data.push_back(mat); }
+        if(ctx.import_settings & ImportSettings::HEADLESS_BIT)
+        {
+            asset.materials.push_back(Handle<gfx::Material>{ (u32)asset.materials.size() });
+        }
+        else { asset.materials.push_back(gfx::get_renderer().make_material(mat)); }
         ++mats.size;
     }
 
@@ -338,8 +562,17 @@ Range32u load_mesh(Asset& asset, const fastgltf::Asset& gltfasset, size_t gltfme
     ENG_ASSERT(geoms == mats && geoms.offset == (u32)asset.meshes.size());
     for(auto i = 0u; i < geoms.size; ++i)
     {
-        asset.meshes.push_back(gfx::get_renderer().make_mesh(gfx::MeshDescriptor{
-            .geometry = asset.geometries[geoms.offset + i], .material = asset.materials[mats.offset + i] }));
+        const auto desc = gfx::MeshDescriptor{ .geometry = asset.geometries[geoms.offset + i],
+                                               .material = asset.materials[mats.offset + i] };
+        if(ctx.import_settings & ImportSettings::KEEP_DATA_BIT)
+        {
+            asset.mesh_data.push_back(gfx::Mesh{ .geometry = desc.geometry, .material = desc.material });
+        }
+        if(ctx.import_settings & ImportSettings::HEADLESS_BIT)
+        {
+            asset.meshes.push_back(Handle<gfx::Mesh>{ (u32)asset.meshes.size() });
+        }
+        else { asset.meshes.push_back(gfx::get_renderer().make_mesh(desc)); }
     }
     ctx.meshes[gltfmeshidx] = geoms;
     return geoms;
@@ -403,17 +636,158 @@ Node load_node(Asset& asset, const fastgltf::Asset& gltfasset, const fastgltf::N
     return node;
 }
 
+void gather_node_dependencies(const fastgltf::Asset& gltfasset, size_t gltfnodeidx, std::vector<bool>& meshes,
+                              std::vector<ImageImportInfo>& images)
+{
+    const auto& gltfnode = gltfasset.nodes[gltfnodeidx];
+    if(gltfnode.meshIndex && !meshes[*gltfnode.meshIndex])
+    {
+        meshes[*gltfnode.meshIndex] = true;
+        for(const auto& gltfprim : gltfasset.meshes[*gltfnode.meshIndex].primitives)
+        {
+            if(!gltfprim.materialIndex) { continue; }
+            const auto& gltfmat = gltfasset.materials[*gltfprim.materialIndex];
+            const auto mark_texture = [&](const auto& texinfo, TextureUsage usage) {
+                if(!texinfo) { return; }
+                const auto& gltftex = gltfasset.textures[texinfo->textureIndex];
+                if(!gltftex.imageIndex) { return; }
+                auto& info = images[*gltftex.imageIndex];
+                if(info.usage == TextureUsage::NONE) { info.usage = usage; }
+                if(usage == TextureUsage::BASE_COLOR && gltfmat.alphaMode == fastgltf::AlphaMode::Mask &&
+                   info.alpha_cutoff < 0.0f)
+                {
+                    info.alpha_cutoff = gltfmat.alphaCutoff;
+                }
+            };
+            mark_texture(gltfmat.pbrData.baseColorTexture, TextureUsage::BASE_COLOR);
+            mark_texture(gltfmat.normalTexture, TextureUsage::NORMAL);
+            mark_texture(gltfmat.pbrData.metallicRoughnessTexture, TextureUsage::METALLIC_ROUGHNESS);
+        }
+    }
+    for(auto e : gltfnode.children)
+    {
+        gather_node_dependencies(gltfasset, e, meshes, images);
+    }
+}
+
+// Decodes and compresses images, extracts, optimizes and simplifies primitives of everything the scene references.
+// None of this touches the renderer, so all of it runs in parallel. Handles are made afterwards on the calling thread in node order,
+// so they come out the same no matter how the work got scheduled.
+void prepare_cpu_data(const fastgltf::Asset& gltfasset, const fastgltf::Scene& gltfscene, Context& ctx)
+{
+    std::vector<bool> used_meshes(gltfasset.meshes.size());
+    std::vector<ImageImportInfo> used_images(gltfasset.images.size());
+    for(auto e : gltfscene.nodeIndices)
+    {
+        gather_node_dependencies(gltfasset, e, used_meshes, used_images);
+    }
+
+    // images first, as decoding them usually takes the longest
+    std::vector<u32> tasks;
+    for(auto i = 0u; i < used_images.size(); ++i)
+    {
+        if(used_images[i].usage != TextureUsage::NONE) { tasks.push_back(i); }
+    }
+    for(auto i = 0u; i < used_meshes.size(); ++i)
+    {
+        if(used_meshes[i]) { tasks.push_back((u32)used_images.size() + i); }
+    }
+
+    ctx.decoded_images.resize(gltfasset.images.size());
+    ctx.extracted_meshes.resize(gltfasset.meshes.size());
+    std::for_each(std::execution::par, tasks.begin(), tasks.end(), [&](u32 task) {
+        if(task < used_images.size()) { ctx.decoded_images[task] = decode_image(gltfasset, task, used_images[task]); }
+        else
+        {
+            const auto mesh = task - (u32)used_images.size();
+            ctx.extracted_meshes[mesh] = extract_mesh(gltfasset, mesh);
+        }
+    });
+
+    std::vector<ExtractedPrimitive*> prims;
+    for(auto& mesh : ctx.extracted_meshes)
+    {
+        for(auto& prim : mesh)
+        {
+            prims.push_back(&prim);
+        }
+    }
+    std::vector<GeometryStats> before(prims.size());
+    std::vector<GeometryStats> after(prims.size());
+    std::for_each(std::execution::par, prims.begin(), prims.end(), [&](ExtractedPrimitive* const& prim) {
+        const auto idx = std::distance(prims.data(), &prim);
+        optimize_primitive(*prim, before[idx], after[idx]);
+        generate_lods(*prim, ctx.lod_settings);
+    });
+    GeometryStats total_before, total_after;
+    for(auto i = 0ull; i < prims.size(); ++i)
+    {
+        total_before += before[i];
+        total_after += after[i];
+    }
+    ENG_LOG("GLTF geometry optimization: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, overdraw {:.3f} -> {:.3f}",
+            total_before.get_acmr(), total_after.get_acmr(), total_before.get_atvr(), total_after.get_atvr(),
+            total_before.get_overdraw(), total_after.get_overdraw());
+}
+
+static std::optional<std::vector<std::byte>> read_file_from_disk(const fs::Path& path)
+{
+    fs::File file;
+    if(!file.open(path, fs::OpenMode::TRY_READ_BYTES_BEG)) { return std::nullopt; }
+    std::vector<std::byte> bytes(file.get_size());
+    usize n_bytes_read = 0;
+    file.read(bytes.data(), bytes.size(), n_bytes_read, 0);
+    if(n_bytes_read != bytes.size()) { return std::nullopt; }
+    return bytes;
+}
+
+// Replaces uris of external files with their bytes. Done here instead of by fastgltf, so they are read with read_file.
+// Missing buffers fail the load, missing images are only warned about when decoding them.
+static bool load_external_sources(fastgltf::Asset& gltfasset, const fs::Path& directory,
+                                  const AssetLoaderGLTF::ReadFile& read_file)
+{
+    const auto load_source = [&directory, &read_file](fastgltf::DataSource& data) {
+        const auto* src = std::get_if<fastgltf::sources::URI>(&data);
+        if(!src) { return true; }
+        const auto path = directory / src->uri.fspath();
+        const auto bytes = src->uri.isLocalPath() ? read_file(path) : std::nullopt;
+        if(!bytes || src->fileByteOffset > bytes->size())
+        {
+            ENG_WARN("Could not read {} referenced by gltf file", path.string());
+            return false;
+        }
+        fastgltf::sources::Array array{ fastgltf::StaticVector<std::byte>(bytes->size() - src->fileByteOffset), src->mimeType };
+        std::memcpy(array.bytes.data(), bytes->data() + src->fileByteOffset, array.bytes.size());
+        data = std::move(array);
+        return true;
+    };
+    auto loaded = true;
+    for(auto& buffer : gltfasset.buffers)
+    {
+        loaded &= load_source(buffer.data);
+    }
+    for(auto& image : gltfasset.images)
+    {
+        load_source(image.data);
+    }
+    return loaded;
+}
+
 } // namespace gltf
 
-std::optional<Asset> AssetLoaderGLTF::load_from_file(const fs::Path& file_path, Flags<ImportSettings> import_settings)
+std::optional<Asset> AssetLoaderGLTF::load_from_file(const fs::Path& file_path, Flags<ImportSettings> import_settings,
+                                                     const LODSettings& lod_settings, const ReadFile& read_file)
 {
-    auto fastdatabuf = fastgltf::GltfDataBuffer::FromPath(file_path);
+    const auto read = read_file ? read_file : ReadFile{ gltf::read_file_from_disk };
+    const auto file_bytes = read(file_path);
+    if(!file_bytes) { return std::nullopt; }
+    auto fastdatabuf = fastgltf::GltfDataBuffer::FromBytes(file_bytes->data(), file_bytes->size());
     if(!fastdatabuf) { return std::nullopt; }
 
-    static constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember | fastgltf::Options::LoadExternalBuffers |
-                                        fastgltf::Options::LoadExternalImages | fastgltf::Options::GenerateMeshIndices;
+    // external files are loaded afterwards, see load_external_sources
+    static constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember | fastgltf::Options::GenerateMeshIndices;
     fastgltf::Parser gltfparser;
-    const auto gltfasset = [&file_path, &gltfparser, &fastdatabuf] {
+    auto gltfasset = [&file_path, &gltfparser, &fastdatabuf] {
         ENG_TIMER_SCOPED("GLTF file parsing {}", file_path.string());
         if(file_path.extension() == ".glb")
         {
@@ -427,27 +801,33 @@ std::optional<Asset> AssetLoaderGLTF::load_from_file(const fs::Path& file_path,
 
     if(!gltfasset) { return std::nullopt; }
     if(gltfasset->scenes.empty()) { return std::nullopt; }
+    if(!gltf::load_external_sources(gltfasset.get(), file_path.parent_path(), read)) { return std::nullopt; }
 
     auto& gltfscene = gltfasset->scenes.at(0);
 
     ENG_TIMER_SCOPED("GLTF loading asset {}", file_path.string());
+    if(import_settings & ImportSettings::HEADLESS_BIT) { import_settings |= ImportSettings::KEEP_DATA_BIT; }
     Asset asset{};
+    if(import_settings & ImportSettings::QUANTIZE_VERTICES_BIT) { asset.vertex_encoding = VertexEncoding::QUANTIZED; }
     gltf::Context ctx{};
     ctx.import_settings = import_settings;
-    ctx.cmd = gfx::get_renderer().current_data->cmdpool->begin();
+    ctx.lod_settings = lod_settings;
+    {
+        ENG_TIMER_SCOPED("GLTF decoding {}", file_path.string());
+        gltf::prepare_cpu_data(gltfasset.get<1>(), gltfscene, ctx);
+    }
     for(auto i = 0u; i < gltfscene.nodeIndices.size(); ++i)
     {
         u32 out_index;
         gltf::load_node(asset, gltfasset.get<1>(), gltfasset->nodes[gltfscene.nodeIndices[i]], nullptr, ctx, &out_index);
         asset.root_nodes.push_back(out_index);
     }
-    auto* staging_sync = gfx::get_renderer().staging->flush(true);
-    auto* mip_sync = gfx::get_renderer().current_data->get_sync();
-    ctx.cmd->wait_sync(staging_sync, gfx::PipelineStage::TRANSFER_BIT);
-    ctx.cmd->signal_sync(mip_sync, gfx::PipelineStage::FRAGMENT_BIT);
-    gfx::get_renderer().current_data->cmdpool->end(ctx.cmd);
-    gfx::get_renderer().gq->with_cmd_buf(ctx.cmd).submit();
-    gfx::get_renderer().current_data->wait_syncs.push_back(mip_sync);
+
+    // without the renderer, geometries are meshletized here, the same way build_pending_geometries does it
+    auto& batches = ctx.headless_geometries.batches;
+    std::for_each(std::execution::par, batches.begin(), batches.end(), [](gfx::Renderer::BuildGeometryBatch& batch) {
+        batch.geom_ready_signal->set_value(gfx::Renderer::process_geometry_batch(batch));
+    });
 
     return asset;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <optional>
 #include <eng/fs/fs.hpp>
 #include <eng/assets/asset_manager.hpp>
@@ -13,13 +14,28 @@ namespace assets
 enum class ImportSettings
 {
     KEEP_DATA_BIT = 0x1, // stores loaded images, vertices, and all the data needed to serialize the asset into custom format
+    QUANTIZE_VERTICES_BIT = 0x2, // serializes vertices quantized; lossy, but a few times smaller
+    HEADLESS_BIT = 0x4, // makes no renderer objects, so the asset is only good for serializing; implies KEEP_DATA_BIT
 };
 ENG_ENABLE_FLAGS_OPERATORS(ImportSettings);
 
+// Levels of detail made for every imported geometry with meshopt_simplify.
+struct LODSettings
+{
+    u32 count{ 4 };           // including the full one; 1 disables them
+    float reduction{ 0.5f };  // triangle count of each level relative to the previous one
+    float max_error{ 0.05f }; // relative to the geometry extent; no more levels are made once it is hit
+};
+
 class AssetLoaderGLTF
 {
   public:
-    static std::optional<Asset> load_from_file(const fs::Path& path, Flags<ImportSettings> import_settings = {});
+    // Reads a whole file: the gltf file, or buffers and images it references, with paths relative to its directory.
+    using ReadFile = std::function<std::optional<std::vector<std::byte>>(const fs::Path& path)>;
+
+    // Without read_file, files are read straight from the disk.
+    static std::optional<Asset> load_from_file(const fs::Path& path, Flags<ImportSettings> import_settings = {},
+                                               const LODSettings& lod_settings = {}, const ReadFile& read_file = {});
 };
 
 } // namespace assets
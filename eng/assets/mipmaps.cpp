@@ -0,0 +1,132 @@
+#include "mipmaps.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace eng
+{
+namespace assets
+{
+
+static const std::array<float, 256>& get_srgb_to_linear_lut()
+{
+    static const auto lut = [] {
+        std::array<float, 256> lut;
+        for(auto i = 0u; i < 256; ++i)
+        {
+            const auto c = (float)i / 255.0f;
+            lut[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return lut;
+    }();
+    return lut;
+}
+
+static u8 linear_to_srgb(float c)
+{
+    c = std::clamp(c, 0.0f, 1.0f);
+    c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return (u8)std::lround(c * 255.0f);
+}
+
+static u8 to_unorm8(float c) { return (u8)std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f); }
+
+static float get_alpha_coverage(std::span<const glm::vec4> texels, float cutoff, float scale)
+{
+    u64 covered = 0;
+    for(const auto& t : texels)
+    {
+        if(t.a * scale > cutoff) { ++covered; }
+    }
+    return (float)covered / (float)texels.size();
+}
+
+u32 get_mip_count(u32 width, u32 height)
+{
+    return (u32)std::log2f((float)std::max(std::min(width, height), 1u)) + 1;
+}
+
+std::vector<std::vector<std::byte>> generate_mips(std::span<const std::byte> rgba8, u32 width, u32 height,
+                                                  const MipSettings& settings)
+{
+    const auto& lut = get_srgb_to_linear_lut();
+    const auto mip_count = get_mip_count(width, height);
+
+    // filtering happens in float, so it does not round at every level
+    std::vector<glm::vec4> level((usize)width * height);
+    for(auto i = 0ull; i < level.size(); ++i)
+    {
+        const auto* t = (const u8*)rgba8.data() + i * 4;
+        if(settings.srgb) { level[i] = glm::vec4{ lut[t[0]], lut[t[1]], lut[t[2]], (float)t[3] / 255.0f }; }
+        else { level[i] = glm::vec4{ t[0], t[1], t[2], t[3] } / 255.0f; }
+    }
+    const auto coverage = settings.alpha_cutoff >= 0.0f ? get_alpha_coverage(level, settings.alpha_cutoff, 1.0f) : 0.0f;
+
+    std::vector<std::vector<std::byte>> mips(mip_count);
+    mips[0].assign(rgba8.begin(), rgba8.begin() + level.size() * 4);
+    u32 w = width, h = height;
+    for(auto mip = 1u; mip < mip_count; ++mip)
+    {
+        const auto nw = std::max(w / 2, 1u);
+        const auto nh = std::max(h / 2, 1u);
+        std::vector<glm::vec4> next((usize)nw * nh);
+        for(auto y = 0u; y < nh; ++y)
+        {
+            const u32 sy[]{ std::min(y * 2, h - 1), std::min(y * 2 + 1, h - 1) };
+            for(auto x = 0u; x < nw; ++x)
+            {
+                const u32 sx[]{ std::min(x * 2, w - 1), std::min(x * 2 + 1, w - 1) };
+                auto& t = next[(usize)y * nw + x];
+                t = (level[(usize)sy[0] * w + sx[0]] + level[(usize)sy[0] * w + sx[1]] +
+                     level[(usize)sy[1] * w + sx[0]] + level[(usize)sy[1] * w + sx[1]]) *
+                    0.25f;
+                if(settings.normal_map)
+                {
+                    auto n = glm::vec3{ t } * 2.0f - 1.0f;
+                    const auto len = glm::length(n);
+                    if(len > 1e-6f) { n /= len; }
+                    t = glm::vec4{ n * 0.5f + 0.5f, t.a };
+                }
+            }
+        }
+        level = std::move(next);
+        w = nw;
+        h = nh;
+
+        // alpha tested foliage thins out in lower mips, as averaging pushes more texels below the cutoff.
+        // find the alpha scale bringing the coverage back to the one of the first mip.
+        auto alpha_scale = 1.0f;
+        if(settings.alpha_cutoff >= 0.0f && get_alpha_coverage(level, settings.alpha_cutoff, 1.0f) != coverage)
+        {
+            auto lo = 0.0f, hi = 4.0f;
+            for(auto it = 0; it < 10; ++it)
+            {
+                const auto mid = (lo + hi) * 0.5f;
+                if(get_alpha_coverage(level, settings.alpha_cutoff, mid) < coverage) { lo = mid; }
+                else { hi = mid; }
+            }
+            // alpha takes few distinct values in small mips, so coverage jumps between lo and hi; take the closer one
+            const auto clo = get_alpha_coverage(level, settings.alpha_cutoff, lo);
+            const auto chi = get_alpha_coverage(level, settings.alpha_cutoff, hi);
+            alpha_scale = coverage - clo < chi - coverage ? lo : hi;
+        }
+
+        auto& out = mips[mip];
+        out.resize(level.size() * 4);
+        auto* dst = (u8*)out.data();
+        for(auto i = 0ull; i < level.size(); ++i)
+        {
+            const auto& t = level[i];
+            for(auto c = 0; c < 3; ++c)
+            {
+                dst[i * 4 + c] = settings.srgb ? linear_to_srgb(t[c]) : to_unorm8(t[c]);
+            }
+            dst[i * 4 + 3] = to_unorm8(t.a * alpha_scale);
+        }
+    }
+    return mips;
+}
+
+} // namespace assets
+} // namespace eng
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <eng/common/types.hpp>
+
+namespace eng
+{
+namespace assets
+{
+
+struct MipSettings
+{
+    bool srgb{};                 // color channels are averaged in linear space
+    bool normal_map{};           // xyz stored as unorm; averaged normals are renormalized
+    float alpha_cutoff{ -1.0f }; // if >= 0, alpha of each mip is scaled to keep the coverage of the first mip
+};
+
+u32 get_mip_count(u32 width, u32 height);
+
+/*
+    Box filtered mip chain of rgba8 image. Every level halves the size of the previous one
+    (rounding down, at least 1), odd texels at edges are clamped. Returns all the levels, starting with
+    the copy of the source.
+*/
+std::vector<std::vector<std::byte>> generate_mips(std::span<const std::byte> rgba8, u32 width, u32 height,
+                                                  const MipSettings& settings);
+
+} // namespace assets
+} // namespace eng
@@ -8,21 +8,143 @@ namespace eng
 {
 namespace serialization
 {
+
+std::vector<u64> ChunkChecksums::make(std::span<const std::byte> bytes)
+{
+    std::vector<u64> checksums(get_chunk_count(bytes.size()));
+    for(auto i = 0ull; i < checksums.size(); ++i)
+    {
+        const auto chunk_size = std::min(CHUNK_BYTES, (usize)(bytes.size() - i * CHUNK_BYTES));
+        const auto chunk = bytes.subspan(i * CHUNK_BYTES, chunk_size);
+        checksums[i] = hash::xxh64(chunk.data(), chunk.size());
+    }
+    return checksums;
+}
+
+ChunkChecksums::ChunkChecksums(std::span<const std::byte> bytes, std::vector<u64> checksums)
+    : m_bytes(bytes), m_checksums(std::move(checksums)),
+      m_states(std::make_unique<std::atomic<u8>[]>(m_checksums.size()))
+{
+    ENG_ASSERT(m_checksums.size() == get_chunk_count(bytes.size()));
+}
+
+bool ChunkChecksums::validate(std::span<const std::byte> bytes)
+{
+    if(bytes.empty()) { return true; }
+    ENG_ASSERT(bytes.data() >= m_bytes.data() && bytes.data() + bytes.size() <= m_bytes.data() + m_bytes.size());
+    return validate((usize)(bytes.data() - m_bytes.data()), bytes.size());
+}
+
+bool ChunkChecksums::validate(usize offset, usize size)
+{
+    enum : u8
+    {
+        UNCHECKED,
+        VALID,
+        CORRUPTED
+    };
+    if(size == 0 || offset >= m_bytes.size()) { return true; }
+    const auto last = std::min(offset + size, (usize)m_bytes.size()) - 1;
+    auto valid = true;
+    for(auto i = offset / CHUNK_BYTES; i <= last / CHUNK_BYTES; ++i)
+    {
+        // threads checking the same chunk at once both hash it, and come to the same result
+        auto state = m_states[i].load(std::memory_order_relaxed);
+        if(state == UNCHECKED)
+        {
+            const auto chunk_size = std::min(CHUNK_BYTES, (usize)(m_bytes.size() - i * CHUNK_BYTES));
+            const auto chunk = m_bytes.subspan(i * CHUNK_BYTES, chunk_size);
+            state = hash::xxh64(chunk.data(), chunk.size()) == m_checksums[i] ? VALID : CORRUPTED;
+            m_states[i].store(state, std::memory_order_relaxed);
+        }
+        valid &= state == VALID;
+    }
+    return valid;
+}
+
 namespace engb
 {
-namespace v0
+namespace v1
 {
 
+static fs::MappedFilePtr map_file(const fs::File& file)
+{
+    auto mapping = std::make_shared<fs::MappedFile>();
+    // containers in mounted pack archives are in memory already
+    const auto mapped = file.is_in_memory() ? mapping->view(file.get_memory(), file.get_memory_owner())
+                                            : mapping->map(file.get_path());
+    if(!mapped)
+    {
+        ENG_WARN("Couldn't map engb container {}; it will be read through its stream", file.get_path().string());
+        return nullptr;
+    }
+    return mapping;
+}
+
+// Writes the index segment of lists at payload_offset, and then points the header at it. Returns absolute offset
+// of the segment's footer, or 0 if it failed, in which case the header still points to the previous one.
+static u64 write_segment(fs::File& file, u64 payload_offset, std::span<const List> lists, u64 prev_footer)
+{
+    const u64 footer_offset = N_HEADER_BYTES + payload_offset + lists.size() * N_LIST_BYTES;
+    std::vector<std::byte> segment(lists.size() * N_LIST_BYTES + N_FOOTER_BYTES);
+    serialization::Context ctx{ std::span{ segment }, 0 };
+    ctx.serialize(lists);
+    ctx.safe_write("engf", 4);
+    const u32 n_lists = static_cast<u32>(lists.size());
+    ctx.safe_write(&n_lists, sizeof(u32));
+    ctx.safe_write(&prev_footer, sizeof(u64));
+    ENG_ASSERT(ctx.m_offset == segment.size());
+
+    usize n_bytes_written = 0;
+    file.write(segment.data(), segment.size(), n_bytes_written, N_HEADER_BYTES + payload_offset);
+    file.flush();
+    if(n_bytes_written != segment.size()) { return 0; }
+
+    // the segment only becomes visible here, after everything it points to is written
+    std::byte header[N_HEADER_BYTES]{};
+    ctx = serialization::Context{ std::span<std::byte>{ header }, 0 };
+    ctx.safe_write("engb", 4);
+    ctx.safe_write(&VERSION, 1);
+    ctx.m_offset += 3; // 3B padding
+    ctx.safe_write(&footer_offset, sizeof(u64));
+    file.write(header, N_HEADER_BYTES, n_bytes_written, 0);
+    file.flush();
+    return n_bytes_written == N_HEADER_BYTES ? footer_offset : 0;
+}
+
+std::optional<SourceStamp> SourceStamp::init(const fs::Path& path, bool with_hash)
+{
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if(ec) { return std::nullopt; }
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if(ec) { return std::nullopt; }
+    SourceStamp stamp{ .size = size, .mtime = (u64)mtime.time_since_epoch().count() };
+    if(with_hash)
+    {
+        fs::File file;
+        if(!file.open(path, fs::OpenMode::TRY_READ_BYTES_BEG)) { return std::nullopt; }
+        stamp.hash = file.get_hash();
+    }
+    return stamp;
+}
+
 Container::Container(fs::FilePtr file) : m_file(file) { read_list_section(); }
 
 Container::~Container() { write_to_file(); }
 
 void Container::read_list_section()
 {
+    m_mapping.reset();
+    m_lists_vec.clear();
+    m_lists_index.clear();
+    m_asset_bytes.clear();
+    m_append_offset = 0;
+    m_last_footer = 0;
+    m_n_written_lists = 0;
     if(!m_file || !m_file->is_read())
     {
         ENG_WARN("Couldn't open engb file {} for read", m_file ? m_file->get_path().string() : "<empty path>");
-        m_lists_vec.clear();
         return;
     }
 
@@ -48,188 +170,308 @@ void Container::read_list_section()
         ENG_WARN("File is not a valid engb file ({})", m_file->get_path().string());
         return;
     }
-    if((char)header_buf[4] != (char)0)
-    {
-        ENG_WARN("Engb container {} has invalid version {}", m_file->get_path().string(), (char)header_buf[4]);
-        return;
-    }
-
-    u64 list_offset = 0;
-    memcpy(&list_offset, &header_buf[8], sizeof(u64));
-    if(list_offset < N_HEADER_BYTES || list_offset > m_file->get_size())
+    if((u8)header_buf[4] != VERSION)
     {
-        ENG_WARN("Engb container {} is corrupted (invalid list offset {})", m_file->get_path().string(), list_offset);
+        // it's a cache, so it's simply written over
+        ENG_WARN("Engb container {} has unsupported version {}; its assets will be imported again",
+                 m_file->get_path().string(), (u32)header_buf[4]);
         return;
     }
 
-    u32 num_lists = 0;
-    m_file->read(reinterpret_cast<std::byte*>(&num_lists), sizeof(u32), read_bytes, list_offset);
-    if(num_lists == 0) { return; }
+    u64 footer_offset = 0;
+    memcpy(&footer_offset, &header_buf[8], sizeof(u64));
+    if(footer_offset == 0) { return; }
 
-    const usize lists_total_bytes = num_lists * N_LIST_BYTES;
-    if(list_offset + sizeof(u32) + lists_total_bytes > m_file->get_size())
+    // segments are walked from the newest, and their lists are put in the order they were written in
+    std::vector<std::vector<List>> segments;
+    for(u64 footer = footer_offset; footer != 0;)
     {
-        ENG_WARN("Engb container {} is corrupted (list section exceeds file size)", m_file->get_path().string());
-        m_lists_vec.clear();
-        return;
+        std::byte footer_buf[N_FOOTER_BYTES];
+        if(footer < N_HEADER_BYTES || footer + N_FOOTER_BYTES > m_file->get_size())
+        {
+            ENG_WARN("Engb container {} is corrupted (invalid footer offset {})", m_file->get_path().string(), footer);
+            return;
+        }
+        m_file->read(footer_buf, N_FOOTER_BYTES, read_bytes, footer);
+        if(read_bytes != N_FOOTER_BYTES || std::string_view{ (const char*)footer_buf, 4 } != "engf")
+        {
+            ENG_WARN("Engb container {} is corrupted (invalid footer at {})", m_file->get_path().string(), footer);
+            return;
+        }
+        u32 num_lists = 0;
+        u64 prev_footer = 0;
+        memcpy(&num_lists, &footer_buf[4], sizeof(u32));
+        memcpy(&prev_footer, &footer_buf[8], sizeof(u64));
+
+        const usize lists_total_bytes = (usize)num_lists * N_LIST_BYTES;
+        // segments only go forward, which also stops cycles in corrupted files
+        if(lists_total_bytes > footer - N_HEADER_BYTES || prev_footer >= footer)
+        {
+            ENG_WARN("Engb container {} is corrupted (list section at {})", m_file->get_path().string(), footer);
+            return;
+        }
+
+        std::vector<std::byte> lists_buf(lists_total_bytes);
+        m_file->read(lists_buf.data(), lists_total_bytes, read_bytes, footer - lists_total_bytes);
+        if(read_bytes != lists_total_bytes)
+        {
+            ENG_WARN("Failed reading engb container lists from file {}", m_file->get_path().string());
+            return;
+        }
+        auto& lists = segments.emplace_back(num_lists);
+        serialization::Context ctx{ std::span{ lists_buf }, 0 };
+        ctx.deserialize(std::span<List>{ lists });
+        footer = prev_footer;
     }
 
-    std::vector<std::byte> lists_buf(lists_total_bytes);
-    usize n_bytes_read = 0;
-    m_file->read(lists_buf.data(), lists_total_bytes, n_bytes_read, list_offset + sizeof(u32));
-    if(n_bytes_read != lists_total_bytes)
+    for(const auto& lists : segments | std::views::reverse)
     {
-        ENG_WARN("Failed reading engb container lists from file {}", m_file->get_path().string());
-        m_lists_vec.clear();
-        return;
+        m_lists_vec.insert(m_lists_vec.end(), lists.begin(), lists.end());
     }
+    build_lists_index();
+    // anything after the newest segment is left from a torn write, and is written over
+    m_append_offset = footer_offset + N_FOOTER_BYTES - N_HEADER_BYTES;
+    m_last_footer = footer_offset;
+    m_n_written_lists = (u32)m_lists_vec.size();
 
-    m_lists_vec.resize(num_lists);
-    serialization::Context ctx{ std::span{ lists_buf }, 0 };
-    ctx.deserialize(std::span<List>{ m_lists_vec });
-
-    for(auto& l : m_lists_vec)
-    {
-        ENG_ASSERT(l.version == 0);
-    }
+    m_mapping = map_file(*m_file);
 }
 
-void Container::add_asset(u8 version, u64 custom_hash, Flags<ListFlags> flags, std::span<const std::byte> asset,
-                          const AssetMetadata& metadata)
+void Container::add_asset(u8 version, u64 schema_hash, u64 custom_hash, Flags<ListFlags> flags,
+                          std::span<const std::byte> asset, const AssetMetadata& metadata, const SourceStamp& source)
 {
     m_modified = true;
-    m_lists_vec.emplace_back(custom_hash, ENG_HASH(asset), m_asset_bytes.size(), 0, version, flags);
-
-    std::byte buf[64];
-    usize metadata_bytes = 0;
-    if(flags & ListFlags::CONTENT_COMPRESSED_BIT)
+    // uncompressed assets are viewed in the mapping, and aren't read whole when they are loaded
+    const auto compressed = flags.test(ListFlags::CONTENT_COMPRESSED_BIT);
+    std::vector<u64> chunk_checksums;
+    if(!compressed)
     {
-        ENG_ASSERT(metadata.uncompressed_size > 0);
-        memcpy(buf, &metadata.uncompressed_size, sizeof(metadata.uncompressed_size));
-        metadata_bytes += sizeof(metadata.uncompressed_size);
+        flags.set(ListFlags::CHUNK_CHECKSUMS_BIT);
+        chunk_checksums = ChunkChecksums::make(asset);
     }
-    ENG_ASSERT(metadata_bytes <= std::size(buf));
+    const auto content_hash = compressed ? hash::xxh64(asset.data(), asset.size())
+                                         : hash::xxh64(chunk_checksums.data(), chunk_checksums.size() * sizeof(u64));
+    m_lists_vec.emplace_back(custom_hash, content_hash, schema_hash, source, m_append_offset + m_asset_bytes.size(), 0,
+                             version, flags);
+    m_lists_index[custom_hash] = (u32)m_lists_vec.size() - 1;
+
+    const auto metadata_bytes = compressed ? std::as_bytes(std::span{ &metadata.uncompressed_size, 1 })
+                                           : std::as_bytes(std::span{ chunk_checksums });
+    ENG_ASSERT(!compressed || metadata.uncompressed_size > 0);
 
-    m_asset_bytes.insert(m_asset_bytes.end(), buf, buf + metadata_bytes);
+    m_asset_bytes.insert(m_asset_bytes.end(), metadata_bytes.begin(), metadata_bytes.end());
     m_asset_bytes.insert(m_asset_bytes.end(), asset.begin(), asset.end());
-    m_lists_vec.back().asset_start += metadata_bytes;
+    m_lists_vec.back().asset_start += metadata_bytes.size();
     m_lists_vec.back().asset_size = asset.size();
 }
 
-void Container::append_asset_bytes(std::span<const std::byte> bytes, bool finished)
+void Container::restamp_asset(u64 custom_hash, const SourceStamp& source)
 {
-    m_asset_bytes.insert(m_asset_bytes.end(), bytes.begin(), bytes.end());
-    m_lists_vec.back().asset_size += bytes.size();
-    if(finished)
-    {
-        m_lists_vec.back().content_hash =
-            ENG_HASH(std::span{ m_asset_bytes.begin() + m_lists_vec.back().asset_start, m_lists_vec.back().asset_size });
-    }
+    const auto it = m_lists_index.find(custom_hash);
+    if(it == m_lists_index.end()) { return; }
+    // a new entry pointing to the same bytes; append-only, so the old one stays in the file until compacted
+    auto list = m_lists_vec[it->second];
+    list.source = source;
+    m_lists_vec.push_back(list);
+    it->second = (u32)m_lists_vec.size() - 1;
+    m_modified = true;
 }
 
 void Container::write_to_file()
 {
     if(!m_modified) { return; }
-    if(!m_file)
+    if(!is_writable())
     {
         ENG_WARN("Cannot serialize engb container: file mode is not permitting writes");
         return;
     }
 
-    const auto n_cont_bytes = N_HEADER_BYTES + m_asset_bytes.size() + sizeof(u32) + (m_lists_vec.size() * N_LIST_BYTES);
-    std::vector<std::byte> data(n_cont_bytes);
-
-    serialization::Context ctx(std::span{ data }, 0);
-    serialize(ctx);
-    ENG_ASSERT(ctx.m_offset == n_cont_bytes);
-
+    // new assets go after the newest segment, and are followed by their own segment
     usize n_bytes_written = 0;
-    m_file->write(data.data(), n_cont_bytes, n_bytes_written, 0);
-    ENG_ASSERT(n_bytes_written == n_cont_bytes);
-    m_modified = false;
-}
-
-void Container::serialize(serialization::Context& ctx) const
-{
-    ctx.safe_write("engb", 4);
-    const u8 version = 0;
-    ctx.safe_write(&version, 1);
-    const u8 padding[3] = { 0, 0, 0 };
-    ctx.safe_write(padding, 3);
-
-    const u64 list_offset = N_HEADER_BYTES + m_asset_bytes.size();
-    ctx.safe_write(&list_offset, 8);
+    m_file->write(m_asset_bytes.data(), m_asset_bytes.size(), n_bytes_written, N_HEADER_BYTES + m_append_offset);
+    const auto new_lists = std::span<const List>{ m_lists_vec }.subspan(m_n_written_lists);
+    const auto footer = n_bytes_written == m_asset_bytes.size()
+                            ? write_segment(*m_file, m_append_offset + m_asset_bytes.size(), new_lists, m_last_footer)
+                            : 0;
+    if(footer == 0)
+    {
+        ENG_WARN("Failed writing {} assets to engb container {}", new_lists.size(), m_file->get_path().string());
+        return;
+    }
 
-    ctx.safe_write(m_asset_bytes.data(), m_asset_bytes.size());
+    m_append_offset = footer + N_FOOTER_BYTES - N_HEADER_BYTES;
+    m_last_footer = footer;
+    m_n_written_lists = (u32)m_lists_vec.size();
+    m_asset_bytes.clear();
+    m_asset_bytes.shrink_to_fit();
+    m_modified = false;
 
-    const u32 n_lists = static_cast<u32>(m_lists_vec.size());
-    ctx.safe_write(&n_lists, sizeof(u32));
-    ctx.serialize(std::span<const List>{ m_lists_vec });
+    // the file may have grown past the old mapping; views into it keep it alive until they are gone
+    m_mapping = map_file(*m_file);
 }
 
-void Container::deserialize(serialization::Context& ctx)
+bool Container::compact()
 {
-    std::byte magic[4];
-    ctx.safe_read(magic, 4);
-    if(std::string_view{ (const char*)magic, 4 } != "engb")
+    write_to_file();
+    if(!is_writable() || m_modified) { return false; }
+
+    const auto path = m_file->get_path();
+    auto compact_path = path;
+    compact_path += ".compact";
+    fs::File out;
+    if(!out.open(compact_path, fs::OpenMode::WRITE_BYTES_CREATE_DISCARD))
     {
-        ENG_WARN("Invalid magic in engb stream");
-        return;
+        ENG_WARN("Couldn't open {} for compacting", compact_path.string());
+        return false;
     }
-    u8 version = 0;
-    ctx.safe_read(&version, 1);
-    if(version != 0)
+
+    // live entries keep their order, and are copied along with their metadata
+    std::vector<List> lists;
+    std::vector<std::byte> buf;
+    u64 offset = 0;
+    auto failed = false;
+    for(auto i = 0u; i < m_lists_vec.size() && !failed; ++i)
     {
-        ENG_WARN("Invalid version in engb stream: {}", version);
-        return;
+        const auto& list = m_lists_vec[i];
+        if(m_lists_index.at(list.custom_hash) != i) { continue; }
+        const auto metadata_bytes = get_metadata_bytes(list);
+        buf.resize(metadata_bytes + list.asset_size);
+        usize n_bytes_written = 0;
+        failed = read_payload(list.asset_start - metadata_bytes, std::span{ buf }) != buf.size();
+        if(!failed) { out.write(buf.data(), buf.size(), n_bytes_written, N_HEADER_BYTES + offset); }
+        failed |= n_bytes_written != buf.size();
+        auto& compacted = lists.emplace_back(list);
+        compacted.asset_start = offset + metadata_bytes;
+        offset += buf.size();
+    }
+    failed = failed || write_segment(out, offset, lists, 0) == 0;
+    out.close();
+    if(failed)
+    {
+        ENG_WARN("Failed compacting engb container {}", path.string());
+        std::filesystem::remove(compact_path);
+        return false;
     }
-    ctx.m_offset += 3; // 3B padding
-
-    u64 list_offset = 0;
-    ctx.safe_read(&list_offset, 8);
 
-    if(list_offset > N_HEADER_BYTES && list_offset <= ctx.m_bytes.size())
+    m_mapping.reset();
+    m_file->close();
+    std::error_code ec;
+    std::filesystem::rename(compact_path, path, ec);
+    if(ec)
     {
-        const usize n_asset_bytes = static_cast<usize>(list_offset - N_HEADER_BYTES);
-        m_asset_bytes.resize(n_asset_bytes);
-        ctx.safe_read(m_asset_bytes.data(), n_asset_bytes);
+        ENG_WARN("Couldn't replace engb container {} with its compacted copy: {}", path.string(), ec.message());
+        std::filesystem::remove(compact_path);
     }
+    m_file->open(path, fs::OpenMode::TRY_READ_WRITE_BYTES_BEG);
+    read_list_section();
+    return !ec;
+}
 
-    ctx.m_offset = static_cast<usize>(list_offset);
-    u32 n_lists = 0;
-    ctx.safe_read(&n_lists, sizeof(u32));
+std::optional<List> Container::get_asset_list(u64 custom_hash) const
+{
+    const auto it = m_lists_index.find(custom_hash);
+    if(it == m_lists_index.end()) { return std::nullopt; }
+    return m_lists_vec[it->second];
+}
 
-    m_lists_vec.resize(n_lists);
-    ctx.deserialize(std::span<List>{ m_lists_vec });
+AssetMetadata Container::get_asset_metadata(const List& list) const
+{
+    std::vector<std::byte> metadata_bytes(get_metadata_bytes(list));
+    if(read_payload(list.asset_start - metadata_bytes.size(), metadata_bytes) != metadata_bytes.size()) { return {}; }
+    return parse_asset_metadata(list, metadata_bytes);
+}
 
-    for(auto& l : m_lists_vec)
+usize Container::get_metadata_bytes(const List& list)
+{
+    if(list.flags.test(ListFlags::CONTENT_COMPRESSED_BIT)) { return sizeof(u64); }
+    if(list.flags.test(ListFlags::CHUNK_CHECKSUMS_BIT))
     {
-        ENG_ASSERT(l.version == 0 && l.content_hash != 0);
+        return ChunkChecksums::get_chunk_count(list.asset_size) * sizeof(u64);
     }
+    return 0;
 }
 
-std::optional<List> Container::get_asset_list(u64 custom_hash) const
+AssetMetadata Container::parse_asset_metadata(const List& list, std::span<const std::byte> metadata_bytes)
 {
-    for(const auto& l : m_lists_vec)
+    AssetMetadata metadata{};
+    if(metadata_bytes.size() != get_metadata_bytes(list)) { return metadata; }
+    if(list.flags.test(ListFlags::CONTENT_COMPRESSED_BIT))
     {
-        if(l.custom_hash == custom_hash) { return l; }
+        memcpy(&metadata.uncompressed_size, metadata_bytes.data(), sizeof(u64));
     }
-    return std::nullopt;
+    else if(list.flags.test(ListFlags::CHUNK_CHECKSUMS_BIT))
+    {
+        metadata.chunk_checksums.resize(metadata_bytes.size() / sizeof(u64));
+        memcpy(metadata.chunk_checksums.data(), metadata_bytes.data(), metadata_bytes.size());
+    }
+    return metadata;
+}
+
+bool Container::validate_asset_bytes(const List& list, std::span<const std::byte> bytes)
+{
+    return bytes.size() == list.asset_size && hash::xxh64(bytes.data(), bytes.size()) == list.content_hash;
+}
+
+bool Container::validate_chunk_checksums(const List& list, std::span<const u64> chunk_checksums)
+{
+    return chunk_checksums.size() == ChunkChecksums::get_chunk_count(list.asset_size) &&
+           hash::xxh64(chunk_checksums.data(), chunk_checksums.size_bytes()) == list.content_hash;
 }
 
 usize Container::get_asset_data(const List& list, std::span<std::byte> out_data, usize src_offset) const
 {
-    if(!m_file || !m_file->is_read()) { return 0; }
     if(src_offset >= list.asset_size) { return 0; }
     const usize remaining_in_asset = list.asset_size - src_offset;
     const usize bytes_to_read = std::min(out_data.size(), remaining_in_asset);
-    const u64 absolute_file_offset = N_HEADER_BYTES + list.asset_start + src_offset;
+    return read_payload(list.asset_start + src_offset, out_data.first(bytes_to_read));
+}
+
+fs::MappedFilePtr Container::get_asset_bytes(const List& list, std::span<const std::byte>& out_bytes) const
+{
+    out_bytes = {};
+    if(!m_mapping || list.asset_start + list.asset_size > m_append_offset) { return nullptr; }
+    const auto bytes = m_mapping->get_bytes();
+    const u64 absolute_file_offset = N_HEADER_BYTES + list.asset_start;
+    if(absolute_file_offset + list.asset_size > bytes.size()) { return nullptr; }
+    out_bytes = bytes.subspan(absolute_file_offset, list.asset_size);
+    return m_mapping;
+}
+
+usize Container::read_payload(u64 payload_offset, std::span<std::byte> out_data) const
+{
+    if(payload_offset >= m_append_offset)
+    {
+        const auto src_offset = payload_offset - m_append_offset;
+        if(src_offset >= m_asset_bytes.size()) { return 0; }
+        const auto n_bytes = std::min(out_data.size(), (usize)(m_asset_bytes.size() - src_offset));
+        std::memcpy(out_data.data(), m_asset_bytes.data() + src_offset, n_bytes);
+        return n_bytes;
+    }
+
+    const auto n_bytes = std::min(out_data.size(), (usize)(m_append_offset - payload_offset));
+    const u64 absolute_file_offset = N_HEADER_BYTES + payload_offset;
+    if(m_mapping && absolute_file_offset + n_bytes <= m_mapping->get_size())
+    {
+        std::memcpy(out_data.data(), m_mapping->get_bytes().data() + absolute_file_offset, n_bytes);
+        return n_bytes;
+    }
+    if(!m_file || !m_file->is_read()) { return 0; }
     usize n_bytes_read = 0;
-    m_file->read(out_data.data(), bytes_to_read, n_bytes_read, absolute_file_offset);
+    m_file->read(out_data.data(), n_bytes, n_bytes_read, absolute_file_offset);
     return n_bytes_read;
 }
 
-} // namespace v0
+void Container::build_lists_index()
+{
+    m_lists_index.clear();
+    m_lists_index.reserve(m_lists_vec.size());
+    for(auto i = 0u; i < m_lists_vec.size(); ++i)
+    {
+        m_lists_index[m_lists_vec[i].custom_hash] = i;
+    }
+}
+
+} // namespace v1
 } // namespace engb
 } // namespace serialization
-} // namespace eng
\ No newline at end of file
+} // namespace eng
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <cstdint>
 #include <type_traits>
@@ -23,6 +25,29 @@ namespace serialization
 
 class Context;
 
+// Checksums of every CHUNK_BYTES of bytes, e.g. of an uncompressed asset viewed in a mapping. Chunks are checked
+// only when some of their bytes are used, and only once, so bytes which are never read are never hashed.
+class ChunkChecksums
+{
+  public:
+    inline static constexpr usize CHUNK_BYTES = 64 * 1024;
+
+    static usize get_chunk_count(usize size) { return (size + CHUNK_BYTES - 1) / CHUNK_BYTES; }
+    // xxh64 of every chunk of bytes.
+    static std::vector<u64> make(std::span<const std::byte> bytes);
+
+    ChunkChecksums(std::span<const std::byte> bytes, std::vector<u64> checksums);
+
+    // False if any chunk with the bytes doesn't match its checksum. Bytes must be a part of the checked ones.
+    bool validate(std::span<const std::byte> bytes);
+    bool validate(usize offset, usize size);
+
+  private:
+    std::span<const std::byte> m_bytes;
+    std::vector<u64> m_checksums;
+    std::unique_ptr<std::atomic<u8>[]> m_states; // of chunks: not checked yet, valid or corrupted
+};
+
 template <typename T>
 concept IsMemcpySafe = std::is_arithmetic_v<T> || std::is_same_v<T, std::byte> || std::is_enum_v<T>;
 template <typename T>
@@ -44,19 +69,49 @@ class Context
   public:
     constexpr Context() = default;
     constexpr Context(std::span<std::byte> bytes, usize offset) : m_bytes(bytes), m_offset(offset) {}
+    // Appends to out_bytes, growing it as needed, so the size doesn't have to be found with another pass first.
+    Context(std::vector<std::byte>& out_bytes) : m_bytes(out_bytes), m_offset(out_bytes.size()), m_out_bytes(&out_bytes)
+    {
+    }
+    // for reading only, e.g. from a mapped file
+    constexpr Context(std::span<const std::byte> bytes, usize offset)
+        : m_bytes(const_cast<std::byte*>(bytes.data()), bytes.size()), m_offset(offset)
+    {
+    }
 
     void safe_write(const void* src, usize src_size)
     {
+        if(m_out_bytes && m_offset + src_size > m_bytes.size())
+        {
+            // grows geometrically, so writes stay amortized constant
+            m_out_bytes->resize(std::max(m_offset + src_size, m_out_bytes->size() * 2));
+            m_bytes = *m_out_bytes;
+        }
         if(src && m_offset + src_size <= m_bytes.size()) { std::memcpy(m_bytes.data() + m_offset, src, src_size); }
         m_offset += src_size;
     }
 
     void safe_read(void* dst, usize dst_size)
     {
-        if(dst && m_offset + dst_size <= m_bytes.size()) { std::memcpy(dst, m_bytes.data() + m_offset, dst_size); }
+        // nothing is read past a corrupted chunk, so corrupted sizes don't get to allocate anything
+        if(m_checksums && !m_checksums->validate(m_offset, dst_size)) { m_corrupted = true; }
+        if(dst && !m_corrupted && m_offset + dst_size <= m_bytes.size())
+        {
+            std::memcpy(dst, m_bytes.data() + m_offset, dst_size);
+        }
         m_offset += dst_size;
     }
 
+    // Returns the next size bytes without copying them; they are valid as long as m_bytes are.
+    // They aren't checked against m_checksums; whoever uses them checks them first.
+    std::span<const std::byte> view(usize size)
+    {
+        std::span<const std::byte> bytes;
+        if(m_offset + size <= m_bytes.size()) { bytes = m_bytes.subspan(m_offset, size); }
+        m_offset += size;
+        return bytes;
+    }
+
     template <IsMemcpySafe T> void serialize(const T& val) { safe_write(&val, sizeof(T)); }
     template <IsMemcpySafe T> void deserialize(T& val) { safe_read(&val, sizeof(T)); }
     template <ImplementsSerialize T> void serialize(const T& val) { val.serialize(*this); }
@@ -138,6 +193,8 @@ class Context
         ((deserialize_field(dst.*std::get<indices>(tuple).fieldptr)), ...);
     }
 
+    void serialize(const glm::vec3& vec) { safe_write(&vec, sizeof(vec)); }
+    void deserialize(glm::vec3& vec) { safe_read(&vec, sizeof(vec)); }
     void serialize(const glm::vec4& vec) { safe_write(&vec, sizeof(vec)); }
     void deserialize(glm::vec4& vec) { safe_read(&vec, sizeof(vec)); }
     template <usize Length> void serialize(const StackString<Length>& str)
@@ -173,49 +230,118 @@ class Context
 
     std::span<std::byte> m_bytes;
     usize m_offset{};
+    fs::MappedFilePtr m_mapping; // set when m_bytes are in it, so deserialized data can view them instead of copying
+    std::vector<std::byte>* m_out_bytes{}; // m_bytes are its contents; its size is the capacity, not what's written
+    std::shared_ptr<ChunkChecksums> m_checksums; // of m_bytes, if they are checked as they are read
+    bool m_corrupted{};                          // if a read chunk didn't match its checksum, or couldn't be decoded
+};
+
+/*
+    Schema hashes describe the serialized layout of a type, from the types of fields its get_struct_fields lists.
+    They change when a field is added, removed, reordered or changes type, so entries serialized with an older
+    layout are found as stale without anyone remembering to bump a version. Renamed fields keep the layout and
+    the hash. Types with their own serialize are opaque to it, and their changes still need a version bump.
+*/
+template <typename T> struct SchemaTag
+{
 };
 
+template <typename T> constexpr u64 get_schema_hash();
+
+template <typename T> constexpr u64 schema_hash(SchemaTag<T>)
+{
+    if constexpr(ImplementsGetStructFields<T>)
+    {
+        using FieldsTuple = std::decay_t<decltype(T::get_struct_fields())>;
+        return [&]<usize... indices>(std::index_sequence<indices...>) {
+            return ENG_HASH('{', get_schema_hash<typename std::tuple_element_t<indices, FieldsTuple>::Type>()..., '}');
+        }(std::make_index_sequence<std::tuple_size_v<FieldsTuple>>{});
+    }
+    else if constexpr(std::is_enum_v<T>) { return get_schema_hash<std::underlying_type_t<T>>(); }
+    else if constexpr(IsMemcpySafe<T>)
+    {
+        return ENG_HASH('p', (u32)sizeof(T), std::is_floating_point_v<T>, std::is_signed_v<T>);
+    }
+    else { return ENG_HASH('o', (u32)sizeof(T)); }
+}
+constexpr u64 schema_hash(SchemaTag<std::string>) { return ENG_HASH('s'); }
+template <usize Length> constexpr u64 schema_hash(SchemaTag<StackString<Length>>) { return ENG_HASH('s'); }
+template <typename T> constexpr u64 schema_hash(SchemaTag<std::vector<T>>) { return ENG_HASH('v', get_schema_hash<T>()); }
+template <typename T> constexpr u64 schema_hash(SchemaTag<Flags<T>>)
+{
+    return get_schema_hash<typename Flags<T>::U>();
+}
+template <typename T, typename Storage> constexpr u64 schema_hash(SchemaTag<Handle<T, Storage>>)
+{
+    return ENG_HASH('h', get_schema_hash<Storage>());
+}
+template <typename T> constexpr u64 schema_hash(SchemaTag<Range_T<T>>) { return ENG_HASH('r', get_schema_hash<T>()); }
+
+template <typename T> constexpr u64 get_schema_hash() { return schema_hash(SchemaTag<std::remove_cvref_t<T>>{}); }
+
 // clang-format off
 /*
 .enbg custom asset byte container format
 
-- 2026.07.12
+- 2026.10.18 (version 1)
+Entries are validated when read: the content hash and checksums of chunks against corruption, the version and
+the schema hash against stale layouts, and the source stamp against changes to the file the asset was imported
+from. Invalid entries are imported again, and the new entries shadow them. Uncompressed entries have checksums of
+their chunks, checked only as the chunks are read, so mapped data which is never used is never read.
+Append-only. Every write appends new assets, followed by an index segment listing only them, and then
+points the header at it; the header is written last, so a torn write leaves the container as it was.
+Segments chain to the previous ones, newest entries win. Stale entries are only dropped by Container::compact.
 The format for this is as follows:
 {
 	4B magic number 'engb',
 	1B container spec version,
 	3B Padding,
-	8B Jump offset to list item count (list section),
+	8B Absolute offset to the footer of the newest index segment, 0 if there is none,
 	[
-		[ optional metadata ]			- e.g., 8B uncompressed size if CONTENT_COMPRESSED_BIT is set
-		[ asset bytes ]					- Pointed to by asset_start (metadata lives immediately before this pointer)
-	] : ASSET BYTES,
+		[
+			[ optional metadata ]			- 8B uncompressed size if CONTENT_COMPRESSED_BIT is set, or 8B xxh64 of every
+											  ChunkChecksums::CHUNK_BYTES of asset bytes if CHUNK_CHECKSUMS_BIT is set
+			[ asset bytes ]					- Pointed to by asset_start (metadata lives immediately before this pointer)
+		] : ASSET BYTES,
+
+		[
+			{
+				8B custom hash for lookup	- usually from virtual path like '/assets/models/model/scene.gltf'
+				8B content hash				- xxh64 of the asset bytes, as stored; of the chunk checksums if there are any
+				8B schema hash				- of the types serialized in the contents, see get_schema_hash
+				8B source size				- size, modification time and xxh64 of the file the asset was imported
+				8B source mtime				  from; all 0 if it's unknown
+				8B source hash
+				8B asset start				- Payload-relative offset to the asset bytes (Add N_HEADER_BYTES to get absolute file offset)
+				8B asset byte size			- asset byte size (excludes all metadata from flags, offset from it to get them)
+				1B version number			- version of the byte representation of the contents in the container
+				1B flags					- flags describing the properties of the content
+			} : LIST_ITEM
+		] : LIST,							- ends where the footer starts
 
-	4B item count in the list of assets in this container,
-	[
 		{
-			8B custom hash for lookup	- usually from virtual path like '/assets/models/model/scene.gltf'
-			8B content hash				- hash of the contents
-			8B asset start				- Payload-relative offset to the asset bytes (Add N_HEADER_BYTES to get absolute file offset)
-			8B asset byte size			- asset byte size (excludes all metadata from flags, offset from it to get them)
-			1B version number			- version of the byte representation of the contents in the container
-			1B flags					- flags describing the properties of the content
-		} : LIST_ITEM
-	] : LIST,
+			4B magic number 'engf',
+			4B item count in the list,
+			8B Absolute offset to the footer of the previous segment, 0 if there is none,
+		} : FOOTER,
+	] : SEGMENT, repeated for every write
 } : .ENGB CONTAINER SPEC
 */
 // clang-format on
 namespace engb
 {
-inline namespace v0
+inline namespace v1
 {
 
+inline static constexpr u8 VERSION = 1;
 inline static constexpr usize N_HEADER_BYTES = 4 + 1 + 3 + 8;
-inline static constexpr usize N_LIST_BYTES = 4 * 8 + 2 * 1;
+inline static constexpr usize N_LIST_BYTES = 8 * 8 + 2 * 1;
+inline static constexpr usize N_FOOTER_BYTES = 4 + 4 + 8;
 
 enum class ListFlags : u8
 {
-    CONTENT_COMPRESSED_BIT = 1 << 0, // use zlib to decompress
+    CONTENT_COMPRESSED_BIT = 1 << 0, // chunked, see compression::decompress_chunked
+    CHUNK_CHECKSUMS_BIT = 1 << 1,    // of uncompressed assets, which are checked as they are used, see ChunkChecksums
 };
 ENG_ENABLE_FLAGS_OPERATORS(ListFlags);
 
@@ -223,6 +349,25 @@ ENG_ENABLE_FLAGS_OPERATORS(ListFlags);
 struct AssetMetadata
 {
     u64 uncompressed_size{};
+    std::vector<u64> chunk_checksums;
+};
+
+// Of the file an asset was imported from. Size and modification time are compared first, and the file is hashed
+// only when they differ, so only touched source files are read to validate their entries.
+struct SourceStamp
+{
+    static constexpr auto get_struct_fields()
+    {
+        return std::make_tuple(serialization::StructField{ &SourceStamp::size }, serialization::StructField{ &SourceStamp::mtime },
+                               serialization::StructField{ &SourceStamp::hash });
+    }
+    // Empty if the file isn't there. The hash is left 0 unless asked for, as it reads the whole file.
+    static std::optional<SourceStamp> init(const fs::Path& path, bool with_hash);
+    bool has_same_times(const SourceStamp& a) const { return size == a.size && mtime == a.mtime; }
+    bool is_empty() const { return size == 0 && mtime == 0 && hash == 0; }
+    u64 size{};
+    u64 mtime{}; // in ticks of the filesystem clock
+    u64 hash{};
 };
 
 struct List
@@ -230,11 +375,14 @@ struct List
     static constexpr auto get_struct_fields()
     {
         return std::make_tuple(serialization::StructField{ &List::custom_hash }, serialization::StructField{ &List::content_hash },
+                               serialization::StructField{ &List::schema_hash }, serialization::StructField{ &List::source },
                                serialization::StructField{ &List::asset_start }, serialization::StructField{ &List::asset_size },
                                serialization::StructField{ &List::version }, serialization::StructField{ &List::flags });
     }
     u64 custom_hash{};
     u64 content_hash{};
+    u64 schema_hash{};
+    SourceStamp source{};
     u64 asset_start{}; // start of asset bytes, skipping metadata from flags, which is left uncompressed; does not include N_HEADER_BYTES
     u64 asset_size{}; // this probably could be calculated from total file size or next_item_list_asset_start - this_item_list_asset_start
     u8 version{};
@@ -248,25 +396,54 @@ struct Container
 
     void read_list_section();
 
-    void add_asset(u8 version, u64 custom_hash, Flags<ListFlags> flags, std::span<const std::byte> asset,
-                   const AssetMetadata& metadata = {});
-    // for streaming compressed data later for the currently added asset, see asset_manager.cpp. set finished on last append to recalc hash.
-    void append_asset_bytes(std::span<const std::byte> bytes, bool finished);
+    void add_asset(u8 version, u64 schema_hash, u64 custom_hash, Flags<ListFlags> flags, std::span<const std::byte> asset,
+                   const AssetMetadata& metadata = {}, const SourceStamp& source = {});
+    // Records a new source stamp for the newest entry with the hash, without touching its bytes; for sources which
+    // were touched, but whose contents are the same, so they aren't hashed again on every start.
+    void restamp_asset(u64 custom_hash, const SourceStamp& source);
 
+    // Appends assets added since the last write, and their index segment. Costs only the new data.
     void write_to_file();
-    void serialize(serialization::Context& ctx) const;
-    void deserialize(serialization::Context& ctx);
+    // Rewrites the file without entries shadowed by newer ones, as a single segment. Offline operation: the file is
+    // replaced, so nothing may view its mapping anymore.
+    bool compact();
 
+    // Newest entry with the hash wins, as re-imported assets (e.g. after version bump) are added after the stale ones.
     std::optional<List> get_asset_list(u64 custom_hash) const;
+    AssetMetadata get_asset_metadata(const List& list) const;
+    // Size of the metadata just before the asset bytes of the entry.
+    static usize get_metadata_bytes(const List& list);
+    static AssetMetadata parse_asset_metadata(const List& list, std::span<const std::byte> metadata_bytes);
+    // Checks stored bytes of the entry against its content hash; not for entries with chunk checksums.
+    static bool validate_asset_bytes(const List& list, std::span<const std::byte> bytes);
+    // Checks chunk checksums of the entry against its content hash, so they can be trusted to check the chunks.
+    static bool validate_chunk_checksums(const List& list, std::span<const u64> chunk_checksums);
     usize get_asset_data(const List& list, std::span<std::byte> out_data, usize src_offset) const;
+    // Views stored asset bytes (compressed ones stay compressed) in the mapping of the file, and returns the mapping.
+    // Returns null if the asset isn't in it, e.g. when it's not written to the file yet.
+    fs::MappedFilePtr get_asset_bytes(const List& list, std::span<const std::byte>& out_bytes) const;
+
+    // If the asset's bytes are in the file, and not only in memory, waiting for the next write.
+    bool is_asset_written(const List& list) const { return list.asset_start + list.asset_size <= m_append_offset; }
+    // Containers in mounted pack archives are read-only.
+    bool is_writable() const { return m_file && m_file->is_write(); }
+
+    // Reads from wherever the bytes are: not yet written ones, the mapping or the file.
+    usize read_payload(u64 payload_offset, std::span<std::byte> out_data) const;
+    void build_lists_index();
 
     fs::FilePtr m_file;
+    fs::MappedFilePtr m_mapping; // of the file as it was read or last written; null if it couldn't be mapped
     std::vector<List> m_lists_vec;
-    std::vector<std::byte> m_asset_bytes;
+    std::unordered_map<u64, u32> m_lists_index; // custom hash to the newest entry of m_lists_vec with it
+    std::vector<std::byte> m_asset_bytes;       // of assets added since the last write, starting at m_append_offset
+    u64 m_append_offset{};                      // payload-relative end of the newest segment; new assets go here
+    u64 m_last_footer{};                        // absolute offset of the newest segment's footer; 0 if there is none
+    u32 m_n_written_lists{};                    // entries of m_lists_vec which are in the file
     bool m_modified{ false };
 };
 
-} // namespace v0
+} // namespace v1
 } // namespace engb
 } // namespace serialization
 } // namespace eng
\ No newline at end of file
@@ -0,0 +1,651 @@
+#include "texture_compression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <glm/glm.hpp>
+
+namespace eng
+{
+namespace compression
+{
+
+using BlockTexels = u8[16][4];
+
+static constexpr u32 BC7_WEIGHTS4[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static void fetch_block(std::span<const std::byte> rgba8, u32 width, u32 height, u32 bx, u32 by, BlockTexels& out)
+{
+    for(auto y = 0u; y < 4; ++y)
+    {
+        const auto sy = std::min(by * 4 + y, height - 1);
+        for(auto x = 0u; x < 4; ++x)
+        {
+            const auto sx = std::min(bx * 4 + x, width - 1);
+            memcpy(out[y * 4 + x], rgba8.data() + (sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+static void store_block(const BlockTexels& block, u32 width, u32 height, u32 bx, u32 by, std::span<std::byte> rgba8)
+{
+    for(auto y = 0u; y < 4 && by * 4 + y < height; ++y)
+    {
+        for(auto x = 0u; x < 4 && bx * 4 + x < width; ++x)
+        {
+            memcpy(rgba8.data() + ((by * 4 + y) * width + bx * 4 + x) * 4, block[y * 4 + x], 4);
+        }
+    }
+}
+
+// Principal axis of points with power iteration. Returns false if all points are the same.
+template <int N>
+static bool principal_axis(const glm::vec<N, float>* points, u32 count, glm::vec<N, float>& out_mean,
+                           glm::vec<N, float>& out_axis)
+{
+    using vec = glm::vec<N, float>;
+    out_mean = vec{ 0.0f };
+    for(auto i = 0u; i < count; ++i)
+    {
+        out_mean += points[i];
+    }
+    out_mean /= (float)count;
+
+    float cov[N][N]{};
+    vec mn{ FLT_MAX }, mx{ -FLT_MAX };
+    for(auto i = 0u; i < count; ++i)
+    {
+        const auto d = points[i] - out_mean;
+        for(auto r = 0; r < N; ++r)
+        {
+            for(auto c = 0; c < N; ++c)
+            {
+                cov[r][c] += d[r] * d[c];
+            }
+        }
+        mn = glm::min(mn, points[i]);
+        mx = glm::max(mx, points[i]);
+    }
+
+    vec axis = mx - mn;
+    if(glm::dot(axis, axis) < 1e-6f) { return false; }
+    for(auto it = 0; it < 8; ++it)
+    {
+        vec next{ 0.0f };
+        for(auto r = 0; r < N; ++r)
+        {
+            for(auto c = 0; c < N; ++c)
+            {
+                next[r] += cov[r][c] * axis[c];
+            }
+        }
+        const auto len2 = glm::dot(next, next);
+        if(len2 < 1e-12f) { break; }
+        axis = next / std::sqrt(len2);
+    }
+    out_axis = glm::normalize(axis);
+    return true;
+}
+
+// Least squares endpoints for fixed interpolation weights; weights[i] is the fraction of e1 for point i.
+template <int N>
+static bool fit_endpoints(const glm::vec<N, float>* points, const float* weights, u32 count, glm::vec<N, float>& e0,
+                          glm::vec<N, float>& e1)
+{
+    using vec = glm::vec<N, float>;
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    vec x{ 0.0f }, y{ 0.0f };
+    for(auto i = 0u; i < count; ++i)
+    {
+        const auto w1 = weights[i];
+        const auto w0 = 1.0f - w1;
+        a += w0 * w0;
+        b += w0 * w1;
+        c += w1 * w1;
+        x += w0 * points[i];
+        y += w1 * points[i];
+    }
+    const auto det = a * c - b * b;
+    if(std::abs(det) < 1e-6f) { return false; }
+    e0 = glm::clamp((c * x - b * y) / det, vec{ 0.0f }, vec{ 255.0f });
+    e1 = glm::clamp((a * y - b * x) / det, vec{ 0.0f }, vec{ 255.0f });
+    return true;
+}
+
+static u16 pack_565(glm::vec3 c)
+{
+    c = glm::clamp(c, glm::vec3{ 0.0f }, glm::vec3{ 255.0f });
+    const auto r = (u32)std::lround(c.r * 31.0f / 255.0f);
+    const auto g = (u32)std::lround(c.g * 63.0f / 255.0f);
+    const auto b = (u32)std::lround(c.b * 31.0f / 255.0f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static glm::ivec3 unpack_565(u16 c)
+{
+    const i32 r = (c >> 11) & 31;
+    const i32 g = (c >> 5) & 63;
+    const i32 b = c & 31;
+    return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+}
+
+// c0 > c1 selects 4 color mode, otherwise 3 colors and transparent black.
+static void bc1_palette(u16 c0, u16 c1, bool force_four_colors, glm::ivec3 (&out)[4])
+{
+    out[0] = unpack_565(c0);
+    out[1] = unpack_565(c1);
+    if(c0 > c1 || force_four_colors)
+    {
+        out[2] = (2 * out[0] + out[1]) / 3;
+        out[3] = (out[0] + 2 * out[1]) / 3;
+    }
+    else
+    {
+        out[2] = (out[0] + out[1]) / 2;
+        out[3] = glm::ivec3{ 0 };
+    }
+}
+
+// Picks the nearest palette entry for each texel. Transparent texels get index 3 in 3 color mode.
+static u32 bc1_fit(const BlockTexels& block, u16 c0, u16 c1, bool force_four_colors, u16 transparent_mask,
+                   u32& out_indices)
+{
+    glm::ivec3 pal[4];
+    bc1_palette(c0, c1, force_four_colors, pal);
+    const auto num_colors = c0 > c1 || force_four_colors ? 4 : 3;
+    u32 error = 0;
+    out_indices = 0;
+    for(auto i = 0u; i < 16; ++i)
+    {
+        if(transparent_mask & (1u << i))
+        {
+            out_indices |= 3u << (i * 2);
+            continue;
+        }
+        const glm::ivec3 px{ block[i][0], block[i][1], block[i][2] };
+        u32 best = ~0u, best_idx = 0;
+        for(auto j = 0; j < num_colors; ++j)
+        {
+            const auto d = px - pal[j];
+            const auto e = (u32)(d.x * d.x + d.y * d.y + d.z * d.z);
+            if(e < best)
+            {
+                best = e;
+                best_idx = j;
+            }
+        }
+        error += best;
+        out_indices |= best_idx << (i * 2);
+    }
+    return error;
+}
+
+// BC3 color blocks always decode as 4 colors, and have no 1 bit alpha.
+static void encode_bc1_block(const BlockTexels& block, bool bc3_color, std::byte* out)
+{
+    u16 transparent_mask = 0;
+    glm::vec3 points[16];
+    u32 count = 0;
+    for(auto i = 0u; i < 16; ++i)
+    {
+        if(!bc3_color && block[i][3] < 128)
+        {
+            transparent_mask |= 1u << i;
+            continue;
+        }
+        points[count++] = glm::vec3{ block[i][0], block[i][1], block[i][2] };
+    }
+
+    u16 c0 = 0, c1 = 0;
+    u32 indices = 0;
+    if(count == 0) { indices = ~0u; }
+    else
+    {
+        glm::vec3 mean, axis;
+        glm::vec3 e0, e1;
+        if(!principal_axis<3>(points, count, mean, axis)) { e0 = e1 = mean; }
+        else
+        {
+            float tmin = FLT_MAX, tmax = -FLT_MAX;
+            for(auto i = 0u; i < count; ++i)
+            {
+                const auto t = glm::dot(points[i] - mean, axis);
+                tmin = std::min(tmin, t);
+                tmax = std::max(tmax, t);
+            }
+            e0 = mean + axis * tmax;
+            e1 = mean + axis * tmin;
+        }
+
+        // 4 color mode needs c0 > c1, 3 color mode (required for transparency) needs c0 <= c1
+        const auto order = [transparent_mask](u16 a, u16 b) {
+            if(transparent_mask) { return std::make_pair(std::min(a, b), std::max(a, b)); }
+            return std::make_pair(std::max(a, b), std::min(a, b));
+        };
+        u32 best_error = ~0u;
+        const auto try_endpoints = [&](glm::vec3 a, glm::vec3 b) {
+            const auto [qa, qb] = order(pack_565(a), pack_565(b));
+            u32 idx;
+            const auto err = bc1_fit(block, qa, qb, bc3_color, transparent_mask, idx);
+            if(err < best_error)
+            {
+                best_error = err;
+                c0 = qa;
+                c1 = qb;
+                indices = idx;
+            }
+        };
+        try_endpoints(e0, e1);
+
+        // refine once with least squares using the indices just found; black of 3 color mode is off the line
+        static constexpr float W4[4]{ 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        static constexpr float W3[4]{ 0.0f, 1.0f, 0.5f, 0.0f };
+        const auto four_colors = c0 > c1 || bc3_color;
+        glm::vec3 fit_points[16];
+        float weights[16];
+        u32 fit_count = 0;
+        for(auto i = 0u; i < 16; ++i)
+        {
+            const auto idx = (indices >> (i * 2)) & 3;
+            if(!four_colors && idx == 3) { continue; }
+            fit_points[fit_count] = glm::vec3{ block[i][0], block[i][1], block[i][2] };
+            weights[fit_count++] = four_colors ? W4[idx] : W3[idx];
+        }
+        if(fit_endpoints<3>(fit_points, weights, fit_count, e0, e1)) { try_endpoints(e0, e1); }
+    }
+
+    memcpy(out, &c0, 2);
+    memcpy(out + 2, &c1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+static void encode_bc4_block(const BlockTexels& block, u32 channel, std::byte* out)
+{
+    u8 mn = 255, mx = 0;
+    for(auto i = 0u; i < 16; ++i)
+    {
+        mn = std::min(mn, block[i][channel]);
+        mx = std::max(mx, block[i][channel]);
+    }
+
+    // a0 > a1 selects 8 interpolated values
+    i32 pal[8]{ mx, mn };
+    for(auto i = 2; i < 8; ++i)
+    {
+        pal[i] = ((8 - i) * mx + (i - 1) * mn) / 7;
+    }
+    u64 bits = (u64)mx | ((u64)mn << 8);
+    if(mx != mn)
+    {
+        for(auto i = 0u; i < 16; ++i)
+        {
+            i32 best = INT32_MAX, best_idx = 0;
+            for(auto j = 0; j < 8; ++j)
+            {
+                const auto e = std::abs((i32)block[i][channel] - pal[j]);
+                if(e < best)
+                {
+                    best = e;
+                    best_idx = j;
+                }
+            }
+            bits |= (u64)best_idx << (16 + i * 3);
+        }
+    }
+    memcpy(out, &bits, 8);
+}
+
+struct BitWriter
+{
+    void write(u32 value, u32 count)
+    {
+        for(auto i = 0u; i < count; ++i, ++pos)
+        {
+            if((value >> i) & 1) { bytes[pos / 8] |= (u8)(1u << (pos % 8)); }
+        }
+    }
+    u8 bytes[16]{};
+    u32 pos{};
+};
+
+struct BitReader
+{
+    u32 read(u32 count)
+    {
+        u32 value = 0;
+        for(auto i = 0u; i < count; ++i, ++pos)
+        {
+            value |= (u32)((bytes[pos / 8] >> (pos % 8)) & 1) << i;
+        }
+        return value;
+    }
+    const u8* bytes{};
+    u32 pos{};
+};
+
+// 7 bit endpoint with a shared p-bit per endpoint, quantized to the p-bit giving smaller error.
+static glm::ivec4 bc7_quantize_endpoint(glm::vec4 e, u32& out_pbit)
+{
+    glm::ivec4 best_q{};
+    float best_error = FLT_MAX;
+    for(auto p = 0u; p < 2; ++p)
+    {
+        glm::ivec4 q;
+        float error = 0.0f;
+        for(auto c = 0; c < 4; ++c)
+        {
+            q[c] = std::clamp((i32)std::lround((e[c] - (float)p) * 0.5f), 0, 127);
+            const auto d = (float)((q[c] << 1) | p) - e[c];
+            error += d * d;
+        }
+        if(error < best_error)
+        {
+            best_error = error;
+            best_q = q;
+            out_pbit = p;
+        }
+    }
+    return best_q;
+}
+
+static u32 bc7_fit(const BlockTexels& block, glm::ivec4 e0, glm::ivec4 e1, u8 (&out_indices)[16])
+{
+    glm::ivec4 pal[16];
+    for(auto i = 0; i < 16; ++i)
+    {
+        pal[i] = ((64 - (i32)BC7_WEIGHTS4[i]) * e0 + (i32)BC7_WEIGHTS4[i] * e1 + 32) >> 6;
+    }
+    u32 error = 0;
+    for(auto i = 0u; i < 16; ++i)
+    {
+        const glm::ivec4 px{ block[i][0], block[i][1], block[i][2], block[i][3] };
+        u32 best = ~0u;
+        for(auto j = 0; j < 16; ++j)
+        {
+            const auto d = px - pal[j];
+            const auto e = (u32)(d.x * d.x + d.y * d.y + d.z * d.z + d.w * d.w);
+            if(e < best)
+            {
+                best = e;
+                out_indices[i] = (u8)j;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+static void encode_bc7_block(const BlockTexels& block, std::byte* out)
+{
+    glm::vec4 points[16];
+    for(auto i = 0u; i < 16; ++i)
+    {
+        points[i] = glm::vec4{ block[i][0], block[i][1], block[i][2], block[i][3] };
+    }
+    glm::vec4 mean, axis, e0, e1;
+    if(!principal_axis<4>(points, 16, mean, axis)) { e0 = e1 = mean; }
+    else
+    {
+        float tmin = FLT_MAX, tmax = -FLT_MAX;
+        for(auto i = 0u; i < 16; ++i)
+        {
+            const auto t = glm::dot(points[i] - mean, axis);
+            tmin = std::min(tmin, t);
+            tmax = std::max(tmax, t);
+        }
+        e0 = glm::clamp(mean + axis * tmin, glm::vec4{ 0.0f }, glm::vec4{ 255.0f });
+        e1 = glm::clamp(mean + axis * tmax, glm::vec4{ 0.0f }, glm::vec4{ 255.0f });
+    }
+
+    glm::ivec4 q0{}, q1{};
+    u32 p0{}, p1{};
+    u8 indices[16]{};
+    u32 best_error = ~0u;
+    for(auto it = 0; it < 3; ++it)
+    {
+        u32 tp0, tp1;
+        const auto tq0 = bc7_quantize_endpoint(e0, tp0);
+        const auto tq1 = bc7_quantize_endpoint(e1, tp1);
+        u8 tindices[16];
+        const auto error = bc7_fit(block, (tq0 << 1) | glm::ivec4(tp0), (tq1 << 1) | glm::ivec4(tp1), tindices);
+        if(error >= best_error) { break; }
+        best_error = error;
+        q0 = tq0;
+        q1 = tq1;
+        p0 = tp0;
+        p1 = tp1;
+        memcpy(indices, tindices, sizeof(indices));
+
+        float weights[16];
+        for(auto i = 0u; i < 16; ++i)
+        {
+            weights[i] = (float)BC7_WEIGHTS4[indices[i]] / 64.0f;
+        }
+        if(!fit_endpoints<4>(points, weights, 16, e0, e1)) { break; }
+    }
+
+    // first index has implicit top bit of 0
+    if(indices[0] >= 8)
+    {
+        std::swap(q0, q1);
+        std::swap(p0, p1);
+        for(auto& i : indices)
+        {
+            i = 15 - i;
+        }
+    }
+
+    BitWriter bw;
+    bw.write(1u << 6, 7);
+    for(auto c = 0; c < 4; ++c)
+    {
+        bw.write((u32)q0[c], 7);
+        bw.write((u32)q1[c], 7);
+    }
+    bw.write(p0, 1);
+    bw.write(p1, 1);
+    bw.write(indices[0], 3);
+    for(auto i = 1u; i < 16; ++i)
+    {
+        bw.write(indices[i], 4);
+    }
+    memcpy(out, bw.bytes, 16);
+}
+
+static void decode_bc1_block(const std::byte* in, bool force_four_colors, BlockTexels& out)
+{
+    u16 c0, c1;
+    u32 indices;
+    memcpy(&c0, in, 2);
+    memcpy(&c1, in + 2, 2);
+    memcpy(&indices, in + 4, 4);
+    glm::ivec3 pal[4];
+    bc1_palette(c0, c1, force_four_colors, pal);
+    const auto transparent_black = !force_four_colors && c0 <= c1;
+    for(auto i = 0u; i < 16; ++i)
+    {
+        const auto idx = (indices >> (i * 2)) & 3;
+        out[i][0] = (u8)pal[idx].r;
+        out[i][1] = (u8)pal[idx].g;
+        out[i][2] = (u8)pal[idx].b;
+        out[i][3] = transparent_black && idx == 3 ? 0 : 255;
+    }
+}
+
+static void decode_bc4_block(const std::byte* in, u32 channel, BlockTexels& out)
+{
+    u64 bits;
+    memcpy(&bits, in, 8);
+    const i32 a0 = bits & 0xFF;
+    const i32 a1 = (bits >> 8) & 0xFF;
+    i32 pal[8]{ a0, a1 };
+    if(a0 > a1)
+    {
+        for(auto i = 2; i < 8; ++i)
+        {
+            pal[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        }
+    }
+    else
+    {
+        for(auto i = 2; i < 6; ++i)
+        {
+            pal[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        }
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+    for(auto i = 0u; i < 16; ++i)
+    {
+        out[i][channel] = (u8)pal[(bits >> (16 + i * 3)) & 7];
+    }
+}
+
+static void decode_bc7_block(const std::byte* in, BlockTexels& out)
+{
+    BitReader br{ .bytes = (const u8*)in };
+    if(br.read(7) != (1u << 6))
+    {
+        memset(out, 0, sizeof(out));
+        return;
+    }
+    glm::ivec4 e0, e1;
+    for(auto c = 0; c < 4; ++c)
+    {
+        e0[c] = (i32)br.read(7) << 1;
+        e1[c] = (i32)br.read(7) << 1;
+    }
+    e0 = e0 | glm::ivec4((i32)br.read(1));
+    e1 = e1 | glm::ivec4((i32)br.read(1));
+    for(auto i = 0u; i < 16; ++i)
+    {
+        const auto w = (i32)BC7_WEIGHTS4[br.read(i == 0 ? 3 : 4)];
+        const auto c = ((64 - w) * e0 + w * e1 + 32) >> 6;
+        for(auto ch = 0; ch < 4; ++ch)
+        {
+            out[i][ch] = (u8)c[ch];
+        }
+    }
+}
+
+u32 get_bc_block_size(BCFormat format)
+{
+    return format == BCFormat::BC1 || format == BCFormat::BC4 ? 8 : 16;
+}
+
+usize get_bc_image_size(BCFormat format, u32 width, u32 height)
+{
+    return (usize)((width + 3) / 4) * ((height + 3) / 4) * get_bc_block_size(format);
+}
+
+std::vector<std::byte> bc_encode(BCFormat format, std::span<const std::byte> rgba8, u32 width, u32 height)
+{
+    const auto blocks_x = (width + 3) / 4;
+    const auto blocks_y = (height + 3) / 4;
+    const auto block_size = get_bc_block_size(format);
+    std::vector<std::byte> out(get_bc_image_size(format, width, height));
+    if(out.empty()) { return out; }
+    ENG_ASSERT(rgba8.size() >= (usize)width * height * 4);
+
+    std::vector<u32> rows(blocks_y);
+    std::iota(rows.begin(), rows.end(), 0u);
+    std::for_each(std::execution::par, rows.begin(), rows.end(), [&](u32 by) {
+        BlockTexels block;
+        for(auto bx = 0u; bx < blocks_x; ++bx)
+        {
+            fetch_block(rgba8, width, height, bx, by, block);
+            auto* dst = out.data() + ((usize)by * blocks_x + bx) * block_size;
+            switch(format)
+            {
+            case BCFormat::BC1:
+                encode_bc1_block(block, false, dst);
+                break;
+            case BCFormat::BC3:
+                encode_bc4_block(block, 3, dst);
+                encode_bc1_block(block, true, dst + 8);
+                break;
+            case BCFormat::BC4:
+                encode_bc4_block(block, 0, dst);
+                break;
+            case BCFormat::BC5:
+                encode_bc4_block(block, 0, dst);
+                encode_bc4_block(block, 1, dst + 8);
+                break;
+            case BCFormat::BC7:
+                encode_bc7_block(block, dst);
+                break;
+            }
+        }
+    });
+    return out;
+}
+
+std::vector<std::byte> bc_decode(BCFormat format, std::span<const std::byte> blocks, u32 width, u32 height)
+{
+    const auto blocks_x = (width + 3) / 4;
+    const auto blocks_y = (height + 3) / 4;
+    const auto block_size = get_bc_block_size(format);
+    std::vector<std::byte> out((usize)width * height * 4);
+    ENG_ASSERT(blocks.size() >= get_bc_image_size(format, width, height));
+
+    for(auto by = 0u; by < blocks_y; ++by)
+    {
+        for(auto bx = 0u; bx < blocks_x; ++bx)
+        {
+            BlockTexels block{};
+            const auto* src = blocks.data() + ((usize)by * blocks_x + bx) * block_size;
+            switch(format)
+            {
+            case BCFormat::BC1:
+                decode_bc1_block(src, false, block);
+                break;
+            case BCFormat::BC3:
+                decode_bc1_block(src + 8, true, block);
+                decode_bc4_block(src, 3, block);
+                break;
+            case BCFormat::BC4:
+                decode_bc4_block(src, 0, block);
+                for(auto& t : block)
+                {
+                    t[3] = 255;
+                }
+                break;
+            case BCFormat::BC5:
+                decode_bc4_block(src, 0, block);
+                decode_bc4_block(src + 8, 1, block);
+                for(auto& t : block)
+                {
+                    t[3] = 255;
+                }
+                break;
+            case BCFormat::BC7:
+                decode_bc7_block(src, block);
+                break;
+            }
+            store_block(block, width, height, bx, by, out);
+        }
+    }
+    return out;
+}
+
+float compute_psnr(std::span<const std::byte> rgba8_a, std::span<const std::byte> rgba8_b, u32 channel_mask)
+{
+    ENG_ASSERT(rgba8_a.size() == rgba8_b.size());
+    f64 sum = 0.0;
+    u64 count = 0;
+    for(auto i = 0ull; i < rgba8_a.size(); ++i)
+    {
+        if(!(channel_mask & (1u << (i % 4)))) { continue; }
+        const auto d = (f64)rgba8_a[i] - (f64)rgba8_b[i];
+        sum += d * d;
+        ++count;
+    }
+    if(count == 0 || sum == 0.0) { return std::numeric_limits<float>::infinity(); }
+    const auto mse = sum / (f64)count;
+    return (float)(10.0 * std::log10(255.0 * 255.0 / mse));
+}
+
+} // namespace compression
+} // namespace eng
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <eng/common/types.hpp>
+
+namespace eng
+{
+namespace compression
+{
+
+/*
+    CPU block compression of rgba8 images. Every format works on 4x4 texel blocks; partial
+    blocks at image edges replicate the last row/column. Blocks are encoded in parallel.
+    BC1: rgb + 1 bit alpha, 8 bytes. BC3: BC1 rgb + BC4 alpha, 16 bytes. BC4: r, 8 bytes.
+    BC5: rg as two BC4 blocks, 16 bytes. BC7: rgba, only mode 6 is used, 16 bytes.
+*/
+enum class BCFormat : u8
+{
+    BC1,
+    BC3,
+    BC4,
+    BC5,
+    BC7,
+};
+
+u32 get_bc_block_size(BCFormat format);
+usize get_bc_image_size(BCFormat format, u32 width, u32 height);
+
+std::vector<std::byte> bc_encode(BCFormat format, std::span<const std::byte> rgba8, u32 width, u32 height);
+// Decodes back to rgba8, for measuring the quality. BC7 decoding handles only mode 6.
+// Channels missing from the format are set to 0, or 255 for alpha.
+std::vector<std::byte> bc_decode(BCFormat format, std::span<const std::byte> blocks, u32 width, u32 height);
+
+// Peak signal to noise ratio in dB over channels selected by channel_mask (bit 0 is red). Infinity if equal.
+float compute_psnr(std::span<const std::byte> rgba8_a, std::span<const std::byte> rgba8_b, u32 channel_mask = 0xF);
+
+} // namespace compression
+} // namespace eng
@@ -0,0 +1,140 @@
+#include "vertex_compression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <meshoptimizer/src/meshoptimizer.h>
+
+namespace eng
+{
+namespace compression
+{
+
+static constexpr usize ATTRIBUTE_FLOATS = 9;
+
+static i16 to_snorm16(float v) { return (i16)std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f); }
+
+static float from_snorm16(i16 v) { return std::max((float)v / 32767.0f, -1.0f); }
+
+static glm::vec2 oct_encode(glm::vec3 n)
+{
+    const auto l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(l1 == 0.0f) { return glm::vec2{ 0.0f }; }
+    n /= l1;
+    if(n.z >= 0.0f) { return glm::vec2{ n.x, n.y }; }
+    return glm::vec2{ (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f) };
+}
+
+static glm::vec3 oct_decode(glm::vec2 e)
+{
+    glm::vec3 n{ e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y) };
+    const auto t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    const auto len = glm::length(n);
+    return len > 0.0f ? n / len : glm::vec3{ 0.0f, 0.0f, 1.0f };
+}
+
+void quantize_positions(std::span<const float> positions, glm::vec3 aabb_min, glm::vec3 aabb_max,
+                        std::span<QuantizedPosition> out_positions)
+{
+    ENG_ASSERT(out_positions.size() * 3 == positions.size());
+    const auto extent = aabb_max - aabb_min;
+    const auto scale = glm::vec3{ extent.x > 0.0f ? 65535.0f / extent.x : 0.0f,
+                                  extent.y > 0.0f ? 65535.0f / extent.y : 0.0f,
+                                  extent.z > 0.0f ? 65535.0f / extent.z : 0.0f };
+    for(auto i = 0ull; i < out_positions.size(); ++i)
+    {
+        const auto p = glm::vec3{ positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2] };
+        const auto q = glm::clamp((p - aabb_min) * scale, glm::vec3{ 0.0f }, glm::vec3{ 65535.0f });
+        out_positions[i] = QuantizedPosition{ (u16)std::lround(q.x), (u16)std::lround(q.y), (u16)std::lround(q.z), 0 };
+    }
+}
+
+void dequantize_positions(std::span<const QuantizedPosition> positions, glm::vec3 aabb_min, glm::vec3 aabb_max,
+                          std::span<float> out_positions)
+{
+    ENG_ASSERT(positions.size() * 3 == out_positions.size());
+    const auto scale = (aabb_max - aabb_min) / 65535.0f;
+    for(auto i = 0ull; i < positions.size(); ++i)
+    {
+        const auto& q = positions[i];
+        const auto p = aabb_min + glm::vec3{ q.x, q.y, q.z } * scale;
+        out_positions[i * 3 + 0] = p.x;
+        out_positions[i * 3 + 1] = p.y;
+        out_positions[i * 3 + 2] = p.z;
+    }
+}
+
+void quantize_attributes(std::span<const float> attributes, std::span<QuantizedAttribute> out_attributes)
+{
+    ENG_ASSERT(out_attributes.size() * ATTRIBUTE_FLOATS == attributes.size());
+    for(auto i = 0ull; i < out_attributes.size(); ++i)
+    {
+        const auto* a = &attributes[i * ATTRIBUTE_FLOATS];
+        const auto n = oct_encode(glm::vec3{ a[0], a[1], a[2] });
+        const auto t = oct_encode(glm::vec3{ a[3], a[4], a[5] });
+        out_attributes[i] = QuantizedAttribute{ .normal = { to_snorm16(n.x), to_snorm16(n.y) },
+                                                .tangent = { to_snorm16(t.x), to_snorm16(t.y) },
+                                                .uv = { glm::packHalf1x16(a[7]), glm::packHalf1x16(a[8]) },
+                                                .tangent_sign = (i16)(a[6] < 0.0f ? -1 : 1),
+                                                .pad = 0 };
+    }
+}
+
+void dequantize_attributes(std::span<const QuantizedAttribute> attributes, std::span<float> out_attributes)
+{
+    ENG_ASSERT(attributes.size() * ATTRIBUTE_FLOATS == out_attributes.size());
+    for(auto i = 0ull; i < attributes.size(); ++i)
+    {
+        const auto& q = attributes[i];
+        const auto n = oct_decode(glm::vec2{ from_snorm16(q.normal[0]), from_snorm16(q.normal[1]) });
+        const auto t = oct_decode(glm::vec2{ from_snorm16(q.tangent[0]), from_snorm16(q.tangent[1]) });
+        auto* a = &out_attributes[i * ATTRIBUTE_FLOATS];
+        a[0] = n.x;
+        a[1] = n.y;
+        a[2] = n.z;
+        a[3] = t.x;
+        a[4] = t.y;
+        a[5] = t.z;
+        a[6] = (float)q.tangent_sign;
+        a[7] = glm::unpackHalf1x16(q.uv[0]);
+        a[8] = glm::unpackHalf1x16(q.uv[1]);
+    }
+}
+
+std::vector<std::byte> encode_vertex_buffer(std::span<const std::byte> vertices, usize vertex_size)
+{
+    ENG_ASSERT(vertex_size % 4 == 0 && vertex_size <= 256 && vertices.size() % vertex_size == 0);
+    const auto vertex_count = vertices.size() / vertex_size;
+    std::vector<std::byte> encoded(meshopt_encodeVertexBufferBound(vertex_count, vertex_size));
+    encoded.resize(meshopt_encodeVertexBuffer((unsigned char*)encoded.data(), encoded.size(), vertices.data(),
+                                              vertex_count, vertex_size));
+    return encoded;
+}
+
+bool decode_vertex_buffer(std::span<const std::byte> encoded, usize vertex_size, std::span<std::byte> out_vertices)
+{
+    ENG_ASSERT(out_vertices.size() % vertex_size == 0);
+    return meshopt_decodeVertexBuffer(out_vertices.data(), out_vertices.size() / vertex_size, vertex_size,
+                                      (const unsigned char*)encoded.data(), encoded.size()) == 0;
+}
+
+std::vector<std::byte> encode_index_buffer(std::span<const u32> indices, usize vertex_count)
+{
+    ENG_ASSERT(indices.size() % 3 == 0);
+    std::vector<std::byte> encoded(meshopt_encodeIndexBufferBound(indices.size(), vertex_count));
+    encoded.resize(
+        meshopt_encodeIndexBuffer((unsigned char*)encoded.data(), encoded.size(), indices.data(), indices.size()));
+    return encoded;
+}
+
+bool decode_index_buffer(std::span<const std::byte> encoded, std::span<u32> out_indices)
+{
+    return meshopt_decodeIndexBuffer(out_indices.data(), out_indices.size(), sizeof(u32),
+                                     (const unsigned char*)encoded.data(), encoded.size()) == 0;
+}
+
+} // namespace compression
+} // namespace eng
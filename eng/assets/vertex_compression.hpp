@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <eng/common/types.hpp>
+
+namespace eng
+{
+namespace compression
+{
+
+/*
+    Quantized vertex streams of meshletized geometry. Positions are float3, attributes are
+    normal (3), tangent (4) and uv (2) floats, the same as in renderer's vertex buffers.
+    Positions become 16 bit unorm inside the aabb of the geometry, normals and tangents are
+    octahedral snorm16 and uvs are half floats.
+*/
+struct QuantizedPosition
+{
+    u16 x, y, z;
+    u16 pad; // vertex codec needs sizes divisible by 4
+};
+
+struct QuantizedAttribute
+{
+    i16 normal[2];
+    i16 tangent[2];
+    u16 uv[2];
+    i16 tangent_sign;
+    u16 pad;
+};
+
+void quantize_positions(std::span<const float> positions, glm::vec3 aabb_min, glm::vec3 aabb_max,
+                        std::span<QuantizedPosition> out_positions);
+void dequantize_positions(std::span<const QuantizedPosition> positions, glm::vec3 aabb_min, glm::vec3 aabb_max,
+                          std::span<float> out_positions);
+void quantize_attributes(std::span<const float> attributes, std::span<QuantizedAttribute> out_attributes);
+void dequantize_attributes(std::span<const QuantizedAttribute> attributes, std::span<float> out_attributes);
+
+// Lossless meshoptimizer codecs. vertex_size must be divisible by 4 and at most 256 bytes.
+std::vector<std::byte> encode_vertex_buffer(std::span<const std::byte> vertices, usize vertex_size);
+bool decode_vertex_buffer(std::span<const std::byte> encoded, usize vertex_size, std::span<std::byte> out_vertices);
+// Triangle list; vertex_count is only used for sizing the output. Decoded triangles keep their order and winding,
+// but their vertices may be rotated.
+std::vector<std::byte> encode_index_buffer(std::span<const u32> indices, usize vertex_count);
+bool decode_index_buffer(std::span<const std::byte> encoded, std::span<u32> out_indices);
+
+} // namespace compression
+} // namespace eng
@@ -3,6 +3,7 @@
 #include <bit>
 #include <array>
 #include <type_traits>
+#include <cstring>
 #include <eng/common/scalar_types.hpp>
 
 namespace eng
@@ -70,6 +71,144 @@ template <typename... Args> inline constexpr u64 fnv1a_list(const auto&... args)
     return hash;
 }
 
+inline constexpr u64 XXH64_PRIME1 = 0x9e3779b185ebca87ull;
+inline constexpr u64 XXH64_PRIME2 = 0xc2b2ae3d27d4eb4full;
+inline constexpr u64 XXH64_PRIME3 = 0x165667b19e3779f9ull;
+inline constexpr u64 XXH64_PRIME4 = 0x85ebca77c2b2ae63ull;
+inline constexpr u64 XXH64_PRIME5 = 0x27d4eb2f165667c5ull;
+
+inline u64 xxh64_read64(const u8* bytes)
+{
+    u64 v;
+    std::memcpy(&v, bytes, sizeof(v));
+    return v;
+}
+
+inline u32 xxh64_read32(const u8* bytes)
+{
+    u32 v;
+    std::memcpy(&v, bytes, sizeof(v));
+    return v;
+}
+
+inline u64 xxh64_round(u64 acc, u64 input)
+{
+    acc += input * XXH64_PRIME2;
+    return std::rotl(acc, 31) * XXH64_PRIME1;
+}
+
+inline u64 xxh64_merge_round(u64 acc, u64 val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+// Mixes in the last, less than 32 bytes, and the length.
+inline u64 xxh64_finalize(u64 hash, u64 total_size, const u8* p, const u8* const end)
+{
+    hash += total_size;
+    for(; p + 8 <= end; p += 8)
+    {
+        hash ^= xxh64_round(0, xxh64_read64(p));
+        hash = std::rotl(hash, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    }
+    if(p + 4 <= end)
+    {
+        hash ^= (u64)xxh64_read32(p) * XXH64_PRIME1;
+        hash = std::rotl(hash, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        p += 4;
+    }
+    for(; p < end; ++p)
+    {
+        hash ^= (u64)*p * XXH64_PRIME5;
+        hash = std::rotl(hash, 11) * XXH64_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH64_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// XXH64 of bytes given in any number of parts; the result is the same as of xxh64 of all of them at once.
+// For hashing things that don't fit in memory, like files read through a fixed buffer.
+class Xxh64Stream
+{
+  public:
+    explicit Xxh64Stream(u64 seed = 0)
+        : m_acc{ seed + XXH64_PRIME1 + XXH64_PRIME2, seed + XXH64_PRIME2, seed, seed - XXH64_PRIME1 }, m_seed(seed)
+    {
+    }
+
+    void update(const void* data, usize size)
+    {
+        const auto* p = static_cast<const u8*>(data);
+        const auto* const end = p + size;
+        m_total_size += size;
+        if(m_buffer_size + size < 32)
+        {
+            std::memcpy(m_buffer + m_buffer_size, p, size);
+            m_buffer_size += (u32)size;
+            return;
+        }
+        if(m_buffer_size > 0)
+        {
+            const auto n_fill = 32 - m_buffer_size;
+            std::memcpy(m_buffer + m_buffer_size, p, n_fill);
+            consume_stripe(m_buffer);
+            p += n_fill;
+            m_buffer_size = 0;
+        }
+        for(; p + 32 <= end; p += 32)
+        {
+            consume_stripe(p);
+        }
+        m_buffer_size = (u32)(end - p);
+        std::memcpy(m_buffer, p, m_buffer_size);
+    }
+
+    u64 digest() const
+    {
+        u64 hash;
+        if(m_total_size >= 32)
+        {
+            hash = std::rotl(m_acc[0], 1) + std::rotl(m_acc[1], 7) + std::rotl(m_acc[2], 12) + std::rotl(m_acc[3], 18);
+            for(const auto acc : m_acc)
+            {
+                hash = xxh64_merge_round(hash, acc);
+            }
+        }
+        else { hash = m_seed + XXH64_PRIME5; }
+        return xxh64_finalize(hash, m_total_size, m_buffer, m_buffer + m_buffer_size);
+    }
+
+  private:
+    void consume_stripe(const u8* p)
+    {
+        for(auto i = 0u; i < 4; ++i)
+        {
+            m_acc[i] = xxh64_round(m_acc[i], xxh64_read64(p + i * 8));
+        }
+    }
+
+    u64 m_acc[4];
+    u64 m_seed{};
+    u64 m_total_size{};
+    u8 m_buffer[32]{};
+    u32 m_buffer_size{};
+};
+
+// XXH64 checksum of bytes. Unlike fnv1a, which goes byte by byte, it runs at memory speed, so it's meant for
+// checksumming big blobs like cached assets. Little-endian only, like the rest of the serialization.
+inline u64 xxh64(const void* data, usize size, u64 seed = 0)
+{
+    Xxh64Stream stream{ seed };
+    stream.update(data, size);
+    return stream.digest();
+}
+
 struct PairHash
 {
     template <typename T1, typename T2> constexpr usize operator()(const std::pair<T1, T2>& p) const
@@ -1,10 +1,22 @@
 #include "fs.hpp"
+#include "pack.hpp"
 
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <eng/common/logger.hpp>
 
 #ifdef ENG_PLATFORM_WIN32
 #include <WinBase.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 static int open_mode_to_ios(eng::fs::OpenMode mode)
@@ -137,6 +149,136 @@ struct Win32DirChangeHandle
     u32 m_buffer[sizeof(FILE_NOTIFY_INFORMATION) * 128 / sizeof(u32)]{};
     std::jthread m_wait_thread;
 };
+using DirChangeHandle = Win32DirChangeHandle;
+#else
+struct InotifyDirChangeHandle
+{
+    // events which arrive within this long of each other are pushed together, e.g. editors saving through
+    // a temporary file, or a tool writing many files at once
+    inline static constexpr int COALESCE_MS = 50;
+    inline static constexpr u32 FILE_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;
+    inline static constexpr u32 DIR_EVENTS = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+
+    InotifyDirChangeHandle(const fs::Path& virtual_path, const fs::Path& physical_path, fs::DirectoryListener* listener)
+        : m_virtual_path(virtual_path), m_physical_path(physical_path), m_listener(listener)
+    {
+    }
+    ~InotifyDirChangeHandle() { close(); }
+
+    void start()
+    {
+        m_notification = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(m_notification < 0)
+        {
+            ENG_WARN("[INOTIFY] Failed to attach on_dir_change notification to {}", m_physical_path.string());
+            return;
+        }
+        m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(m_event < 0)
+        {
+            ENG_WARN("[INOTIFY] Failed to create on_dir_change listener for {}", m_physical_path.string());
+            close();
+            return;
+        }
+
+        // inotify isn't recursive, so every directory is watched on its own
+        add_watches(fs::Path{});
+
+        m_wait_thread = std::jthread{ [this](std::stop_token stop_token) {
+            std::vector<fs::Path> paths;
+            while(!stop_token.stop_requested())
+            {
+                // blocks until something happens, then keeps collecting until it quiets down
+                pollfd fds[2]{ { m_notification, POLLIN, 0 }, { m_event, POLLIN, 0 } };
+                auto timeout = paths.empty() ? -1 : COALESCE_MS;
+                const auto poll_res = poll(fds, 2, timeout);
+                if(stop_token.stop_requested() || (fds[1].revents & POLLIN)) { break; }
+                if(poll_res < 0) { continue; }
+                if(poll_res == 0)
+                {
+                    m_listener->push_paths(paths);
+                    paths.clear();
+                    continue;
+                }
+                read_events(paths);
+            }
+        } };
+    }
+
+    void close()
+    {
+        if(m_notification < 0) { return; }
+        if(m_event >= 0)
+        {
+            const u64 one = 1;
+            [[maybe_unused]] const auto ret = ::write(m_event, &one, sizeof(one));
+        }
+        if(m_wait_thread.joinable())
+        {
+            m_wait_thread.request_stop();
+            m_wait_thread.join();
+        }
+        if(m_event >= 0) { ::close(m_event); }
+        ::close(m_notification);
+        m_notification = -1;
+        m_event = -1;
+        m_watches.clear();
+    }
+
+    // dir is relative to the physical path
+    void add_watches(const fs::Path& dir)
+    {
+        const auto wd = inotify_add_watch(m_notification, (m_physical_path / dir).c_str(), FILE_EVENTS | DIR_EVENTS);
+        if(wd < 0)
+        {
+            ENG_WARN("[INOTIFY] Failed to watch directory {}", (m_physical_path / dir).string());
+            return;
+        }
+        m_watches[wd] = dir;
+        std::error_code ec;
+        for(const auto& it : std::filesystem::directory_iterator{ m_physical_path / dir, ec })
+        {
+            if(it.is_directory(ec) && !it.is_symlink(ec)) { add_watches(dir / it.path().filename()); }
+        }
+    }
+
+    void read_events(std::vector<fs::Path>& paths)
+    {
+        while(true)
+        {
+            const auto rec_bytes = ::read(m_notification, m_buffer, sizeof(m_buffer));
+            if(rec_bytes <= 0) { break; }
+            inotify_event info{};
+            for(auto offset = 0ll; offset < rec_bytes; offset += sizeof(inotify_event) + info.len)
+            {
+                auto* file_info = (char*)m_buffer + offset;
+                memcpy(&info, file_info, sizeof(inotify_event));
+                if(info.mask & IN_Q_OVERFLOW) { ENG_WARN("[INOTIFY] Events of {} overflowed", m_physical_path.string()); }
+                if(info.mask & IN_IGNORED) { m_watches.erase(info.wd); }
+                const auto it = m_watches.find(info.wd);
+                if(info.len == 0 || it == m_watches.end()) { continue; }
+                const auto filename = fs::Path{ file_info + offsetof(inotify_event, name) };
+                if(info.mask & IN_ISDIR)
+                {
+                    // files created in it before the watch is added are missed
+                    if(info.mask & (IN_CREATE | IN_MOVED_TO)) { add_watches(it->second / filename); }
+                    continue;
+                }
+                if(info.mask & FILE_EVENTS) { paths.push_back((m_virtual_path / it->second / filename).generic_string()); }
+            }
+        }
+    }
+
+    fs::Path m_virtual_path;
+    fs::Path m_physical_path;
+    int m_notification{ -1 };
+    int m_event{ -1 }; // signalled to wake up the thread on close
+    fs::DirectoryListener* m_listener;
+    std::unordered_map<int, fs::Path> m_watches; // watch descriptor to its directory, relative to m_physical_path
+    alignas(inotify_event) char m_buffer[(sizeof(inotify_event) + NAME_MAX + 1) * 64]{};
+    std::jthread m_wait_thread;
+};
+using DirChangeHandle = InotifyDirChangeHandle;
 #endif
 
 namespace fs
@@ -144,7 +286,7 @@ namespace fs
 
 bool File::open(const fs::Path& path, OpenMode mode)
 {
-    ENG_ASSERT(!m_file.is_open());
+    ENG_ASSERT(!is_open());
     m_path = path;
     m_mode = mode;
     m_file = std::fstream{ path.c_str(), open_mode_to_ios(mode) };
@@ -152,6 +294,19 @@ bool File::open(const fs::Path& path, OpenMode mode)
     return is_open();
 }
 
+bool File::open(const fs::Path& path, std::span<const std::byte> bytes, std::shared_ptr<const void> owner)
+{
+    ENG_ASSERT(!is_open());
+    m_path = path;
+    m_mode = OpenMode::TRY_READ_BYTES_BEG;
+    m_in_memory = true;
+    m_memory = bytes;
+    m_memory_owner = std::move(owner);
+    m_memory_head = 0;
+    m_size = bytes.size();
+    return true;
+}
+
 bool File::reopen()
 {
     ENG_ASSERT(!m_path.empty() && m_mode != OpenMode::DONT_OPEN);
@@ -160,7 +315,11 @@ bool File::reopen()
 
 void File::close()
 {
-    if(is_open()) { m_file.close(); }
+    if(m_file.is_open()) { m_file.close(); }
+    m_in_memory = false;
+    m_memory = {};
+    m_memory_owner.reset();
+    m_memory_head = 0;
     // m_path = fs::Path{};
     // m_mode = OpenMode::DONT_OPEN;
     m_hash = 0;
@@ -183,7 +342,13 @@ void File::read(std::byte* dst_bytes, usize dst_size, usize& out_read_bytes, usi
     }
     if(src_offset != ~0ull) { set_read_head(src_offset); }
     src_offset = get_read_head();
-    out_read_bytes = std::min(dst_size, m_size - src_offset);
+    out_read_bytes = std::min(dst_size, m_size - std::min(src_offset, m_size));
+    if(m_in_memory)
+    {
+        std::memcpy(dst_bytes, m_memory.data() + src_offset, out_read_bytes);
+        m_memory_head += out_read_bytes;
+        return;
+    }
     m_file.read((char*)dst_bytes, out_read_bytes);
     out_read_bytes = m_file.gcount();
 }
@@ -202,16 +367,30 @@ bool File::get_line(std::string& dst_str, usize src_offset)
 {
     dst_str.clear();
     if(!is_read() || !is_open()) { return false; }
+    if(m_in_memory)
+    {
+        if(m_memory_head >= m_size) { return false; }
+        const auto* begin = (const char*)m_memory.data() + m_memory_head;
+        const auto line = std::string_view{ begin, m_size - m_memory_head };
+        const auto end = std::min(line.find('\n'), line.size());
+        dst_str.assign(line.substr(0, end));
+        m_memory_head += std::min(end + 1, line.size());
+        return true;
+    }
     return (bool)std::getline(m_file, dst_str);
 }
 
 void File::write(const std::byte* src_bytes, usize src_size, usize& out_write_bytes, usize dst_offset)
 {
     out_write_bytes = 0;
-    if(!src_bytes || src_size == 0) { return; }
+    if(!src_bytes || src_size == 0 || m_in_memory) { return; }
     if(dst_offset != ~0ull) { set_write_head(dst_offset); }
     m_file.write((const char*)src_bytes, src_size);
-    if(m_file.good()) { out_write_bytes = src_size; }
+    if(m_file.good())
+    {
+        out_write_bytes = src_size;
+        m_size = std::max(m_size, get_write_head());
+    }
 }
 
 u64 File::get_hash()
@@ -219,22 +398,489 @@ u64 File::get_hash()
     if(m_hash != 0) { return m_hash; }
     if(is_read() && is_open())
     {
-        std::string str;
-        read(str);
+        // hashed through a fixed buffer, so big files aren't read into memory whole
+        std::vector<std::byte> buf(HASH_BUFFER_SIZE);
+        hash::Xxh64Stream stream;
+        usize n_bytes_read = 0;
+        for(usize offset = 0; offset < m_size; offset += n_bytes_read)
+        {
+            read(buf.data(), buf.size(), n_bytes_read, offset);
+            if(n_bytes_read == 0) { break; }
+            stream.update(buf.data(), n_bytes_read);
+        }
         set_read_head(0);
-        m_hash = ENG_HASH(str);
+        m_hash = stream.digest();
     }
     return m_hash;
 }
 
+bool MappedFile::map(const fs::Path& path)
+{
+    unmap();
+    std::error_code ec;
+    const auto size = (usize)std::filesystem::file_size(path, ec);
+    if(ec || size == 0) { return false; }
+
+#ifdef ENG_PLATFORM_WIN32
+    // shared for writes, as containers are written through their File while mapped
+    const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        ENG_WARN("[WIN32] Failed to open {} for mapping", path.string());
+        return false;
+    }
+    // the mapping object keeps the file open on its own
+    const auto mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(!mapping)
+    {
+        ENG_WARN("[WIN32] Failed to create mapping of {}", path.string());
+        return false;
+    }
+    const auto* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    if(!data)
+    {
+        ENG_WARN("[WIN32] Failed to map view of {}", path.string());
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+#else
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        ENG_WARN("Failed to open {} for mapping", path.string());
+        return false;
+    }
+    // the mapping keeps its own reference to the file
+    const auto* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+    {
+        ENG_WARN("Failed to map {}", path.string());
+        return false;
+    }
+#endif
+    m_data = (const std::byte*)data;
+    m_size = size;
+    return true;
+}
+
+bool MappedFile::view(std::span<const std::byte> bytes, std::shared_ptr<const void> owner)
+{
+    unmap();
+    if(bytes.empty()) { return false; }
+    m_data = bytes.data();
+    m_size = bytes.size();
+    m_owner = std::move(owner);
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if(!m_data) { return; }
+    if(m_owner)
+    {
+        m_owner.reset();
+        m_data = nullptr;
+        m_size = 0;
+        return;
+    }
+#ifdef ENG_PLATFORM_WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+#else
+    ::munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+}
+
+#ifdef ENG_PLATFORM_WIN32
+struct IoRing
+{
+};
+#else
+static int io_uring_enter(int ring_fd, u32 to_submit, u32 min_complete, u32 flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+// io_uring came in 5.1, but reads only in 5.6, together with probing; without them every read would fail
+static bool io_uring_supports_read(int ring_fd)
+{
+    constexpr u32 N_OPS = 256;
+    std::vector<std::byte> buf(sizeof(io_uring_probe) + N_OPS * sizeof(io_uring_probe_op));
+    auto* probe = (io_uring_probe*)buf.data();
+    if(syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, N_OPS) < 0) { return false; }
+    return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+}
+
+struct IoRing
+{
+    struct InFlightRead
+    {
+        AsyncRead read;
+        int fd{ -1 };
+        usize n_bytes_read{};
+    };
+
+    ~IoRing()
+    {
+        if(leaked) { return; }
+        if(sqes) { munmap(sqes, sqes_size); }
+        if(cq_ptr && cq_ptr != sq_ptr) { munmap(cq_ptr, cq_size); }
+        if(sq_ptr) { munmap(sq_ptr, sq_size); }
+        if(ring_fd >= 0) { ::close(ring_fd); }
+    }
+
+    bool init(u32 queue_depth)
+    {
+        io_uring_params params{};
+        ring_fd = (int)syscall(__NR_io_uring_setup, queue_depth, &params);
+        if(ring_fd < 0) { return false; }
+        if(!io_uring_supports_read(ring_fd))
+        {
+            errno = EOPNOTSUPP;
+            return false;
+        }
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        // newer kernels map both rings at once
+        if(params.features & IORING_FEAT_SINGLE_MMAP) { sq_size = cq_size = std::max(sq_size, cq_size); }
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if(sq_ptr == MAP_FAILED)
+        {
+            sq_ptr = nullptr;
+            return false;
+        }
+        if(params.features & IORING_FEAT_SINGLE_MMAP) { cq_ptr = sq_ptr; }
+        else
+        {
+            cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if(cq_ptr == MAP_FAILED)
+            {
+                cq_ptr = nullptr;
+                return false;
+            }
+        }
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if(sqes == MAP_FAILED)
+        {
+            sqes = nullptr;
+            return false;
+        }
+
+        auto* sq = (std::byte*)sq_ptr;
+        auto* cq = (std::byte*)cq_ptr;
+        sq_tail = (u32*)(sq + params.sq_off.tail);
+        sq_mask = *(u32*)(sq + params.sq_off.ring_mask);
+        sq_array = (u32*)(sq + params.sq_off.array);
+        cq_head = (u32*)(cq + params.cq_off.head);
+        cq_tail = (u32*)(cq + params.cq_off.tail);
+        cq_mask = *(u32*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        // the completion queue is twice as big, so it can't overflow with at most this many in flight
+        max_in_flight = params.sq_entries;
+
+        completion_thread = std::jthread{ [this] { complete_reads(); } };
+        return true;
+    }
+
+    // Queues the rest of the read; submitted with the next flush. Has to be called with the mutex locked.
+    void push(InFlightRead* ifr)
+    {
+        const auto tail = std::atomic_ref{ *sq_tail }.load(std::memory_order_relaxed);
+        const auto index = tail & sq_mask;
+        auto& sqe = sqes[index];
+        sqe = io_uring_sqe{};
+        sqe.user_data = (u64)ifr;
+        if(ifr)
+        {
+            const auto remaining = ifr->read.dst.subspan(ifr->n_bytes_read);
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = ifr->fd;
+            sqe.off = ifr->read.offset + ifr->n_bytes_read;
+            sqe.addr = (u64)remaining.data();
+            sqe.len = (u32)std::min(remaining.size(), (usize)std::numeric_limits<i32>::max());
+        }
+        else { sqe.opcode = IORING_OP_NOP; } // wakes up the completion thread to stop it
+        sq_array[index] = index;
+        std::atomic_ref{ *sq_tail }.store(tail + 1, std::memory_order_release);
+        ++n_pending;
+    }
+
+    // Has to be called with the mutex locked. Returns reads which couldn't be submitted, taken back out of the queue;
+    // they have to be failed with the mutex unlocked, see complete.
+    [[nodiscard]] std::vector<InFlightRead*> flush()
+    {
+        while(n_pending > 0)
+        {
+            const auto ret = io_uring_enter(ring_fd, n_pending, 0, 0);
+            if(ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                ENG_WARN("[IO_URING] Failed to submit {} reads ({})", n_pending, errno);
+                // the kernel took none of them, so they are simply dropped from the tail
+                const auto tail = std::atomic_ref{ *sq_tail }.load(std::memory_order_relaxed) - n_pending;
+                std::vector<InFlightRead*> failed;
+                for(auto i = 0u; i < n_pending; ++i)
+                {
+                    auto* ifr = (InFlightRead*)sqes[(tail + i) & sq_mask].user_data;
+                    if(ifr) { failed.push_back(ifr); }
+                }
+                std::atomic_ref{ *sq_tail }.store(tail, std::memory_order_release);
+                n_pending = 0;
+                return failed;
+            }
+            if(ret > 0) { n_pending -= (u32)ret; }
+        }
+        return {};
+    }
+
+    // Calls the callback, and lets the next read in. Has to be called with the mutex unlocked, as callbacks may
+    // submit more reads.
+    void complete(InFlightRead* ifr, bool success)
+    {
+        ::close(ifr->fd);
+        if(ifr->read.on_complete) { ifr->read.on_complete(ifr->read, ifr->n_bytes_read, success); }
+        delete ifr;
+        std::vector<InFlightRead*> failed;
+        {
+            std::scoped_lock lock{ mutex };
+            --n_in_flight;
+            if(!deferred.empty())
+            {
+                ++n_in_flight;
+                push(deferred.front());
+                deferred.pop_front();
+                failed = flush();
+            }
+        }
+        cv.notify_all();
+        for(auto* f : failed)
+        {
+            complete(f, false);
+        }
+    }
+
+    void submit(std::span<const AsyncRead> reads)
+    {
+        std::unique_lock lock{ mutex };
+        std::vector<InFlightRead*> failed;
+        const auto fail = [&lock, &failed, this] {
+            lock.unlock();
+            for(auto* ifr : failed)
+            {
+                complete(ifr, false);
+            }
+            failed.clear();
+            lock.lock();
+        };
+        for(const auto& read : reads)
+        {
+            const auto fd = ::open(read.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+            {
+                lock.unlock();
+                if(read.on_complete) { read.on_complete(read, 0, false); }
+                lock.lock();
+                continue;
+            }
+            // callbacks submitting more reads run on the completion thread, which would wait for itself; their reads
+            // go in as other reads complete
+            if(std::this_thread::get_id() == completion_thread.get_id() && (n_in_flight == max_in_flight || !deferred.empty()))
+            {
+                deferred.push_back(new InFlightRead{ read, fd });
+                continue;
+            }
+            if(n_in_flight == max_in_flight)
+            {
+                failed = flush();
+                if(!failed.empty()) { fail(); }
+                cv.wait(lock, [this] { return n_in_flight < max_in_flight; });
+            }
+            ++n_in_flight;
+            push(new InFlightRead{ read, fd });
+        }
+        failed = flush();
+        if(!failed.empty()) { fail(); }
+    }
+
+    void complete_reads()
+    {
+        std::vector<io_uring_cqe> completed;
+        while(true)
+        {
+            io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+            auto head = std::atomic_ref{ *cq_head }.load(std::memory_order_relaxed);
+            const auto tail = std::atomic_ref{ *cq_tail }.load(std::memory_order_acquire);
+            completed.clear();
+            for(; head != tail; ++head)
+            {
+                completed.push_back(cqes[head & cq_mask]);
+            }
+            std::atomic_ref{ *cq_head }.store(head, std::memory_order_release);
+
+            for(const auto& cqe : completed)
+            {
+                auto* ifr = (InFlightRead*)cqe.user_data;
+                if(!ifr) { return; }
+                if(cqe.res == -EINTR || cqe.res == -EAGAIN || (cqe.res > 0 && ifr->n_bytes_read + cqe.res < ifr->read.dst.size()))
+                {
+                    // short reads are continued, unless the file ended
+                    if(cqe.res > 0) { ifr->n_bytes_read += (usize)cqe.res; }
+                    std::vector<InFlightRead*> failed;
+                    {
+                        std::scoped_lock lock{ mutex };
+                        push(ifr);
+                        failed = flush();
+                    }
+                    for(auto* f : failed)
+                    {
+                        complete(f, false);
+                    }
+                    continue;
+                }
+                if(cqe.res > 0) { ifr->n_bytes_read += (usize)cqe.res; }
+                complete(ifr, cqe.res >= 0);
+            }
+        }
+    }
+
+    void wait_idle()
+    {
+        std::unique_lock lock{ mutex };
+        cv.wait(lock, [this] { return n_in_flight == 0 && deferred.empty(); });
+    }
+
+    void stop()
+    {
+        if(!completion_thread.joinable()) { return; }
+        wait_idle();
+        std::unique_lock lock{ mutex };
+        const auto tail = std::atomic_ref{ *sq_tail }.load(std::memory_order_relaxed);
+        push(nullptr);
+        [[maybe_unused]] const auto failed = flush(); // only the stop request was queued
+        if(std::atomic_ref{ *sq_tail }.load(std::memory_order_relaxed) == tail)
+        {
+            // the completion thread waits in the kernel for good, so it's left there, with the ring it still uses
+            ENG_WARN("[IO_URING] Could not stop the completion thread");
+            completion_thread.detach();
+            leaked = true;
+            return;
+        }
+        lock.unlock();
+        completion_thread.join();
+    }
+
+    int ring_fd{ -1 };
+    void* sq_ptr{};
+    usize sq_size{};
+    void* cq_ptr{};
+    usize cq_size{};
+    io_uring_sqe* sqes{};
+    usize sqes_size{};
+    u32* sq_tail{};
+    u32 sq_mask{};
+    u32* sq_array{};
+    u32* cq_head{};
+    u32* cq_tail{};
+    u32 cq_mask{};
+    io_uring_cqe* cqes{};
+
+    std::mutex mutex; // of the submission queue, n_in_flight and deferred
+    std::condition_variable cv;
+    u32 max_in_flight{};
+    u32 n_in_flight{};
+    u32 n_pending{}; // queued, but not yet submitted
+    std::deque<InFlightRead*> deferred; // submitted by callbacks while the queue was full
+    std::jthread completion_thread;
+    bool leaked{}; // the completion thread couldn't be stopped and still uses the ring
+};
+#endif
+
+AsyncIO::AsyncIO() = default;
+
+AsyncIO::~AsyncIO() { shutdown(); }
+
+void AsyncIO::init(u32 queue_depth)
+{
+    shutdown();
+#ifndef ENG_PLATFORM_WIN32
+    auto ring = std::make_unique<IoRing>();
+    if(ring->init(queue_depth)) { m_ring = std::move(ring); }
+    else { ENG_WARN("[IO_URING] Not available ({}); reads will be synchronous", errno); }
+#endif
+}
+
+void AsyncIO::shutdown()
+{
+#ifndef ENG_PLATFORM_WIN32
+    if(m_ring) { m_ring->stop(); }
+#endif
+    m_ring.reset();
+}
+
+void AsyncIO::submit(std::span<const AsyncRead> reads)
+{
+#ifndef ENG_PLATFORM_WIN32
+    if(m_ring)
+    {
+        m_ring->submit(reads);
+        return;
+    }
+#endif
+    for(const auto& read : reads)
+    {
+        File file;
+        usize n_bytes_read = 0;
+        const auto success = file.open(read.path, OpenMode::TRY_READ_BYTES_BEG);
+        if(success && read.offset < file.get_size()) { file.read(read.dst.data(), read.dst.size(), n_bytes_read, read.offset); }
+        if(read.on_complete) { read.on_complete(read, n_bytes_read, success); }
+    }
+}
+
+void AsyncIO::wait_idle()
+{
+#ifndef ENG_PLATFORM_WIN32
+    if(m_ring) { m_ring->wait_idle(); }
+#endif
+}
+
 bool FileSystem::init()
 {
+    m_async_io.init();
     s_root_dir_path = "../";
     const auto has_assets_dir = file_exists(make_rel_path("/assets"));
     if(!has_assets_dir) { ENG_ERROR("assets folder missing in cwd directory."); }
+
+    std::vector<Path> pack_paths;
+    std::error_code ec;
+    for(const auto& it : std::filesystem::directory_iterator{ make_rel_path("/assets"), ec })
+    {
+        if(it.is_regular_file() && it.path().extension() == ".engp") { pack_paths.push_back(it.path()); }
+    }
+    std::sort(pack_paths.begin(), pack_paths.end());
+    for(const auto& p : pack_paths)
+    {
+        mount(p);
+    }
     return has_assets_dir;
 }
 
+bool FileSystem::mount(const Path& pack_path)
+{
+    auto pack = std::make_shared<engp::PackFile>();
+    if(!pack->mount(pack_path)) { return false; }
+    m_mounts.push_back(std::move(pack));
+    ENG_LOG("Mounted pack archive {}", pack_path.string());
+    return true;
+}
+
 FilePtr FileSystem::open_file(const Path& path, OpenMode mode)
 {
     auto rel_path = make_rel_path(path);
@@ -242,6 +888,23 @@ FilePtr FileSystem::open_file(const Path& path, OpenMode mode)
                                           ptr->close();
                                           delete ptr;
                                       } };
+    // files in archives can't be written, so only reads go to them
+    if(mode == OpenMode::TRY_READ_BYTES_BEG && !m_mounts.empty() && path.string().starts_with("/"))
+    {
+        const auto path_hash = engp::make_path_hash(path);
+        for(const auto& pack : m_mounts | std::views::reverse)
+        {
+            const auto* entry = pack->find(path_hash);
+            if(!entry) { continue; }
+            std::span<const std::byte> bytes;
+            std::shared_ptr<const void> owner;
+            if(pack->get_bytes(*entry, bytes, owner))
+            {
+                file->open(rel_path, bytes, std::move(owner));
+                return file;
+            }
+        }
+    }
     file->open(rel_path, mode);
     return file;
 }
@@ -249,10 +912,38 @@ FilePtr FileSystem::open_file(const Path& path, OpenMode mode)
 void FileSystem::delete_file(const Path& path)
 {
     std::filesystem::remove(path);
-    if(file_exists(path)) { ENG_WARN("Could not remove file {}", path.string()); }
+    if(std::filesystem::exists(path)) { ENG_WARN("Could not remove file {}", path.string()); }
 }
 
-bool fs::FileSystem::file_exists(const Path& path) const { return std::filesystem::exists(path); }
+bool fs::FileSystem::file_exists(const Path& path) const
+{
+    if(path.string().starts_with("/"))
+    {
+        const auto path_hash = engp::make_path_hash(path);
+        if(std::ranges::any_of(m_mounts, [path_hash](const auto& pack) { return pack->find(path_hash) != nullptr; }))
+        {
+            return true;
+        }
+    }
+    return std::filesystem::exists(make_rel_path(path));
+}
+
+std::vector<fs::Path> fs::FileSystem::list_mounted_files(const Path& virtual_dir) const
+{
+    std::vector<Path> paths;
+    for(const auto& pack : m_mounts)
+    {
+        for(const auto& entry : pack->get_entries())
+        {
+            Path path{ pack->get_path(entry) };
+            if(path.parent_path().generic_string() == virtual_dir.generic_string()) { paths.push_back(std::move(path)); }
+        }
+    }
+    // the same file can be in many archives
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    return paths;
+}
 
 DirectoryListener* fs::FileSystem::make_listener(std::string_view virtual_path)
 {
@@ -261,7 +952,7 @@ DirectoryListener* fs::FileSystem::make_listener(std::string_view virtual_path)
     dir_listener->m_listening_path = virtual_path;
     auto physical_path = make_rel_path(virtual_path);
     physical_path = std::filesystem::absolute(physical_path);
-    auto listener_impl = new Win32DirChangeHandle{ virtual_path, physical_path, dir_listener };
+    auto listener_impl = new DirChangeHandle{ virtual_path, physical_path, dir_listener };
     dir_listener->m_impl = listener_impl;
     listener_impl->start();
     return dir_listener;
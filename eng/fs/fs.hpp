@@ -7,6 +7,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <deque>
+#include <functional>
+#include <span>
 #include <string_view>
 
 #include <eng/string/stack_string.hpp>
@@ -30,11 +32,18 @@ enum class OpenMode
 };
 
 class FileSystem;
+namespace engp
+{
+class PackFile;
+}
 
 class File
 {
   public:
     bool open(const fs::Path& path, OpenMode mode);
+    // Read-only file over bytes in memory, e.g. of a mounted pack archive. owner keeps them valid. Once closed,
+    // it reopens from path, like any other file.
+    bool open(const fs::Path& path, std::span<const std::byte> bytes, std::shared_ptr<const void> owner);
     bool reopen();
     void close();
     void flush();
@@ -45,12 +54,16 @@ class File
     bool get_line(std::string& dst_str, usize src_offset = ~0ull);
     void write(const std::byte* src_bytes, usize src_size, usize& out_write_bytes, usize dst_offset = ~0ull);
 
-    void set_read_head(usize pos) { m_file.seekg(pos, std::fstream::beg); }
-    usize get_read_head() { return (usize)m_file.tellg(); }
+    void set_read_head(usize pos)
+    {
+        if(m_in_memory) { m_memory_head = pos; }
+        else { m_file.seekg(pos, std::fstream::beg); }
+    }
+    usize get_read_head() { return m_in_memory ? m_memory_head : (usize)m_file.tellg(); }
     void set_write_head(usize pos) { m_file.seekp(pos, std::fstream::beg); }
     usize get_write_head() { return (usize)m_file.tellp(); }
 
-    bool is_open() const { return m_file.is_open(); }
+    bool is_open() const { return m_in_memory || m_file.is_open(); }
     bool is_read() const
     {
         return m_mode == OpenMode::TRY_READ_BYTES_BEG || m_mode == OpenMode::TRY_READ_WRITE_BYTES_BEG ||
@@ -58,24 +71,113 @@ class File
     }
     bool is_write() const
     {
-        return m_mode == OpenMode::READ_WRITE_BYTES_CREATE_DISCARD || m_mode == OpenMode::WRITE_BYTES_CREATE_DISCARD;
+        return m_mode == OpenMode::TRY_READ_WRITE_BYTES_BEG || m_mode == OpenMode::READ_WRITE_BYTES_CREATE_DISCARD ||
+               m_mode == OpenMode::WRITE_BYTES_CREATE_DISCARD;
     }
-    bool is_eof() const { return m_file.eof(); }
+    bool is_eof() const { return m_in_memory ? m_memory_head >= m_size : m_file.eof(); }
+    bool is_in_memory() const { return m_in_memory; }
+    // Bytes of an in-memory file, and what keeps them valid.
+    std::span<const std::byte> get_memory() const { return m_memory; }
+    const std::shared_ptr<const void>& get_memory_owner() const { return m_memory_owner; }
 
+    // xxh64 of the whole file. Computed once, and cached until the file is closed.
     u64 get_hash();
     usize get_size() const { return m_size; }
     const fs::Path& get_path() const { return m_path; }
 
   private:
+    inline static constexpr usize HASH_BUFFER_SIZE = 256 * 1024;
+
     OpenMode m_mode{ OpenMode::DONT_OPEN };
     fs::Path m_path;
     u64 m_hash{};
     usize m_size{};
     std::fstream m_file;
+    bool m_in_memory{};                  // read from m_memory instead of m_file
+    std::span<const std::byte> m_memory;
+    std::shared_ptr<const void> m_memory_owner;
+    usize m_memory_head{};
 };
 
 using FilePtr = std::shared_ptr<File>;
 
+// Read-only mapping of the whole file. Nothing is read up front; pages come from the page cache as they are
+// touched, so views into it cost no copies. Writes to the file through File are visible in the mapping.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { unmap(); }
+
+    // Fails for empty files, as they can't be mapped.
+    bool map(const fs::Path& path);
+    // Views bytes which are in memory already, like a file in a mounted pack archive, as if they were mapped.
+    // owner keeps them valid.
+    bool view(std::span<const std::byte> bytes, std::shared_ptr<const void> owner);
+    void unmap();
+
+    bool is_mapped() const { return m_data != nullptr; }
+    std::span<const std::byte> get_bytes() const { return { m_data, m_size }; }
+    usize get_size() const { return m_size; }
+
+  private:
+    const std::byte* m_data{};
+    usize m_size{};
+    void* m_mapping{}; // file mapping object on win32
+    std::shared_ptr<const void> m_owner; // of viewed bytes; nothing is mapped then
+};
+
+// Shared by everything viewing the mapping, so it stays mapped as long as any of them does.
+using MappedFilePtr = std::shared_ptr<const MappedFile>;
+
+struct AsyncRead
+{
+    // Called once per read, on the completion thread, or inside submit when reads are synchronous. n_bytes_read
+    // is short of dst's size only when the file ends first.
+    using Callback = std::function<void(const AsyncRead& read, usize n_bytes_read, bool success)>;
+
+    fs::Path path; // system path, the same as for FileSystem::open_file
+    u64 offset{};
+    std::span<std::byte> dst; // has to stay valid until the callback
+    Callback on_complete;
+};
+
+struct IoRing;
+
+/*
+    Batched reads with many of them in flight at once. Uses io_uring through raw syscalls, so there is no
+    dependency on liburing; completions are handled by a single thread, which calls the callbacks, so they
+    should hand off any heavy work. Without io_uring (win32, or kernels which don't have or allow it, or can't read
+    through it), reads are done synchronously in submit, and the callbacks are called before it returns. Reads which
+    couldn't be submitted complete with failure.
+*/
+class AsyncIO
+{
+  public:
+    inline static constexpr u32 DEFAULT_QUEUE_DEPTH = 128;
+
+    AsyncIO();
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+    ~AsyncIO();
+
+    void init(u32 queue_depth = DEFAULT_QUEUE_DEPTH);
+    // Waits for reads in flight.
+    void shutdown();
+
+    // Submits all reads at once. Blocks only while the queue is full; from a callback, reads over the queue depth
+    // are submitted as others complete instead.
+    void submit(std::span<const AsyncRead> reads);
+    // Blocks until every read submitted so far is completed.
+    void wait_idle();
+    bool is_async() const { return m_ring != nullptr; }
+
+  private:
+    std::unique_ptr<IoRing> m_ring;
+};
+
 class DirectoryListener
 {
   public:
@@ -109,18 +211,31 @@ class FileSystem
 
     bool init();
 
-    // Open a file with system path (relative or absolute)
+    // Mounts a pack archive over the loose files. Files in it shadow loose ones with the same virtual path, and
+    // archives mounted later shadow earlier ones. init mounts every .engp file in the assets directory, by name.
+    bool mount(const Path& pack_path);
+
+    // Open a file with system path (relative or absolute). Virtual paths opened for reading are looked up in
+    // mounted archives first.
     FilePtr open_file(const Path& path, OpenMode mode);
     // Delete file from the disk
     void delete_file(const Path& path);
-    // Checks if file exists
+    // Checks if file exists, in mounted archives too for virtual paths
     bool file_exists(const Path& path) const;
+    // Virtual paths of files in mounted archives, which are directly in the virtual directory, like '/assets'
+    std::vector<Path> list_mounted_files(const Path& virtual_dir) const;
 
-    // Create recursive listener for file changes
+    // Create recursive listener for file changes; ReadDirectoryChangesW on win32, inotify elsewhere
     DirectoryListener* make_listener(std::string_view virtual_path);
 
+    // Reads with system paths, see AsyncIO
+    void read_async(std::span<const AsyncRead> reads) { m_async_io.submit(reads); }
+
     inline static Path s_root_dir_path;
     std::deque<DirectoryListener> m_dir_listeners_vec;
+    AsyncIO m_async_io;
+    std::vector<std::shared_ptr<const engp::PackFile>> m_mounts; // from the lowest priority
+
 };
 
 } // namespace fs
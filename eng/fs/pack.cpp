@@ -0,0 +1,211 @@
+#include "pack.hpp"
+#include <algorithm>
+#include <cstring>
+#include <eng/assets/compression.hpp>
+#include <eng/common/logger.hpp>
+
+namespace eng
+{
+namespace fs
+{
+namespace engp
+{
+
+bool PackFile::mount(const fs::Path& path)
+{
+    m_path = path;
+    m_entries.clear();
+    auto mapping = std::make_shared<fs::MappedFile>();
+    if(!mapping->map(path))
+    {
+        ENG_WARN("Couldn't map pack archive {}", path.string());
+        return false;
+    }
+    const auto bytes = mapping->get_bytes();
+    if(bytes.size() < N_HEADER_BYTES || std::memcmp(bytes.data(), "engp", 4) != 0)
+    {
+        ENG_WARN("File is not a valid pack archive ({})", path.string());
+        return false;
+    }
+    if((u8)bytes[4] != VERSION)
+    {
+        ENG_WARN("Pack archive {} has unsupported version {}", path.string(), (u32)bytes[4]);
+        return false;
+    }
+
+    u32 entry_count = 0;
+    u64 directory_offset = 0;
+    std::memcpy(&entry_count, &bytes[8], sizeof(u32));
+    std::memcpy(&directory_offset, &bytes[16], sizeof(u64));
+    if(directory_offset < N_HEADER_BYTES || directory_offset + (u64)entry_count * N_ENTRY_BYTES > bytes.size())
+    {
+        ENG_WARN("Pack archive {} is corrupted (invalid directory at {})", path.string(), directory_offset);
+        return false;
+    }
+
+    m_entries.resize(entry_count);
+    for(auto i = 0u; i < entry_count; ++i)
+    {
+        const auto* src = &bytes[directory_offset + i * N_ENTRY_BYTES];
+        auto& entry = m_entries[i];
+        std::memcpy(&entry.path_hash, src, sizeof(u64));
+        std::memcpy(&entry.offset, src + 8, sizeof(u64));
+        std::memcpy(&entry.stored_size, src + 16, sizeof(u64));
+        std::memcpy(&entry.size, src + 24, sizeof(u64));
+        std::memcpy(&entry.path_offset, src + 32, sizeof(u64));
+        std::memcpy(&entry.path_size, src + 40, sizeof(u32));
+        std::memcpy(&entry.flags.flags, src + 44, sizeof(u8));
+        if(entry.offset + entry.stored_size > directory_offset || entry.path_offset + entry.path_size > directory_offset ||
+           (i > 0 && m_entries[i - 1].path_hash >= entry.path_hash))
+        {
+            ENG_WARN("Pack archive {} is corrupted (invalid entry {})", path.string(), i);
+            m_entries.clear();
+            return false;
+        }
+    }
+    m_mapping = std::move(mapping);
+    return true;
+}
+
+const Entry* PackFile::find(u64 path_hash) const
+{
+    const auto it = std::lower_bound(m_entries.begin(), m_entries.end(), path_hash,
+                                     [](const Entry& e, u64 hash) { return e.path_hash < hash; });
+    if(it == m_entries.end() || it->path_hash != path_hash) { return nullptr; }
+    return &*it;
+}
+
+std::string_view PackFile::get_path(const Entry& entry) const
+{
+    if(!m_mapping) { return {}; }
+    return { (const char*)m_mapping->get_bytes().data() + entry.path_offset, entry.path_size };
+}
+
+bool PackFile::get_bytes(const Entry& entry, std::span<const std::byte>& out_bytes, std::shared_ptr<const void>& out_owner) const
+{
+    out_bytes = {};
+    out_owner.reset();
+    if(!m_mapping) { return false; }
+    const auto stored = m_mapping->get_bytes().subspan(entry.offset, entry.stored_size);
+    if(!entry.flags.test(EntryFlags::COMPRESSED_BIT))
+    {
+        out_bytes = stored;
+        out_owner = m_mapping;
+        return true;
+    }
+
+    auto decompressed = std::make_shared<std::vector<std::byte>>(entry.size);
+    if(!compression::decompress_chunked(stored, *decompressed))
+    {
+        ENG_WARN("Failed to decompress entry {:x} of pack archive {}", entry.path_hash, m_path.string());
+        return false;
+    }
+    out_bytes = *decompressed;
+    out_owner = std::move(decompressed);
+    return true;
+}
+
+bool write_pack(const fs::Path& out_path, std::span<const PackInput> files, bool compress, u32 alignment)
+{
+    ENG_ASSERT(alignment > 0);
+    fs::File out;
+    if(!out.open(out_path, fs::OpenMode::WRITE_BYTES_CREATE_DISCARD))
+    {
+        ENG_WARN("Couldn't open {} for writing", out_path.string());
+        return false;
+    }
+
+    const auto align_up = [alignment](u64 offset) { return (offset + alignment - 1) / alignment * alignment; };
+    std::vector<Entry> entries;
+    entries.reserve(files.size());
+    std::vector<std::byte> bytes;
+    u64 offset = align_up(N_HEADER_BYTES);
+    for(const auto& input : files)
+    {
+        fs::File file;
+        usize n_bytes = 0;
+        if(!file.open(input.file_path, fs::OpenMode::TRY_READ_BYTES_BEG))
+        {
+            ENG_WARN("Couldn't open {} for packing", input.file_path.string());
+            return false;
+        }
+        bytes.resize(file.get_size());
+        file.read(bytes.data(), bytes.size(), n_bytes, 0);
+        if(n_bytes != bytes.size())
+        {
+            ENG_WARN("Couldn't read {} for packing", input.file_path.string());
+            return false;
+        }
+
+        auto& entry = entries.emplace_back(make_path_hash(input.virtual_path), offset, (u64)bytes.size(), (u64)bytes.size());
+        // only kept if it got smaller; already compressed files, like most images, are stored as they are
+        std::vector<std::byte> compressed;
+        if(compress && !bytes.empty()) { compressed = compression::compress_chunked(bytes); }
+        const auto is_compressed = !compressed.empty() && compressed.size() < bytes.size();
+        const auto stored = is_compressed ? std::span<const std::byte>{ compressed } : std::span<const std::byte>{ bytes };
+        if(is_compressed) { entry.flags.set(EntryFlags::COMPRESSED_BIT); }
+        entry.stored_size = stored.size();
+        out.write(stored.data(), stored.size(), n_bytes, offset);
+        if(n_bytes != stored.size() && !stored.empty())
+        {
+            ENG_WARN("Failed writing {} to pack archive {}", input.file_path.string(), out_path.string());
+            return false;
+        }
+        offset = align_up(offset + stored.size());
+    }
+
+    // paths go right after the last entry, in the order of the inputs
+    std::string paths;
+    for(auto i = 0u; i < files.size(); ++i)
+    {
+        const auto path = files[i].virtual_path.generic_string();
+        entries[i].path_offset = offset + paths.size();
+        entries[i].path_size = (u32)path.size();
+        paths += path;
+    }
+    usize n_bytes = 0;
+    out.write((const std::byte*)paths.data(), paths.size(), n_bytes, offset);
+    if(n_bytes != paths.size() && !paths.empty()) { return false; }
+    offset += paths.size();
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path_hash < b.path_hash; });
+    for(auto i = 1u; i < entries.size(); ++i)
+    {
+        if(entries[i - 1].path_hash == entries[i].path_hash)
+        {
+            ENG_WARN("Two files packed into {} have the same path hash {:x}", out_path.string(), entries[i].path_hash);
+            return false;
+        }
+    }
+
+    std::vector<std::byte> directory(entries.size() * N_ENTRY_BYTES);
+    for(auto i = 0u; i < entries.size(); ++i)
+    {
+        auto* dst = &directory[i * N_ENTRY_BYTES];
+        std::memcpy(dst, &entries[i].path_hash, sizeof(u64));
+        std::memcpy(dst + 8, &entries[i].offset, sizeof(u64));
+        std::memcpy(dst + 16, &entries[i].stored_size, sizeof(u64));
+        std::memcpy(dst + 24, &entries[i].size, sizeof(u64));
+        std::memcpy(dst + 32, &entries[i].path_offset, sizeof(u64));
+        std::memcpy(dst + 40, &entries[i].path_size, sizeof(u32));
+        std::memcpy(dst + 44, &entries[i].flags.flags, sizeof(u8));
+    }
+    out.write(directory.data(), directory.size(), n_bytes, offset);
+    if(n_bytes != directory.size() && !directory.empty()) { return false; }
+
+    // written last, so a failed write doesn't leave a valid looking archive behind
+    std::byte header[N_HEADER_BYTES]{};
+    const auto entry_count = (u32)entries.size();
+    std::memcpy(header, "engp", 4);
+    header[4] = (std::byte)VERSION;
+    std::memcpy(&header[8], &entry_count, sizeof(u32));
+    std::memcpy(&header[12], &alignment, sizeof(u32));
+    std::memcpy(&header[16], &offset, sizeof(u64));
+    out.write(header, N_HEADER_BYTES, n_bytes, 0);
+    out.flush();
+    return n_bytes == N_HEADER_BYTES;
+}
+
+} // namespace engp
+} // namespace fs
+} // namespace eng
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <eng/common/flags.hpp>
+#include <eng/common/types.hpp>
+#include <eng/fs/fs.hpp>
+
+namespace eng
+{
+namespace fs
+{
+
+// clang-format off
+/*
+.engp pack archive format
+
+- 2026.10.18 (version 0)
+Many files in one archive, so shipping them costs a single open. Entries are found by hash of their virtual path
+in a directory sorted by it, and start at multiples of the alignment, so they can be viewed in a mapping of the
+archive as they are. Entries which got smaller are stored chunk-compressed, see compression::compress_chunked.
+Entries store their virtual paths too, so files in mounted archives can be listed, e.g. engb containers.
+{
+	4B magic number 'engp',
+	1B version,
+	3B Padding,
+	4B entry count,
+	4B alignment of entries,
+	8B Absolute offset to the directory,
+	[ entry bytes ]...,					- every entry padded to the alignment
+	[ virtual paths ]...,				- without terminators
+	[
+		{
+			8B path hash				- of the virtual path, like '/assets/shaders/common.hlsli'
+			8B offset					- absolute offset of the entry bytes
+			8B stored size				- size of the entry bytes in the archive
+			8B size						- size of the file, after decompressing it
+			8B path offset				- absolute offset of the virtual path
+			4B path size
+			1B flags
+			3B Padding
+		} : ENTRY
+	] : DIRECTORY,						- sorted by path hash
+} : .ENGP ARCHIVE SPEC
+*/
+// clang-format on
+namespace engp
+{
+
+inline static constexpr u8 VERSION = 0;
+inline static constexpr usize N_HEADER_BYTES = 4 + 1 + 3 + 4 + 4 + 8;
+inline static constexpr usize N_ENTRY_BYTES = 5 * 8 + 4 + 1 + 3;
+inline static constexpr u32 DEFAULT_ALIGNMENT = 4096;
+
+enum class EntryFlags : u8
+{
+    COMPRESSED_BIT = 1 << 0,
+};
+ENG_ENABLE_FLAGS_OPERATORS(EntryFlags);
+
+struct Entry
+{
+    u64 path_hash{};
+    u64 offset{};
+    u64 stored_size{};
+    u64 size{};
+    u64 path_offset{};
+    u32 path_size{};
+    Flags<EntryFlags> flags{};
+};
+
+// Key of files in archives; virtual paths are hashed as given, e.g. '/assets/textures/brick.png'.
+inline u64 make_path_hash(const fs::Path& virtual_path) { return ENG_HASH(virtual_path.generic_string()); }
+
+// Mounted archive. It's read through a mapping, so opening a file in it costs a binary search, and uncompressed
+// files are never copied.
+class PackFile
+{
+  public:
+    bool mount(const fs::Path& path);
+
+    const Entry* find(u64 path_hash) const;
+    // Views the entry in the mapping, or decompresses it. out_owner keeps out_bytes valid.
+    bool get_bytes(const Entry& entry, std::span<const std::byte>& out_bytes, std::shared_ptr<const void>& out_owner) const;
+    // Virtual path of the entry, viewed in the mapping.
+    std::string_view get_path(const Entry& entry) const;
+    std::span<const Entry> get_entries() const { return m_entries; }
+    const fs::Path& get_path() const { return m_path; }
+
+  private:
+    fs::Path m_path;
+    fs::MappedFilePtr m_mapping;
+    std::vector<Entry> m_entries; // sorted by path hash
+};
+
+using PackFilePtr = std::shared_ptr<const PackFile>;
+
+struct PackInput
+{
+    fs::Path virtual_path;
+    fs::Path file_path; // system path to read it from
+};
+
+// Writes files into a new archive. Fails if two virtual paths have the same hash.
+bool write_pack(const fs::Path& out_path, std::span<const PackInput> files, bool compress,
+                u32 alignment = DEFAULT_ALIGNMENT);
+
+} // namespace engp
+} // namespace fs
+} // namespace eng
@@ -0,0 +1,441 @@
+#include "broadphase.hpp"
+#include <execution>
+#include <numeric>
+#include <thread>
+#include <eng/engine.hpp>
+#include <eng/scene.hpp>
+#include <eng/ecs/components.hpp>
+#include <eng/renderer/renderer.hpp>
+
+namespace eng
+{
+namespace physics
+{
+
+static Pair make_pair(ecs::EntityId a, ecs::EntityId b) { return b < a ? Pair{ b, a } : Pair{ a, b }; }
+
+// Splits [0, count) into chunks processed in parallel. Each chunk outputs into its own vector
+// and they are concatenated in chunk order, so the result does not depend on scheduling.
+template <typename Func>
+static void parallel_find_pairs(u32 count, u32 min_chunk_size, std::vector<Pair>& out_pairs, const Func& func)
+{
+    const auto max_chunks = std::max(std::thread::hardware_concurrency(), 1u) * 4;
+    const auto chunk_count = std::clamp(count / min_chunk_size, 1u, max_chunks);
+    std::vector<std::vector<Pair>> chunk_pairs(chunk_count);
+    std::vector<u32> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0u);
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](u32 c) {
+        const auto begin = (u32)((u64)count * c / chunk_count);
+        const auto end = (u32)((u64)count * (c + 1) / chunk_count);
+        func(begin, end, chunk_pairs[c]);
+    });
+
+    out_pairs.clear();
+    size_t total{};
+    for(const auto& cp : chunk_pairs)
+    {
+        total += cp.size();
+    }
+    out_pairs.reserve(total);
+    for(const auto& cp : chunk_pairs)
+    {
+        out_pairs.insert(out_pairs.end(), cp.begin(), cp.end());
+    }
+}
+
+static AABB merge(const AABB& a, const AABB& b)
+{
+    auto r = a;
+    r.grow(b);
+    return r;
+}
+
+ProxyId DynamicAABBTree::insert(ecs::EntityId entity, const AABB& aabb)
+{
+    const auto leaf = allocate_node();
+    auto& n = nodes[leaf];
+    n.tight = aabb;
+    n.aabb = AABB{ aabb.min - FAT_MARGIN, aabb.max + FAT_MARGIN };
+    n.entity = entity;
+    n.height = 0;
+    insert_leaf(leaf);
+    ++proxy_count;
+    return ProxyId{ leaf };
+}
+
+void DynamicAABBTree::remove(ProxyId proxy)
+{
+    if(!proxy || *proxy >= nodes.size() || !nodes[*proxy].is_leaf() || nodes[*proxy].height != 0) { return; }
+    remove_leaf(*proxy);
+    free_node(*proxy);
+    --proxy_count;
+}
+
+void DynamicAABBTree::move(ProxyId proxy, const AABB& aabb, glm::vec3 displacement)
+{
+    assert(proxy && *proxy < nodes.size() && nodes[*proxy].height == 0);
+    auto& n = nodes[*proxy];
+    n.tight = aabb;
+    if(n.aabb.contains(aabb)) { return; }
+
+    // enlarge the box in the direction of movement, so the proxy can stay in it for a few more moves
+    AABB fat{ aabb.min - FAT_MARGIN, aabb.max + FAT_MARGIN };
+    const auto d = displacement * DISPLACEMENT_MULTIPLIER;
+    fat.min += glm::min(d, glm::vec3{ 0.0f });
+    fat.max += glm::max(d, glm::vec3{ 0.0f });
+    remove_leaf(*proxy);
+    nodes[*proxy].aabb = fat;
+    insert_leaf(*proxy);
+}
+
+void DynamicAABBTree::find_pairs(std::vector<Pair>& out_pairs)
+{
+    out_pairs.clear();
+    if(root == NULL_NODE) { return; }
+
+    // the tree is tested against itself. top levels are split into independent tasks: self-tests of subtrees
+    // at TASK_SPLIT_DEPTH and cross-tests between siblings above it, which then run in parallel.
+    struct Task
+    {
+        u32 a;
+        u32 b; // NULL_NODE for self-test of a
+    };
+    std::vector<Task> tasks;
+    std::vector<u32> level{ root };
+    std::vector<u32> next_level;
+    for(auto depth = 0u; depth < TASK_SPLIT_DEPTH && !level.empty(); ++depth)
+    {
+        next_level.clear();
+        for(const auto n : level)
+        {
+            if(nodes[n].is_leaf()) { continue; }
+            tasks.push_back(Task{ nodes[n].left, nodes[n].right });
+            next_level.push_back(nodes[n].left);
+            next_level.push_back(nodes[n].right);
+        }
+        std::swap(level, next_level);
+    }
+    for(const auto n : level)
+    {
+        tasks.push_back(Task{ n, NULL_NODE });
+    }
+
+    parallel_find_pairs((u32)tasks.size(), 1, out_pairs, [this, &tasks](u32 begin, u32 end, std::vector<Pair>& out) {
+        for(auto i = begin; i < end; ++i)
+        {
+            if(tasks[i].b == NULL_NODE) { collide_self(tasks[i].a, out); }
+            else { collide(tasks[i].a, tasks[i].b, out); }
+        }
+    });
+}
+
+void DynamicAABBTree::collide_self(u32 node, std::vector<Pair>& out_pairs) const
+{
+    const auto& n = nodes[node];
+    if(n.is_leaf()) { return; }
+    collide_self(n.left, out_pairs);
+    collide_self(n.right, out_pairs);
+    collide(n.left, n.right, out_pairs);
+}
+
+void DynamicAABBTree::collide(u32 a, u32 b, std::vector<Pair>& out_pairs) const
+{
+    const auto& na = nodes[a];
+    const auto& nb = nodes[b];
+    if(!na.aabb.overlaps(nb.aabb)) { return; }
+    if(na.is_leaf() && nb.is_leaf())
+    {
+        if(na.tight.overlaps(nb.tight)) { out_pairs.push_back(make_pair(na.entity, nb.entity)); }
+        return;
+    }
+    // descend into the taller subtree
+    if(nb.is_leaf() || (!na.is_leaf() && na.height >= nb.height))
+    {
+        collide(na.left, b, out_pairs);
+        collide(na.right, b, out_pairs);
+    }
+    else
+    {
+        collide(a, nb.left, out_pairs);
+        collide(a, nb.right, out_pairs);
+    }
+}
+
+u32 DynamicAABBTree::allocate_node()
+{
+    if(free_list == NULL_NODE)
+    {
+        nodes.emplace_back();
+        return (u32)nodes.size() - 1;
+    }
+    const auto node = free_list;
+    free_list = nodes[node].parent;
+    nodes[node] = Node{};
+    return node;
+}
+
+void DynamicAABBTree::free_node(u32 node)
+{
+    nodes[node] = Node{};
+    nodes[node].parent = free_list;
+    free_list = node;
+}
+
+void DynamicAABBTree::insert_leaf(u32 leaf)
+{
+    if(root == NULL_NODE)
+    {
+        root = leaf;
+        nodes[root].parent = NULL_NODE;
+        return;
+    }
+
+    // descend towards the sibling which would increase the surface area of the tree the least
+    const auto leaf_aabb = nodes[leaf].aabb;
+    auto index = root;
+    while(!nodes[index].is_leaf())
+    {
+        const auto& n = nodes[index];
+        const auto area = n.aabb.area();
+        const auto combined_area = merge(n.aabb, leaf_aabb).area();
+        // cost of making a new parent for this node and the leaf
+        const auto cost = 2.0f * combined_area;
+        // minimum cost of pushing the leaf further down the tree
+        const auto inheritance_cost = 2.0f * (combined_area - area);
+        const auto child_cost = [&](u32 c) {
+            const auto& cn = nodes[c];
+            const auto merged_area = merge(leaf_aabb, cn.aabb).area();
+            return (cn.is_leaf() ? merged_area : merged_area - cn.aabb.area()) + inheritance_cost;
+        };
+        const auto cost_left = child_cost(n.left);
+        const auto cost_right = child_cost(n.right);
+        if(cost < cost_left && cost < cost_right) { break; }
+        index = cost_left < cost_right ? n.left : n.right;
+    }
+
+    const auto sibling = index;
+    const auto old_parent = nodes[sibling].parent;
+    const auto new_parent = allocate_node();
+    auto& np = nodes[new_parent];
+    np.parent = old_parent;
+    np.aabb = merge(leaf_aabb, nodes[sibling].aabb);
+    np.height = nodes[sibling].height + 1;
+    np.left = sibling;
+    np.right = leaf;
+    if(old_parent != NULL_NODE)
+    {
+        if(nodes[old_parent].left == sibling) { nodes[old_parent].left = new_parent; }
+        else { nodes[old_parent].right = new_parent; }
+    }
+    else { root = new_parent; }
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    fix_upwards(new_parent);
+}
+
+void DynamicAABBTree::remove_leaf(u32 leaf)
+{
+    if(leaf == root)
+    {
+        root = NULL_NODE;
+        return;
+    }
+
+    const auto parent = nodes[leaf].parent;
+    const auto grandparent = nodes[parent].parent;
+    const auto sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+    if(grandparent != NULL_NODE)
+    {
+        if(nodes[grandparent].left == parent) { nodes[grandparent].left = sibling; }
+        else { nodes[grandparent].right = sibling; }
+        nodes[sibling].parent = grandparent;
+        free_node(parent);
+        fix_upwards(grandparent);
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        free_node(parent);
+    }
+}
+
+void DynamicAABBTree::fix_upwards(u32 node)
+{
+    while(node != NULL_NODE)
+    {
+        node = balance(node);
+        auto& n = nodes[node];
+        n.height = 1 + std::max(nodes[n.left].height, nodes[n.right].height);
+        n.aabb = merge(nodes[n.left].aabb, nodes[n.right].aabb);
+        node = n.parent;
+    }
+}
+
+u32 DynamicAABBTree::balance(u32 ia)
+{
+    if(nodes[ia].is_leaf() || nodes[ia].height < 2) { return ia; }
+
+    // rotates child up, making node its child. the taller grandchild stays under the rotated child.
+    const auto rotate_up = [this, ia](u32 ichild, u32 iother, bool child_is_right) {
+        auto& a = nodes[ia];
+        auto& c = nodes[ichild];
+        const auto ig1 = c.left;
+        const auto ig2 = c.right;
+        c.left = ia;
+        c.parent = a.parent;
+        a.parent = ichild;
+        if(c.parent != NULL_NODE)
+        {
+            if(nodes[c.parent].left == ia) { nodes[c.parent].left = ichild; }
+            else { nodes[c.parent].right = ichild; }
+        }
+        else { root = ichild; }
+
+        const auto taller = nodes[ig1].height > nodes[ig2].height ? ig1 : ig2;
+        const auto shorter = taller == ig1 ? ig2 : ig1;
+        c.right = taller;
+        if(child_is_right) { a.right = shorter; }
+        else { a.left = shorter; }
+        nodes[shorter].parent = ia;
+        a.aabb = merge(nodes[iother].aabb, nodes[shorter].aabb);
+        c.aabb = merge(a.aabb, nodes[taller].aabb);
+        a.height = 1 + std::max(nodes[iother].height, nodes[shorter].height);
+        c.height = 1 + std::max(a.height, nodes[taller].height);
+        return ichild;
+    };
+
+    const auto ib = nodes[ia].left;
+    const auto ic = nodes[ia].right;
+    const auto balance = nodes[ic].height - nodes[ib].height;
+    if(balance > 1) { return rotate_up(ic, ib, true); }
+    if(balance < -1) { return rotate_up(ib, ic, false); }
+    return ia;
+}
+
+ProxyId SortAndSweep::insert(ecs::EntityId entity, const AABB& aabb)
+{
+    u32 idx;
+    if(free_proxies.empty())
+    {
+        idx = (u32)proxies.size();
+        proxies.emplace_back();
+    }
+    else
+    {
+        idx = free_proxies.back();
+        free_proxies.pop_back();
+    }
+    proxies[idx] = Proxy{ .aabb = aabb, .entity = entity, .alive = true };
+    order.push_back(idx);
+    return ProxyId{ idx };
+}
+
+void SortAndSweep::remove(ProxyId proxy)
+{
+    if(!proxy || *proxy >= proxies.size() || !proxies[*proxy].alive) { return; }
+    proxies[*proxy].alive = false;
+    free_proxies.push_back(*proxy);
+    std::erase(order, *proxy);
+}
+
+void SortAndSweep::move(ProxyId proxy, const AABB& aabb, glm::vec3 /*displacement*/)
+{
+    assert(proxy && *proxy < proxies.size() && proxies[*proxy].alive);
+    proxies[*proxy].aabb = aabb;
+}
+
+void SortAndSweep::find_pairs(std::vector<Pair>& out_pairs)
+{
+    out_pairs.clear();
+    if(order.size() < 2) { return; }
+
+    // sweep along the axis with the biggest variance of centers, as it separates proxies the best
+    glm::vec3 sum{ 0.0f };
+    glm::vec3 sum2{ 0.0f };
+    for(const auto i : order)
+    {
+        const auto c = proxies[i].aabb.center();
+        sum += c;
+        sum2 += c * c;
+    }
+    const auto variance = sum2 - sum * sum / (float)order.size();
+    int axis = 0;
+    if(variance.y > variance[axis]) { axis = 1; }
+    if(variance.z > variance[axis]) { axis = 2; }
+
+    // order is mostly sorted from the previous frame
+    std::sort(std::execution::par, order.begin(), order.end(),
+              [this, axis](u32 a, u32 b) { return proxies[a].aabb.min[axis] < proxies[b].aabb.min[axis]; });
+    sorted_min.resize(order.size());
+    sorted_max.resize(order.size());
+    for(auto i = 0u; i < order.size(); ++i)
+    {
+        sorted_min[i] = proxies[order[i]].aabb.min[axis];
+        sorted_max[i] = proxies[order[i]].aabb.max[axis];
+    }
+
+    parallel_find_pairs((u32)order.size(), 512, out_pairs, [this](u32 begin, u32 end, std::vector<Pair>& out) {
+        for(auto i = begin; i < end; ++i)
+        {
+            const auto& a = proxies[order[i]];
+            for(auto j = i + 1; j < order.size() && sorted_min[j] <= sorted_max[i]; ++j)
+            {
+                const auto& b = proxies[order[j]];
+                if(a.aabb.overlaps(b.aabb)) { out.push_back(make_pair(a.entity, b.entity)); }
+            }
+        }
+    });
+}
+
+Broadphase::Broadphase(Type type)
+{
+    if(type == Type::AABB_TREE) { impl = std::make_unique<DynamicAABBTree>(); }
+    else { impl = std::make_unique<SortAndSweep>(); }
+}
+
+void Broadphase::update()
+{
+    ++frame;
+    auto* ecs = get_engine().ecs;
+    const auto& tlas = get_engine().scene->tlas;
+    ecs->iterate_components<ecsc::Transform, ecsc::Mesh>([&](ecs::EntityId e, const ecsc::Transform& t, const ecsc::Mesh& m) {
+        AABB local{};
+        for(auto rmh : m.render_meshes)
+        {
+            if(const auto* blas = tlas.get_blas(rmh->geometry)) { local.grow(blas->get_aabb()); }
+        }
+        AABB world{ t.position, t.position };
+        if(local.min.x <= local.max.x) { world = local.transform(t.to_mat4()); }
+
+        const auto slot = e.slot();
+        if(slot >= entity_proxies.size()) { entity_proxies.resize(slot + 1); }
+        auto& ep = entity_proxies[slot];
+        if(ep.proxy && ep.entity != e)
+        {
+            impl->remove(ep.proxy); // slot was recycled
+            ep.proxy = {};
+        }
+        if(!ep.proxy) { ep.proxy = impl->insert(e, world); }
+        else { impl->move(ep.proxy, world, t.position - ep.position); }
+        ep.entity = e;
+        ep.position = t.position;
+        ep.frame = frame;
+    });
+
+    // entities that were erased or lost their components
+    for(auto& ep : entity_proxies)
+    {
+        if(ep.proxy && ep.frame != frame)
+        {
+            impl->remove(ep.proxy);
+            ep = EntityProxy{};
+        }
+    }
+
+    impl->find_pairs(pairs);
+}
+
+} // namespace physics
+} // namespace eng
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <eng/common/handle.hpp>
+#include <eng/common/types.hpp>
+#include <eng/ecs/ecs.hpp>
+#include <eng/physics/bvh.hpp>
+
+namespace eng
+{
+namespace physics
+{
+
+struct proxy_t;
+using ProxyId = TypedId<proxy_t, u32>;
+
+// Entities whose bounds overlap; a < b.
+struct Pair
+{
+    auto operator<=>(const Pair&) const = default;
+    ecs::EntityId a;
+    ecs::EntityId b;
+};
+
+/*
+    Broadphase finds pairs of proxies with overlapping bounds, which then should be
+    tested by the narrowphase. Each proxy holds an entity it was inserted with.
+    find_pairs() reports every overlapping pair once, in deterministic order.
+*/
+class IBroadphase
+{
+  public:
+    virtual ~IBroadphase() = default;
+    virtual ProxyId insert(ecs::EntityId entity, const AABB& aabb) = 0;
+    virtual void remove(ProxyId proxy) = 0;
+    // displacement since last move helps predicting where the proxy goes next
+    virtual void move(ProxyId proxy, const AABB& aabb, glm::vec3 displacement = {}) = 0;
+    virtual void find_pairs(std::vector<Pair>& out_pairs) = 0;
+    virtual u32 size() const = 0;
+};
+
+/*
+    Dynamic AABB tree with fattened leaves. Moving a proxy within its fat box is just a store,
+    otherwise the leaf is reinserted. Insertion picks the sibling with the lowest surface area cost,
+    and AVL rotations keep the tree balanced. Proxy ids are leaf node indices and stay stable.
+    Pairs are found by testing the tree against itself, which visits far fewer nodes than
+    querying the tree with every proxy separately.
+*/
+class DynamicAABBTree final : public IBroadphase
+{
+    inline static constexpr u32 NULL_NODE = ~0u;
+    inline static constexpr u32 TASK_SPLIT_DEPTH = 6; // levels of the tree split into parallel tasks when finding pairs
+    struct Node
+    {
+        bool is_leaf() const { return left == NULL_NODE; }
+        AABB aabb{};  // fattened for leaves
+        AABB tight{}; // actual bounds of the proxy, for leaves only
+        u32 parent{ NULL_NODE }; // or next free node, if the node is not used
+        u32 left{ NULL_NODE };
+        u32 right{ NULL_NODE };
+        i32 height{ -1 }; // 0 for leaves, -1 for free nodes
+        ecs::EntityId entity{};
+    };
+
+  public:
+    inline static constexpr float FAT_MARGIN = 0.1f;
+    inline static constexpr float DISPLACEMENT_MULTIPLIER = 2.0f;
+
+    ProxyId insert(ecs::EntityId entity, const AABB& aabb) override;
+    void remove(ProxyId proxy) override;
+    void move(ProxyId proxy, const AABB& aabb, glm::vec3 displacement = {}) override;
+    void find_pairs(std::vector<Pair>& out_pairs) override;
+    u32 size() const override { return proxy_count; }
+
+    u32 get_height() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+  private:
+    u32 allocate_node();
+    void free_node(u32 node);
+    void insert_leaf(u32 leaf);
+    void remove_leaf(u32 leaf);
+    u32 balance(u32 node);
+    void fix_upwards(u32 node);
+    void collide_self(u32 node, std::vector<Pair>& out_pairs) const;
+    void collide(u32 a, u32 b, std::vector<Pair>& out_pairs) const;
+
+    std::vector<Node> nodes;
+    u32 root{ NULL_NODE };
+    u32 free_list{ NULL_NODE };
+    u32 proxy_count{};
+};
+
+/*
+    Sort and sweep over the axis with the biggest spread of proxy centers.
+    Does not keep any hierarchy, so moving is free, and finding pairs is a sort
+    followed by a linear sweep. Works best when proxies are evenly distributed along some axis.
+*/
+class SortAndSweep final : public IBroadphase
+{
+    struct Proxy
+    {
+        AABB aabb{};
+        ecs::EntityId entity{};
+        bool alive{};
+    };
+
+  public:
+    ProxyId insert(ecs::EntityId entity, const AABB& aabb) override;
+    void remove(ProxyId proxy) override;
+    void move(ProxyId proxy, const AABB& aabb, glm::vec3 displacement = {}) override;
+    void find_pairs(std::vector<Pair>& out_pairs) override;
+    u32 size() const override { return (u32)order.size(); }
+
+  private:
+    std::vector<Proxy> proxies;
+    std::vector<u32> free_proxies;
+    std::vector<u32> order; // indices of alive proxies, sorted by aabb.min on the sweep axis
+    std::vector<float> sorted_min;
+    std::vector<float> sorted_max;
+};
+
+/*
+    Keeps broadphase proxies in sync with entities having ecsc::Transform and ecsc::Mesh components.
+    Local bounds of an entity come from BLASes of its geometries registered in scene's TLAS, so entities
+    whose geometries haven't been built yet are just points until then.
+*/
+class Broadphase
+{
+    struct EntityProxy
+    {
+        ecs::EntityId entity{};
+        ProxyId proxy;
+        glm::vec3 position{};
+        u64 frame{};
+    };
+
+  public:
+    enum class Type
+    {
+        AABB_TREE,
+        SORT_AND_SWEEP,
+    };
+
+    explicit Broadphase(Type type = Type::AABB_TREE);
+
+    // Inserts, moves and removes proxies, then collects overlapping pairs.
+    void update();
+    std::span<const Pair> get_pairs() const { return pairs; }
+    IBroadphase& get_impl() { return *impl; }
+
+  private:
+    std::unique_ptr<IBroadphase> impl;
+    std::vector<EntityProxy> entity_proxies; // indexed with entity slot
+    std::vector<Pair> pairs;
+    u64 frame{};
+};
+
+} // namespace physics
+} // namespace eng
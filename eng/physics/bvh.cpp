@@ -1,56 +1,110 @@
 #include "bvh.hpp"
+#include <execution>
 #include <eng/renderer/types.hpp>
+#include <eng/assets/serialization.hpp>
 
 namespace eng
 {
 namespace physics
 {
+AABB AABB::transform(const glm::mat4& mat) const
+{
+    AABB ret{};
+    for(auto i = 0u; i < 8; ++i)
+    {
+        const glm::vec3 corner{ i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z };
+        ret.grow(glm::vec3{ mat * glm::vec4{ corner, 1.0f } });
+    }
+    return ret;
+}
+
+float AABB::intersect(const Ray& ray, float tmax) const
+{
+    // slab test
+    const auto t0 = (min - ray.origin) * ray.inv_dir;
+    const auto t1 = (max - ray.origin) * ray.inv_dir;
+    const auto tsmall = glm::min(t0, t1);
+    const auto tbig = glm::max(t0, t1);
+    const auto tenter = std::max(std::max(tsmall.x, tsmall.y), std::max(tsmall.z, 0.0f));
+    const auto texit = std::min(std::min(tbig.x, tbig.y), std::min(tbig.z, tmax));
+    return tenter <= texit ? tenter : FLT_MAX;
+}
+
+bool Triangle::intersect(const Ray& ray, RayHit& hit) const
+{
+    const auto e1 = b - a;
+    const auto e2 = c - a;
+    const auto h = glm::cross(ray.dir, e2);
+    const auto det = glm::dot(e1, h);
+    if(std::abs(det) < 1e-8f) { return false; } // parallel
+    const auto inv_det = 1.0f / det;
+    const auto s = ray.origin - a;
+    const auto u = glm::dot(s, h) * inv_det;
+    if(u < 0.0f || u > 1.0f) { return false; }
+    const auto q = glm::cross(s, e1);
+    const auto v = glm::dot(ray.dir, q) * inv_det;
+    if(v < 0.0f || u + v > 1.0f) { return false; }
+    const auto t = glm::dot(e2, q) * inv_det;
+    if(t <= 0.0f || t >= hit.t || t > ray.tmax) { return false; }
+    hit.t = t;
+    hit.uv = { u, v };
+    return true;
+}
+
+static std::vector<u32> get_u32_indices(std::span<const std::byte> indices, gfx::IndexFormat index_format)
+{
+    std::vector<u32> ids(gfx::get_index_count(indices, index_format));
+    if(ids.size() > 0)
+    {
+        gfx::copy_indices(std::as_writable_bytes(std::span{ ids }), std::span{ indices }, gfx::IndexFormat::U32, index_format);
+    }
+    return ids;
+}
+
+// reads tri-th triangle's positions from vertex buffer, indexed or not.
+static Triangle read_triangle(std::span<const std::byte> vertices, size_t stride, std::span<const u32> ids, size_t tri)
+{
+    const auto* psrc = vertices.data();
+    const auto ic = ids.size();
+    const auto* pa = ic > 0 ? psrc + ids[tri * 3 + 0] * stride : psrc + (tri * 3 + 0) * stride;
+    const auto* pb = ic > 0 ? psrc + ids[tri * 3 + 1] * stride : psrc + (tri * 3 + 1) * stride;
+    const auto* pc = ic > 0 ? psrc + ids[tri * 3 + 2] * stride : psrc + (tri * 3 + 2) * stride;
+    Triangle t;
+    memcpy(&t.a, pa, sizeof(t.a));
+    memcpy(&t.b, pb, sizeof(t.b));
+    memcpy(&t.c, pc, sizeof(t.c));
+    return t;
+}
+
 BVH::BVH(std::span<const std::byte> vertices, size_t stride, std::span<const std::byte> indices, gfx::IndexFormat index_format)
 {
-    return;
     // make sure vertices are non empty and the stride at least is one position (3 floats.
     assert(vertices.size() > 0 && stride >= 3 * sizeof(float));
 
-    const auto ic = gfx::get_index_count(indices, index_format);
+    const auto ids = get_u32_indices(indices, index_format);
+    const auto ic = ids.size();
     // if using indices, make sure they form triangles; or check if vertices form triangles
     assert(ic > 0 ? ic % 3 == 0 : (vertices.size() / stride) % 3 == 0);
 
-    std::vector<u32> ids(ic);
-    if(ic > 0)
-    {
-        gfx::copy_indices(std::as_writable_bytes(std::span{ ids }), std::span{ indices }, gfx::IndexFormat::U32, index_format);
-    }
-
     // copy vertex positions to triangles
     const auto tri_count = (ic > 0 ? ic : vertices.size() / stride) / 3;
     tris.resize(tri_count);
-    const auto* psrc = vertices.data();
+    tri_ids.resize(tri_count);
     for(auto i = 0ull; i < tri_count; ++i)
     {
-        const auto* pa = ic > 0 ? psrc + ids[i * 3 + 0] * stride : psrc + (i * 3 + 0) * stride;
-        const auto* pb = ic > 0 ? psrc + ids[i * 3 + 1] * stride : psrc + (i * 3 + 1) * stride;
-        const auto* pc = ic > 0 ? psrc + ids[i * 3 + 2] * stride : psrc + (i * 3 + 2) * stride;
-        memcpy(&tris[i].a, pa, sizeof(tris[i].a));
-        memcpy(&tris[i].b, pb, sizeof(tris[i].b));
-        memcpy(&tris[i].c, pc, sizeof(tris[i].c));
+        tris[i] = read_triangle(vertices, stride, ids, i);
+        tri_ids[i] = (u32)i;
     }
 
     assert(tris.size() <= UINT32_MAX);
+    if(tris.empty()) { return; }
 
     nodes.reserve(tri_count * 2 - 1);
     nodes.push_back(Node{ .aabb = {}, .left_or_pstart = 0, .pcount = (u32)tris.size() });
     update_bounds(0);
-    subdivide(0);
+    subdivide(0, 0);
     nodes.shrink_to_fit();
-    metadatas.resize(nodes.size());
-
-    const auto count_levels = [this](u32 node, u32 level, const auto& self) -> u32 {
-        const auto& n = nodes[node];
-        metadatas[node].level = level;
-        if(n.is_leaf()) { return level; }
-        return std::max(self(n.left_or_pstart, level + 1, self), self(n.left_or_pstart + 1, level + 1, self));
-    };
-    levels = count_levels(0, 1, count_levels);
+    update_levels();
 }
 
 BVH::Stats BVH::get_stats() const
@@ -64,23 +118,210 @@ BVH::Stats BVH::get_stats() const
     };
 }
 
-void BVH::subdivide(u32 node)
+bool BVH::intersect(const Ray& ray, RayHit& hit) const
+{
+    if(nodes.empty()) { return false; }
+    if(nodes[0].aabb.intersect(ray, std::min(hit.t, ray.tmax)) == FLT_MAX) { return false; }
+
+    bool found = false;
+    u32 stack[MAX_DEPTH + 1];
+    u32 stack_size = 0;
+    stack[stack_size++] = 0;
+    while(stack_size > 0)
+    {
+        const auto& n = nodes[stack[--stack_size]];
+        if(n.is_leaf())
+        {
+            for(auto i = 0u; i < n.pcount; ++i)
+            {
+                if(tris[n.left_or_pstart + i].intersect(ray, hit))
+                {
+                    hit.prim = tri_ids[n.left_or_pstart + i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // visit the closer child first by pushing it last
+        const auto tmax = std::min(hit.t, ray.tmax);
+        auto l = n.left_or_pstart;
+        auto r = n.left_or_pstart + 1;
+        auto tl = nodes[l].aabb.intersect(ray, tmax);
+        auto tr = nodes[r].aabb.intersect(ray, tmax);
+        if(tl > tr)
+        {
+            std::swap(l, r);
+            std::swap(tl, tr);
+        }
+        assert(stack_size + 2 <= std::size(stack));
+        if(tr != FLT_MAX) { stack[stack_size++] = r; }
+        if(tl != FLT_MAX) { stack[stack_size++] = l; }
+    }
+    return found;
+}
+
+void BVH::refit(std::span<const std::byte> vertices, size_t stride, std::span<const std::byte> indices, gfx::IndexFormat index_format)
+{
+    if(nodes.empty()) { return; }
+
+    const auto ids = get_u32_indices(indices, index_format);
+    assert((ids.size() > 0 ? ids.size() : vertices.size() / stride) / 3 == tris.size());
+
+    std::for_each(std::execution::par, tris.begin(), tris.end(), [&](Triangle& t) {
+        t = read_triangle(vertices, stride, ids, tri_ids[&t - tris.data()]);
+    });
+
+    // nodes on the same level don't depend on each other, so each level can be done in parallel,
+    // starting from the deepest one.
+    const auto refit_node = [this](u32 node) {
+        auto& n = nodes[node];
+        if(n.is_leaf()) { return update_bounds(node); }
+        n.aabb = nodes[n.left_or_pstart].aabb;
+        n.aabb.grow(nodes[n.left_or_pstart + 1].aabb);
+    };
+    for(auto l = levels; l > 0; --l)
+    {
+        const auto lnodes = std::span{ level_nodes }.subspan(level_offsets[l - 1], level_offsets[l] - level_offsets[l - 1]);
+        if(lnodes.size() < MIN_PARALLEL_REFIT_NODES) { std::for_each(lnodes.begin(), lnodes.end(), refit_node); }
+        else { std::for_each(std::execution::par, lnodes.begin(), lnodes.end(), refit_node); }
+    }
+}
+
+void BVH::optimize(u32 passes)
+{
+    if(nodes.size() < 5) { return; } // rotations need at least one grandchild
+    std::vector<u32> heights(nodes.size());
+    for(auto i = 0u; i < passes; ++i)
+    {
+        rotate(0, 0, heights);
+    }
+    update_levels();
+}
+
+u32 BVH::rotate(u32 node, u32 depth, std::vector<u32>& heights)
+{
+    auto& n = nodes[node];
+    if(n.is_leaf()) { return heights[node] = 0; }
+
+    const auto l = n.left_or_pstart;
+    const auto r = l + 1;
+    rotate(l, depth + 1, heights);
+    rotate(r, depth + 1, heights);
+
+    // try swapping a child with one of the grandchildren from the other side, and pick the swap
+    // that shrinks the surface area of the sibling the most. this node's bounds don't change.
+    struct Rotation
+    {
+        float gain{};
+        u32 child;
+        u32 grandchild;
+        u32 sibling;
+        u32 other;
+    };
+    Rotation best{};
+    for(const auto [c, s] : { std::pair{ l, r }, std::pair{ r, l } })
+    {
+        if(nodes[s].is_leaf()) { continue; }
+        if(depth + 2 + heights[c] >= MAX_DEPTH) { continue; } // child would be pushed one level down
+        for(const auto g : { nodes[s].left_or_pstart, nodes[s].left_or_pstart + 1 })
+        {
+            const auto o = g == nodes[s].left_or_pstart ? g + 1 : g - 1;
+            auto aabb = nodes[c].aabb;
+            aabb.grow(nodes[o].aabb);
+            const auto gain = nodes[s].aabb.area() - aabb.area();
+            if(gain > best.gain) { best = Rotation{ gain, c, g, s, o }; }
+        }
+    }
+    if(best.gain > 0.0f)
+    {
+        // swapping node structs moves whole subtrees, as they only reference their own children
+        std::swap(nodes[best.child], nodes[best.grandchild]);
+        std::swap(heights[best.child], heights[best.grandchild]);
+        nodes[best.sibling].aabb = nodes[best.other].aabb;
+        nodes[best.sibling].aabb.grow(nodes[best.grandchild].aabb);
+        heights[best.sibling] = 1 + std::max(heights[best.other], heights[best.grandchild]);
+    }
+    return heights[node] = 1 + std::max(heights[l], heights[r]);
+}
+
+void BVH::serialize(serialization::Context& ctx) const
+{
+    static_assert(std::is_trivially_copyable_v<Triangle> && std::is_trivially_copyable_v<Node>);
+    const u64 tri_count = tris.size();
+    const u64 node_count = nodes.size();
+    ctx.serialize(tri_count);
+    ctx.safe_write(tris.data(), tri_count * sizeof(Triangle));
+    ctx.safe_write(tri_ids.data(), tri_count * sizeof(u32));
+    ctx.serialize(node_count);
+    ctx.safe_write(nodes.data(), node_count * sizeof(Node));
+}
+
+void BVH::deserialize(serialization::Context& ctx)
+{
+    u64 tri_count = 0;
+    u64 node_count = 0;
+    ctx.deserialize(tri_count);
+    tris.resize(tri_count);
+    tri_ids.resize(tri_count);
+    ctx.safe_read(tris.data(), tri_count * sizeof(Triangle));
+    ctx.safe_read(tri_ids.data(), tri_count * sizeof(u32));
+    ctx.deserialize(node_count);
+    nodes.resize(node_count);
+    ctx.safe_read(nodes.data(), node_count * sizeof(Node));
+    levels = 0;
+    metadatas.clear();
+    level_nodes.clear();
+    level_offsets.clear();
+    if(!nodes.empty()) { update_levels(); }
+}
+
+void BVH::update_levels()
+{
+    metadatas.resize(nodes.size());
+    const auto count_levels = [this](u32 node, u32 level, const auto& self) -> u32 {
+        const auto& n = nodes[node];
+        metadatas[node].level = level;
+        if(n.is_leaf()) { return level; }
+        return std::max(self(n.left_or_pstart, level + 1, self), self(n.left_or_pstart + 1, level + 1, self));
+    };
+    levels = count_levels(0, 1, count_levels);
+
+    // bucket nodes by level; nodes of level l are in level_nodes[level_offsets[l - 1]..level_offsets[l]]
+    level_offsets.assign(levels + 1, 0);
+    for(const auto& m : metadatas)
+    {
+        ++level_offsets[m.level];
+    }
+    std::partial_sum(level_offsets.begin(), level_offsets.end(), level_offsets.begin());
+    auto cursors = level_offsets;
+    level_nodes.resize(nodes.size());
+    for(auto i = 0u; i < nodes.size(); ++i)
+    {
+        level_nodes[cursors[metadatas[i].level - 1]++] = i;
+    }
+}
+
+void BVH::subdivide(u32 node, u32 depth)
 {
     auto& n = nodes[node];
-    if(n.pcount <= 2) { return; }
+    if(n.pcount <= 2 || depth + 1 >= MAX_DEPTH) { return; }
     int axis = 0;
     const auto extent = n.aabb.extent();
     if(extent.y > extent[axis]) { axis = 1; }
     if(extent.z > extent[axis]) { axis = 2; }
     const auto splitpos = (n.aabb.min[axis] + n.aabb.max[axis]) * 0.5f;
 
-    u32 a = n.left_or_pstart;
-    u32 b = a + n.pcount - 1;
+    i64 a = n.left_or_pstart;
+    i64 b = a + n.pcount - 1;
     while(a <= b)
     {
         const auto p = tris[a].centroid()[axis];
         if(p < splitpos) { ++a; }
-        else { std::swap(tris[a], tris[b--]); }
+        else
+        {
+            std::swap(tri_ids[a], tri_ids[b]);
+            std::swap(tris[a], tris[b--]);
+        }
     }
 
     // don't subdivide if one child has all all the triangles
@@ -90,15 +331,15 @@ void BVH::subdivide(u32 node)
     nodes.emplace_back();
     nodes.emplace_back();
     nodes[lni].left_or_pstart = n.left_or_pstart;
-    nodes[lni].pcount = a - n.left_or_pstart;
-    nodes[lni + 1].left_or_pstart = a;
+    nodes[lni].pcount = (u32)(a - n.left_or_pstart);
+    nodes[lni + 1].left_or_pstart = (u32)a;
     nodes[lni + 1].pcount = n.pcount - nodes[lni].pcount;
     n.left_or_pstart = lni;
     n.pcount = 0;
     update_bounds(lni);
     update_bounds(lni + 1);
-    subdivide(lni);
-    subdivide(lni + 1);
+    subdivide(lni, depth + 1);
+    subdivide(lni + 1, depth + 1);
 }
 
 void BVH::update_bounds(u32 node)
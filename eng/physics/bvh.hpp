@@ -5,17 +5,75 @@
 #include <cstdint>
 #include <cstddef>
 #include <glm/common.hpp>
+#include <glm/mat4x4.hpp>
 #include <eng/common/types.hpp>
 
 namespace eng
 {
+namespace serialization
+{
+class Context;
+}
+
 namespace physics
 {
 
+struct Ray
+{
+    static Ray init(glm::vec3 origin, glm::vec3 dir, float tmax = FLT_MAX)
+    {
+        return Ray{ .origin = origin, .dir = dir, .inv_dir = 1.0f / dir, .tmax = tmax };
+    }
+    // transforms the ray with the matrix. direction is not normalized, so distances stay comparable between spaces.
+    Ray transform(const glm::mat4& mat) const
+    {
+        return init(glm::vec3{ mat * glm::vec4{ origin, 1.0f } }, glm::vec3{ mat * glm::vec4{ dir, 0.0f } }, tmax);
+    }
+    glm::vec3 origin{};
+    glm::vec3 dir{ 0.0f, 0.0f, -1.0f };
+    glm::vec3 inv_dir{ 0.0f, 0.0f, -1.0f };
+    float tmax{ FLT_MAX };
+};
+
+struct RayHit
+{
+    bool is_hit() const { return prim != ~0u; }
+    float t{ FLT_MAX };
+    glm::vec2 uv{}; // barycentrics of the hit point
+    u32 prim{ ~0u }; // index of the hit triangle
+};
+
 struct AABB
 {
     glm::vec3 extent() const { return max - min; }
     glm::vec3 center() const { return (min + max) * 0.5f; }
+    float area() const
+    {
+        const auto e = glm::max(extent(), glm::vec3{ 0.0f });
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+    void grow(glm::vec3 p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    void grow(const AABB& a)
+    {
+        min = glm::min(min, a.min);
+        max = glm::max(max, a.max);
+    }
+    bool overlaps(const AABB& a) const
+    {
+        return glm::all(glm::lessThanEqual(min, a.max)) && glm::all(glm::lessThanEqual(a.min, max));
+    }
+    bool contains(const AABB& a) const
+    {
+        return glm::all(glm::lessThanEqual(min, a.min)) && glm::all(glm::lessThanEqual(a.max, max));
+    }
+    // returns aabb enclosing this aabb after transforming it with the matrix
+    AABB transform(const glm::mat4& mat) const;
+    // returns entry distance along the ray, or FLT_MAX if the ray misses or enters further than tmax.
+    float intersect(const Ray& ray, float tmax) const;
     glm::vec3 min{ FLT_MAX };
     glm::vec3 max{ -FLT_MAX };
 };
@@ -24,6 +82,8 @@ struct Triangle
 {
     glm::vec3 centroid() const { return (a + b + c) / 3.0f; }
     AABB aabb() const { return AABB{ glm::min(glm::min(a, b), c), glm::max(glm::max(a, b), c) }; }
+    // moller-trumbore; updates hit if the triangle is closer than hit.t
+    bool intersect(const Ray& ray, RayHit& hit) const;
     glm::vec3 a;
     glm::vec3 b;
     glm::vec3 c;
@@ -32,6 +92,8 @@ struct Triangle
 class BVH
 {
     inline static constexpr u32 INVALID_CHILD = ~0u;
+    inline static constexpr u32 MAX_DEPTH = 64; // subdivision stops at this depth, so traversal can use fixed stack
+    inline static constexpr u32 MIN_PARALLEL_REFIT_NODES = 256; // smaller levels are refitted on the calling thread
     struct Node
     {
         struct Metadata
@@ -61,15 +123,37 @@ class BVH
         gfx::IndexFormat index_format = gfx::IndexFormat::U32);
 
     Stats get_stats() const;
+    bool empty() const { return nodes.empty(); }
+    const AABB& get_aabb() const { return nodes.at(0).aabb; }
+
+    // finds closest hit along the ray in the space of the vertices the bvh was built with.
+    // hit.prim is the index of the triangle in the order of the buffers the bvh was built with.
+    bool intersect(const Ray& ray, RayHit& hit) const;
+
+    // Updates triangles and node bounds from deformed vertices without changing the topology of the tree.
+    // Buffers must describe the same triangles as the ones the bvh was built with.
+    void refit(std::span<const std::byte> vertices, size_t stride, std::span<const std::byte> indices = {},
+               gfx::IndexFormat index_format = gfx::IndexFormat::U32);
+    // Tree rotations reducing surface area of nodes; restores some of the quality lost by refitting after heavy deformations.
+    void optimize(u32 passes = 1);
+
+    // Writes triangles, their original ids and nodes as raw bytes, so loading skips the build.
+    void serialize(serialization::Context& ctx) const;
+    void deserialize(serialization::Context& ctx);
 
   private:
-    void subdivide(u32 node);
+    void subdivide(u32 node, u32 depth);
     void update_bounds(u32 node);
+    void update_levels();
+    u32 rotate(u32 node, u32 depth, std::vector<u32>& heights);
 
     u32 levels{};
     std::vector<Triangle> tris;
+    std::vector<u32> tri_ids; // original index of each triangle, as tris get reordered during build
     std::vector<Node> nodes;
     std::vector<Node::Metadata> metadatas;
+    std::vector<u32> level_nodes;   // node indices sorted by level
+    std::vector<u32> level_offsets; // level_offsets[l - 1] is the start of level l in level_nodes
 };
 } // namespace physics
 } // namespace eng
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "tlas.hpp"
+#include <eng/engine.hpp>
+#include <eng/ecs/components.hpp>
+#include <eng/renderer/renderer.hpp>
+
+namespace eng
+{
+namespace physics
+{
+
+void TLAS::add_blas(Handle<gfx::Geometry> geometry, BVH&& blas)
+{
+    if(!geometry || blas.empty()) { return; }
+    if(auto it = blas_map.find(geometry); it != blas_map.end()) { blases[it->second] = std::move(blas); }
+    else
+    {
+        blas_map.emplace(geometry, (u32)blases.size());
+        blases.push_back(std::move(blas));
+    }
+    blases_changed = true;
+}
+
+const BVH* TLAS::get_blas(Handle<gfx::Geometry> geometry) const
+{
+    auto it = blas_map.find(geometry);
+    if(it == blas_map.end()) { return nullptr; }
+    return &blases[it->second];
+}
+
+BVH* TLAS::get_blas(Handle<gfx::Geometry> geometry)
+{
+    return const_cast<BVH*>(std::as_const(*this).get_blas(geometry));
+}
+
+bool TLAS::update()
+{
+    const auto& qgroup = get_engine().ecs->get_query_group<ecsc::Mesh, ecsc::Transform>();
+    if(qgroup.hash == entities_hash && !blases_changed) { return false; }
+    entities_hash = qgroup.hash;
+    blases_changed = false;
+    build();
+    return true;
+}
+
+void TLAS::build()
+{
+    ENG_TIMER_SCOPED("Build scene TLAS");
+
+    instances.clear();
+    nodes.clear();
+    auto* ecs = get_engine().ecs;
+    for(auto e : ecs->get_query_group<ecsc::Mesh, ecsc::Transform>().entities)
+    {
+        const auto& mesh = ecs->get<ecsc::Mesh>(e);
+        for(auto rmh : mesh.render_meshes)
+        {
+            auto it = blas_map.find(rmh->geometry);
+            if(it == blas_map.end()) { continue; } // geometry without cpu bvh can't be queried
+            auto& inst = instances.emplace_back(Instance{ .entity = e, .geometry = rmh->geometry, .blas = it->second });
+            update_instance(inst);
+        }
+    }
+    if(instances.empty()) { return; }
+
+    nodes.reserve(instances.size() * 2 - 1);
+    nodes.push_back(Node{ .aabb = {}, .left_or_istart = 0, .icount = (u32)instances.size() });
+    update_bounds(0);
+    subdivide(0, 0);
+    nodes.shrink_to_fit();
+}
+
+void TLAS::refit()
+{
+    if(nodes.empty()) { return; }
+    for(auto& inst : instances)
+    {
+        update_instance(inst);
+    }
+    // children are always placed after their parent, so reverse order visits them first
+    for(auto i = (i64)nodes.size() - 1; i >= 0; --i)
+    {
+        auto& n = nodes[i];
+        if(n.is_leaf()) { update_bounds((u32)i); }
+        else
+        {
+            n.aabb = nodes[n.left_or_istart].aabb;
+            n.aabb.grow(nodes[n.left_or_istart + 1].aabb);
+        }
+    }
+}
+
+bool TLAS::has_moved_instances() const
+{
+    auto* ecs = get_engine().ecs;
+    return std::ranges::any_of(instances, [ecs](const Instance& inst) {
+        return ecs->get<ecsc::Transform>(inst.entity).to_mat4() != inst.world;
+    });
+}
+
+std::optional<TLAS::Hit> TLAS::intersect(const Ray& ray) const
+{
+    if(nodes.empty()) { return std::nullopt; }
+
+    RayHit hit{};
+    const Instance* hit_inst{};
+    u32 stack[MAX_DEPTH + 1];
+    u32 stack_size = 0;
+    if(nodes[0].aabb.intersect(ray, ray.tmax) != FLT_MAX) { stack[stack_size++] = 0; }
+    while(stack_size > 0)
+    {
+        const auto& n = nodes[stack[--stack_size]];
+        if(n.is_leaf())
+        {
+            for(auto i = 0u; i < n.icount; ++i)
+            {
+                const auto& inst = instances[n.left_or_istart + i];
+                if(inst.aabb.intersect(ray, std::min(hit.t, ray.tmax)) == FLT_MAX) { continue; }
+                // direction is not normalized in object space, so t stays the same in both spaces
+                if(blases[inst.blas].intersect(ray.transform(inst.inv_world), hit)) { hit_inst = &inst; }
+            }
+            continue;
+        }
+        const auto tmax = std::min(hit.t, ray.tmax);
+        auto l = n.left_or_istart;
+        auto r = n.left_or_istart + 1;
+        auto tl = nodes[l].aabb.intersect(ray, tmax);
+        auto tr = nodes[r].aabb.intersect(ray, tmax);
+        if(tl > tr)
+        {
+            std::swap(l, r);
+            std::swap(tl, tr);
+        }
+        if(tr != FLT_MAX) { stack[stack_size++] = r; }
+        if(tl != FLT_MAX) { stack[stack_size++] = l; }
+    }
+
+    if(!hit_inst) { return std::nullopt; }
+    return Hit{ .entity = hit_inst->entity, .geometry = hit_inst->geometry, .hit = hit };
+}
+
+void TLAS::update_instance(Instance& inst) const
+{
+    inst.world = get_engine().ecs->get<ecsc::Transform>(inst.entity).to_mat4();
+    inst.inv_world = glm::inverse(inst.world);
+    inst.aabb = blases[inst.blas].get_aabb().transform(inst.world);
+}
+
+void TLAS::subdivide(u32 node, u32 depth)
+{
+    auto& n = nodes[node];
+    if(n.icount <= 2 || depth + 1 >= MAX_DEPTH) { return; }
+
+    AABB centroids{};
+    for(auto i = 0u; i < n.icount; ++i)
+    {
+        centroids.grow(instances[n.left_or_istart + i].aabb.center());
+    }
+    int axis = 0;
+    const auto extent = centroids.extent();
+    if(extent.y > extent[axis]) { axis = 1; }
+    if(extent.z > extent[axis]) { axis = 2; }
+    if(extent[axis] <= 0.0f) { return; } // all centroids in one spot, splitting won't help
+
+    const auto first = instances.begin() + n.left_or_istart;
+    const auto splitpos = centroids.center()[axis];
+    auto mid = std::partition(first, first + n.icount,
+                              [axis, splitpos](const Instance& i) { return i.aabb.center()[axis] < splitpos; });
+    // instances tend to cluster, so fall back to median split instead of giving up
+    if(mid == first || mid == first + n.icount)
+    {
+        mid = first + n.icount / 2;
+        std::nth_element(first, mid, first + n.icount, [axis](const Instance& a, const Instance& b) {
+            return a.aabb.center()[axis] < b.aabb.center()[axis];
+        });
+    }
+
+    const auto lcount = (u32)std::distance(first, mid);
+    const auto lni = (u32)nodes.size();
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[lni].left_or_istart = n.left_or_istart;
+    nodes[lni].icount = lcount;
+    nodes[lni + 1].left_or_istart = n.left_or_istart + lcount;
+    nodes[lni + 1].icount = n.icount - lcount;
+    n.left_or_istart = lni;
+    n.icount = 0;
+    update_bounds(lni);
+    update_bounds(lni + 1);
+    subdivide(lni, depth + 1);
+    subdivide(lni + 1, depth + 1);
+}
+
+void TLAS::update_bounds(u32 node)
+{
+    auto& n = nodes[node];
+    n.aabb = {};
+    for(auto i = 0u; i < n.icount; ++i)
+    {
+        n.aabb.grow(instances[n.left_or_istart + i].aabb);
+    }
+}
+
+} // namespace physics
+} // namespace eng
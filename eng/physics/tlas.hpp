@@ -0,0 +1,97 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <eng/common/handle.hpp>
+#include <eng/common/types.hpp>
+#include <eng/ecs/ecs.hpp>
+#include <eng/physics/bvh.hpp>
+
+namespace eng
+{
+namespace gfx
+{
+struct Geometry;
+}
+
+namespace physics
+{
+
+/*
+    Two-level acceleration structure for cpu queries over the whole scene.
+    Bottom level are triangle BVHs, one per geometry, shared by all the instances using it.
+    Top level is a BVH over world-space bounds of instances, one per render mesh of entities
+    with ecsc::Mesh and ecsc::Transform components. Rays are transformed into object space of
+    an instance before traversing its BLAS.
+
+    update() rebuilds the top level when set of mesh entities or registered BLASes changed.
+    refit() reads transforms again and updates bounds bottom-up without changing topology,
+    which is enough when instances just moved.
+*/
+class TLAS
+{
+    inline static constexpr u32 MAX_DEPTH = 64;
+    struct Node
+    {
+        bool is_leaf() const { return icount > 0; }
+        AABB aabb{};
+        u32 left_or_istart{ ~0u }; // if icount == 0, index of the left child (right is +1), otherwise offset into instances
+        u32 icount{};
+    };
+
+  public:
+    struct Instance
+    {
+        ecs::EntityId entity;
+        Handle<gfx::Geometry> geometry;
+        u32 blas{ ~0u };
+        glm::mat4 world{ 1.0f };
+        glm::mat4 inv_world{ 1.0f };
+        AABB aabb{}; // world-space bounds
+    };
+
+    struct Hit
+    {
+        ecs::EntityId entity;
+        Handle<gfx::Geometry> geometry;
+        RayHit hit; // t is in world-space units when ray direction was given in world space
+    };
+
+    // Registers bottom-level bvh shared by all instances of the geometry. Replaces previous one.
+    void add_blas(Handle<gfx::Geometry> geometry, BVH&& blas);
+    const BVH* get_blas(Handle<gfx::Geometry> geometry) const;
+    // For refitting deformed geometry. Call refit() afterwards, so instance bounds catch up.
+    BVH* get_blas(Handle<gfx::Geometry> geometry);
+
+    // Rebuilds the top level if mesh entities or blases changed since last build. Returns true if it did.
+    bool update();
+    // Rebuilds instance list and top level from ecs entities with ecsc::Mesh and ecsc::Transform components.
+    void build();
+    // Re-reads transforms of instances and refits the top level bounds.
+    void refit();
+    // True if transform of any instance changed since it was last read.
+    bool has_moved_instances() const;
+
+    // Finds closest hit among all the instances.
+    std::optional<Hit> intersect(const Ray& ray) const;
+
+    std::span<const Instance> get_instances() const { return instances; }
+
+  private:
+    void update_instance(Instance& inst) const;
+    void subdivide(u32 node, u32 depth);
+    void update_bounds(u32 node);
+
+    std::vector<BVH> blases;
+    std::unordered_map<Handle<gfx::Geometry>, u32> blas_map;
+    std::vector<Instance> instances;
+    std::vector<Node> nodes;
+    u64 entities_hash{};
+    bool blases_changed{};
+};
+
+} // namespace physics
+} // namespace eng
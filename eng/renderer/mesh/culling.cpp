@@ -0,0 +1,184 @@
+#include "culling.hpp"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#define ENG_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace eng
+{
+namespace gfx
+{
+
+Frustum Frustum::init(const glm::mat4& proj_view)
+{
+    // gribb-hartmann; rows of the matrix. clip space is x,y in [-w, w] and z in [0, w], with z == w at near plane.
+    const auto row = [&proj_view](int i) {
+        return glm::vec4{ proj_view[0][i], proj_view[1][i], proj_view[2][i], proj_view[3][i] };
+    };
+    Frustum f;
+    f.planes[0] = row(3) + row(0);
+    f.planes[1] = row(3) - row(0);
+    f.planes[2] = row(3) + row(1);
+    f.planes[3] = row(3) - row(1);
+    f.planes[4] = row(3) - row(2);
+    for(auto& p : f.planes)
+    {
+        p /= glm::length(glm::vec3{ p });
+    }
+    return f;
+}
+
+u32 Frustum::test_spheres4(const glm::vec4* spheres[4]) const
+{
+#ifdef ENG_CULLING_SSE
+    const auto x = _mm_setr_ps(spheres[0]->x, spheres[1]->x, spheres[2]->x, spheres[3]->x);
+    const auto y = _mm_setr_ps(spheres[0]->y, spheres[1]->y, spheres[2]->y, spheres[3]->y);
+    const auto z = _mm_setr_ps(spheres[0]->z, spheres[1]->z, spheres[2]->z, spheres[3]->z);
+    const auto nr = _mm_setr_ps(-spheres[0]->w, -spheres[1]->w, -spheres[2]->w, -spheres[3]->w);
+    auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for(const auto& p : planes)
+    {
+        auto d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_mul_ps(y, _mm_set1_ps(p.y)));
+        d = _mm_add_ps(d, _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+        inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, nr));
+    }
+    return (u32)_mm_movemask_ps(inside);
+#else
+    u32 mask = 0;
+    for(auto i = 0u; i < 4; ++i)
+    {
+        const auto& s = *spheres[i];
+        bool inside = true;
+        for(const auto& p : planes)
+        {
+            inside = inside && glm::dot(glm::vec3{ p }, glm::vec3{ s }) + p.w > -s.w;
+        }
+        mask |= (u32)inside << i;
+    }
+    return mask;
+#endif
+}
+
+void SoftwareDepthBuffer::begin(const glm::mat4& proj_view)
+{
+    this->proj_view = proj_view;
+    depth.assign(WIDTH * HEIGHT, 0.0f); // reverse-z: 0 is infinitely far
+}
+
+void SoftwareDepthBuffer::rasterize(std::span<const physics::Triangle> triangles)
+{
+    for(const auto& t : triangles)
+    {
+        rasterize(t);
+    }
+}
+
+void SoftwareDepthBuffer::end()
+{
+    // erode occluders by taking the farthest depth of the neighbourhood
+    scratch.resize(depth.size());
+    for(auto y = 0u; y < HEIGHT; ++y)
+    {
+        for(auto x = 0u; x < WIDTH; ++x)
+        {
+            auto d = depth[y * WIDTH + x];
+            if(x > 0) { d = std::min(d, depth[y * WIDTH + x - 1]); }
+            if(x + 1 < WIDTH) { d = std::min(d, depth[y * WIDTH + x + 1]); }
+            scratch[y * WIDTH + x] = d;
+        }
+    }
+    for(auto y = 0u; y < HEIGHT; ++y)
+    {
+        for(auto x = 0u; x < WIDTH; ++x)
+        {
+            auto d = scratch[y * WIDTH + x];
+            if(y > 0) { d = std::min(d, scratch[(y - 1) * WIDTH + x]); }
+            if(y + 1 < HEIGHT) { d = std::min(d, scratch[(y + 1) * WIDTH + x]); }
+            depth[y * WIDTH + x] = d;
+        }
+    }
+}
+
+bool SoftwareDepthBuffer::is_sphere_occluded(const glm::vec4& sphere) const
+{
+    // project corners of the box around the sphere; its closest corner is at least as close as the sphere
+    glm::vec2 smin{ FLT_MAX };
+    glm::vec2 smax{ -FLT_MAX };
+    float closest = 0.0f;
+    for(auto i = 0u; i < 8; ++i)
+    {
+        const auto r = sphere.w;
+        const glm::vec3 corner{ i & 1 ? r : -r, i & 2 ? r : -r, i & 4 ? r : -r };
+        const auto clip = proj_view * glm::vec4{ glm::vec3{ sphere } + corner, 1.0f };
+        if(clip.w <= 0.0f || clip.z > clip.w) { return false; } // crosses near plane
+        const auto ndc = glm::vec3{ clip } / clip.w;
+        smin = glm::min(smin, glm::vec2{ ndc });
+        smax = glm::max(smax, glm::vec2{ ndc });
+        closest = std::max(closest, ndc.z);
+    }
+
+    const auto x0 = (i32)std::floor((smin.x * 0.5f + 0.5f) * WIDTH);
+    const auto x1 = (i32)std::ceil((smax.x * 0.5f + 0.5f) * WIDTH);
+    const auto y0 = (i32)std::floor((smin.y * 0.5f + 0.5f) * HEIGHT);
+    const auto y1 = (i32)std::ceil((smax.y * 0.5f + 0.5f) * HEIGHT);
+    const auto cx0 = std::max(x0, 0);
+    const auto cx1 = std::min(x1, (i32)WIDTH);
+    const auto cy0 = std::max(y0, 0);
+    const auto cy1 = std::min(y1, (i32)HEIGHT);
+    if(cx0 >= cx1 || cy0 >= cy1) { return false; } // off-screen; frustum test decides
+
+    for(auto y = cy0; y < cy1; ++y)
+    {
+        for(auto x = cx0; x < cx1; ++x)
+        {
+            if(depth[y * WIDTH + x] <= closest) { return false; }
+        }
+    }
+    return true;
+}
+
+void SoftwareDepthBuffer::rasterize(const physics::Triangle& triangle)
+{
+    glm::vec3 v[3];
+    const glm::vec3* src[]{ &triangle.a, &triangle.b, &triangle.c };
+    for(auto i = 0u; i < 3; ++i)
+    {
+        const auto clip = proj_view * glm::vec4{ *src[i], 1.0f };
+        if(clip.w <= 0.0f || clip.z > clip.w) { return; } // crosses near plane; skipping occluder is conservative
+        v[i] = glm::vec3{ clip } / clip.w;
+        v[i].x = (v[i].x * 0.5f + 0.5f) * WIDTH;
+        v[i].y = (v[i].y * 0.5f + 0.5f) * HEIGHT;
+    }
+
+    const auto edge = [](const glm::vec3& a, const glm::vec3& b, float px, float py) {
+        return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+    };
+    const auto area = edge(v[0], v[1], v[2].x, v[2].y);
+    if(std::abs(area) < 1e-6f) { return; }
+    const auto inv_area = 1.0f / area;
+
+    const auto x0 = std::max((i32)std::floor(std::min({ v[0].x, v[1].x, v[2].x })), 0);
+    const auto x1 = std::min((i32)std::ceil(std::max({ v[0].x, v[1].x, v[2].x })), (i32)WIDTH);
+    const auto y0 = std::max((i32)std::floor(std::min({ v[0].y, v[1].y, v[2].y })), 0);
+    const auto y1 = std::min((i32)std::ceil(std::max({ v[0].y, v[1].y, v[2].y })), (i32)HEIGHT);
+    for(auto y = y0; y < y1; ++y)
+    {
+        const auto py = (float)y + 0.5f;
+        for(auto x = x0; x < x1; ++x)
+        {
+            const auto px = (float)x + 0.5f;
+            // barycentrics normalized by area, so winding does not matter
+            const auto b0 = edge(v[1], v[2], px, py) * inv_area;
+            const auto b1 = edge(v[2], v[0], px, py) * inv_area;
+            const auto b2 = 1.0f - b0 - b1;
+            if(b0 < 0.0f || b1 < 0.0f || b2 < 0.0f) { continue; }
+            auto& d = depth[y * WIDTH + x];
+            d = std::max(d, b0 * v[0].z + b1 * v[1].z + b2 * v[2].z);
+        }
+    }
+}
+
+} // namespace gfx
+} // namespace eng
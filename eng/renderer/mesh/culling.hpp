@@ -0,0 +1,50 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <eng/common/types.hpp>
+#include <eng/physics/bvh.hpp>
+
+namespace eng
+{
+namespace gfx
+{
+
+// Frustum planes of camera's infinite reverse-z projection. There is no far plane.
+struct Frustum
+{
+    static Frustum init(const glm::mat4& proj_view);
+    // Tests 4 spheres (xyz center, w radius) at once. Bit i is set if sphere i is at least partially inside.
+    u32 test_spheres4(const glm::vec4* spheres[4]) const;
+    glm::vec4 planes[5]; // left, right, bottom, top, near; normalized, pointing inside
+};
+
+/*
+    Low resolution depth buffer for cpu occlusion culling. Occluder triangles are rasterized with
+    reverse-z depth (bigger is closer), and then the buffer is eroded by a pixel, so partially
+    covered pixels at occluder edges don't hide anything behind them. Triangles crossing the near plane
+    are skipped, and so are spheres that do, so the test stays conservative.
+*/
+class SoftwareDepthBuffer
+{
+  public:
+    inline static constexpr u32 WIDTH = 256;
+    inline static constexpr u32 HEIGHT = 128;
+
+    void begin(const glm::mat4& proj_view);
+    void rasterize(std::span<const physics::Triangle> triangles);
+    void end();
+    bool is_sphere_occluded(const glm::vec4& sphere) const;
+
+  private:
+    void rasterize(const physics::Triangle& triangle);
+
+    glm::mat4 proj_view{ 1.0f };
+    std::vector<float> depth;
+    std::vector<float> scratch;
+};
+
+} // namespace gfx
+} // namespace eng
@@ -1,5 +1,9 @@
+#include <execution>
+#include <numeric>
 #include "mesh_renderer.hpp"
+#include <eng/camera.hpp>
 #include <eng/engine.hpp>
+#include <eng/scene.hpp>
 #include <eng/renderer/renderer.hpp>
 #include <eng/renderer/submit_queue.hpp>
 #include <eng/renderer/staging_buffer.hpp>
@@ -36,60 +40,49 @@ void MeshRenderer::instance_entity(ecs::EntityId entity)
 
 void MeshRenderer::build_passes()
 {
-    for(auto i = 0u; i < (int)MeshPassType::LAST_ENUM; ++i)
+    const auto& qgroup = get_engine().ecs->get_query_group<ecsc::Mesh>();
+    const auto meshes_changed = m_meshes_hash != qgroup.hash;
+    // streamed levels of detail change meshlet ranges of geometries, which instances are made from
+    const auto lods_changed = m_geometry_lods_version != get_renderer().geometry_lods_version;
+    const auto culling = cpu_frustum_culling || cpu_occlusion_culling || cpu_lod_selection;
+    if(!meshes_changed && !lods_changed && !culling && !m_culled_last_frame) { return; }
+    m_meshes_hash = qgroup.hash;
+    m_geometry_lods_version = get_renderer().geometry_lods_version;
+    m_culled_last_frame = culling;
+
+    if(meshes_changed || lods_changed)
     {
-        auto& pass = m_pass_datas_arr[i];
-        const auto& qgroup = get_engine().ecs->get_query_group<ecsc::Mesh>();
-        if(pass.meshes_hash != qgroup.hash)
+        // meshes_vec is filled by the renderer calling instance_entity() for every entity when the group changes
+        for(auto i = 0u; i < (int)MeshPassType::LAST_ENUM; ++i)
         {
-            for(auto e : qgroup.entities)
+            auto& pass = m_pass_datas_arr[i];
+            if(meshes_changed)
             {
-                instance_entity(e);
+                pass.instanced_meshes_vec = std::move(pass.meshes_vec);
+                pass.meshes_vec.clear();
             }
-            pass.meshes_hash = qgroup.hash;
+            pass.instances = extract_mesh_instances((MeshPassType)i, pass);
+            sort_mesh_instances(pass.instances);
         }
-        else { continue; }
-
-        auto instances = extract_mesh_instances((MeshPassType)i, pass);
-        sort_mesh_instances(instances);
-        auto ret = build_pass_from_instances(pass, instances);
-
-        std::vector<u32> counts;
-        counts.reserve(pass.batches_vec.size());
-        for(const auto& b : pass.batches_vec)
-        {
-            counts.push_back(b.command_count);
-        }
-
-        const auto cmds_byte_start = align_up2((counts.size() * sizeof(counts[0])), 16);
-        const auto indirect_cap = cmds_byte_start + ret.cmds_vec.size();
-
-        pass.indirect_cmds_offset = cmds_byte_start;
 
-        struct MakeOrResizeBufData
+        m_geometries.clear();
+        for(const auto& pass : m_pass_datas_arr)
         {
-            Handle<Buffer>* buf;
-            size_t size;
-            StackString<64> name;
-            Flags<BufferUsage> usage;
-        };
-        MakeOrResizeBufData mkorrszbufs[]{
-            { &pass.indirect_buf, indirect_cap, ENG_FMT("{} indirect buffer", to_string((MeshPassType)i)), BufferUsage::INDIRECT_BIT },
-            { &pass.instance_buf, ret.gpuinstanceids_vec.size() * sizeof(ret.gpuinstanceids_vec[0]),
-              ENG_FMT("{} instance buffer", to_string((MeshPassType)i)), BufferUsage::STORAGE_BIT },
-        };
-        for(auto i = 0u; i < std::size(mkorrszbufs); ++i)
-        {
-            auto& d = mkorrszbufs[i];
-            if(!*d.buf) { *d.buf = get_renderer().make_buffer(d.name.as_view(), Buffer::init(d.size, d.usage)); }
-            else { get_renderer().resize_buffer(*d.buf, d.size, false); }
+            for(const auto& mi : pass.instances)
+            {
+                if(m_geometries.empty() || m_geometries.back() != mi.geometry) { m_geometries.push_back(mi.geometry); }
+            }
         }
+        std::sort(m_geometries.begin(), m_geometries.end());
+        m_geometries.erase(std::unique(m_geometries.begin(), m_geometries.end()), m_geometries.end());
+    }
 
-        get_renderer().staging->copy(pass.indirect_buf.get(), counts, 0ull);
-        get_renderer().staging->copy(pass.indirect_buf.get(), ret.cmds_vec, cmds_byte_start);
-        get_renderer().staging->copy(pass.instance_buf.get(), ret.gpuinstanceids_vec, 0);
-
-        pass.meshes_vec.clear();
+    // instances hold meshlets of every lod, so they always go through culling, which keeps only the selected lods
+    prepare_culling();
+    for(auto i = 0u; i < (int)MeshPassType::LAST_ENUM; ++i)
+    {
+        auto& pass = m_pass_datas_arr[i];
+        upload_pass((MeshPassType)i, pass, cull_instances(pass.instances));
     }
 }
 
@@ -101,9 +94,9 @@ MeshRenderer::SetupPassData MeshRenderer::setup(MeshPassType type, RGBuilder& b)
     data.constants = b.read_buffer(get_renderer().current_data->render_resources.constants);
     data.index = b.import_resource(get_renderer().bufs.indices);
     data.index = b.read_index(data.index);
-    data.indirect = b.import_resource(pass.indirect_buf);
+    data.indirect = b.import_resource(pass.indirect_bufs[0]);
     data.indirect = b.read_indirect(data.indirect);
-    data.gpuinstances = b.import_resource(pass.instance_buf);
+    data.gpuinstances = b.import_resource(pass.instance_bufs[0]);
     data.gpuinstances = b.read_buffer(data.gpuinstances);
     return data;
 }
@@ -117,22 +110,199 @@ void MeshRenderer::draw(MeshPassType type, ICommandBuffer& cmd)
     for(const auto& batch : pass.batches_vec)
     {
         cmd.bind_pipeline(batch.pipeline.get());
-        cmd.draw_indexed_indirect_count(pass.indirect_buf.get(), pass.indirect_cmds_offset + batch.first_command * cmd_size,
-                                        pass.indirect_buf.get(), batch_idx * sizeof(u32), batch.command_count, cmd_size);
+        cmd.draw_indexed_indirect_count(pass.indirect_bufs[0].get(), pass.indirect_cmds_offset + batch.first_command * cmd_size,
+                                        pass.indirect_bufs[0].get(), batch_idx * sizeof(u32), batch.command_count, cmd_size);
         ++batch_idx;
     }
 }
 
+void MeshRenderer::upload_pass(MeshPassType type, PassData& pass, const InstancesVec& vec)
+{
+    auto ret = build_pass_from_instances(pass, vec);
+
+    std::vector<u32> counts;
+    counts.reserve(pass.batches_vec.size());
+    for(const auto& b : pass.batches_vec)
+    {
+        counts.push_back(b.command_count);
+    }
+
+    const auto cmds_byte_start = align_up2((counts.size() * sizeof(counts[0])), 16);
+    const auto indirect_cap = cmds_byte_start + ret.cmds_vec.size();
+
+    pass.indirect_cmds_offset = cmds_byte_start;
+
+    // previous frame may still be reading the buffers
+    std::swap(pass.indirect_bufs[0], pass.indirect_bufs[1]);
+    std::swap(pass.instance_bufs[0], pass.instance_bufs[1]);
+
+    struct MakeOrResizeBufData
+    {
+        Handle<Buffer>* buf;
+        size_t size;
+        StackString<64> name;
+        Flags<BufferUsage> usage;
+    };
+    MakeOrResizeBufData mkorrszbufs[]{
+        { &pass.indirect_bufs[0], indirect_cap, ENG_FMT("{} indirect buffer", to_string(type)), BufferUsage::INDIRECT_BIT },
+        { &pass.instance_bufs[0], ret.gpuinstanceids_vec.size() * sizeof(GPUInstanceId),
+          ENG_FMT("{} instance buffer", to_string(type)), BufferUsage::STORAGE_BIT },
+    };
+    for(auto i = 0u; i < std::size(mkorrszbufs); ++i)
+    {
+        auto& d = mkorrszbufs[i];
+        if(!*d.buf) { *d.buf = get_renderer().make_buffer(d.name.as_view(), Buffer::init(d.size, d.usage)); }
+        else { get_renderer().resize_buffer(*d.buf, d.size, false); }
+    }
+
+    get_renderer().staging->copy(pass.indirect_bufs[0].get(), counts, 0ull);
+    get_renderer().staging->copy(pass.indirect_bufs[0].get(), ret.cmds_vec, cmds_byte_start);
+    get_renderer().staging->copy(pass.instance_bufs[0].get(), ret.gpuinstanceids_vec, 0);
+}
+
+void MeshRenderer::prepare_culling()
+{
+    const auto* cam = get_engine().camera;
+    const auto proj_view = cam->get_projection() * cam->get_view();
+    m_frustum = Frustum::init(proj_view);
+    select_lods(cam->get_projection());
+    if(!cpu_occlusion_culling) { return; }
+
+    // vertex shaders don't apply instance transforms yet, so geometries are drawn where they were authored
+    // and every one of them is rasterized once, no matter how many times it is instanced.
+    m_depth_buffer.begin(proj_view);
+    for(auto g : m_geometries)
+    {
+        auto it = m_occluders_map.find(g);
+        if(it == m_occluders_map.end())
+        {
+            const auto* blas = get_engine().scene->tlas.get_blas(g);
+            if(!blas) { continue; } // bvh not ready yet; try next frame
+            const auto tris = blas->get_stats().tris;
+            std::vector<physics::Triangle> occluders{ tris.begin(), tris.end() };
+            const auto area = [](const physics::Triangle& t) {
+                const auto n = glm::cross(t.b - t.a, t.c - t.a);
+                return glm::dot(n, n);
+            };
+            if(occluders.size() > MAX_OCCLUDERS_PER_GEOMETRY)
+            {
+                std::nth_element(occluders.begin(), occluders.begin() + MAX_OCCLUDERS_PER_GEOMETRY, occluders.end(),
+                                 [&area](const auto& a, const auto& b) { return area(a) > area(b); });
+                occluders.resize(MAX_OCCLUDERS_PER_GEOMETRY);
+            }
+            it = m_occluders_map.emplace(g, std::move(occluders)).first;
+        }
+        m_depth_buffer.rasterize(it->second);
+    }
+    m_depth_buffer.end();
+}
+
+void MeshRenderer::select_lods(const glm::mat4& proj)
+{
+    const auto& meshlets = get_renderer().meshlets;
+    m_geometry_lods.assign(get_renderer().geometries.size(), 0u);
+    m_geometry_demand.assign(get_renderer().geometries.size(), GeometryDemand{});
+
+    // world space error e at distance d covers e / d * proj[1][1] * height / 2 pixels
+    const auto cam_pos = get_engine().camera->pos;
+    const auto pixels_per_unit = proj[1][1] * get_renderer().settings.render_resolution.y * 0.5f;
+    for(auto g : m_geometries)
+    {
+        const auto& geom = g.get();
+        if(geom.lod_count == 0) { continue; }
+        auto it = m_geometry_spheres_map.find(g);
+        if(it == m_geometry_spheres_map.end())
+        {
+            // finer levels may not be streamed in yet; the coarser ones have nearly the same bounds
+            physics::AABB aabb{};
+            const auto range = geom.lods[geom.resident_lod].meshlet_range;
+            for(auto i = range.offset; i < range.offset + range.size; ++i)
+            {
+                const auto& bs = meshlets[i].bounding_sphere;
+                aabb.grow(glm::vec3{ bs } - bs.w);
+                aabb.grow(glm::vec3{ bs } + bs.w);
+            }
+            const auto center = aabb.center();
+            auto radius = 0.0f;
+            for(auto i = range.offset; i < range.offset + range.size; ++i)
+            {
+                const auto& bs = meshlets[i].bounding_sphere;
+                radius = std::max(radius, glm::distance(center, glm::vec3{ bs }) + bs.w);
+            }
+            it = m_geometry_spheres_map.emplace(g, glm::vec4{ center, radius }).first;
+        }
+
+        // closest point of the bounding sphere gives the biggest projected error
+        const auto distance = std::max(glm::distance(cam_pos, glm::vec3{ it->second }) - it->second.w, 1e-4f);
+        auto lod = 0u;
+        while(cpu_lod_selection && lod + 1 < geom.lod_count &&
+              geom.lods[lod + 1].error / distance * pixels_per_unit <= lod_pixel_error)
+        {
+            ++lod;
+        }
+        m_geometry_demand[*g] = GeometryDemand{ .pixels = 2.0f * it->second.w / distance * pixels_per_unit, .lod = lod };
+        m_geometry_lods[*g] = std::max(lod, geom.resident_lod);
+    }
+}
+
+MeshRenderer::InstancesVec MeshRenderer::cull_instances(const InstancesVec& vec) const
+{
+    static constexpr size_t CHUNK_SIZE = 1024;
+    const auto& meshlets = get_renderer().meshlets;
+    const auto chunk_count = (vec.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<InstancesVec> chunks(chunk_count);
+    std::vector<size_t> chunk_ids(chunk_count);
+    std::iota(chunk_ids.begin(), chunk_ids.end(), 0ull);
+    std::for_each(std::execution::par, chunk_ids.begin(), chunk_ids.end(), [&](size_t ci) {
+        const auto first = ci * CHUNK_SIZE;
+        const auto last = std::min(first + CHUNK_SIZE, vec.size());
+        auto& out = chunks[ci];
+        out.reserve(last - first);
+        for(auto i = first; i < last; i += 4)
+        {
+            const auto count = std::min(last - i, (size_t)4);
+            const glm::vec4* spheres[4];
+            for(auto j = 0u; j < 4; ++j)
+            {
+                // pad last group with repeats of its first sphere
+                spheres[j] = &meshlets[vec[i + (j < count ? j : 0)].meshlet].bounding_sphere;
+            }
+            auto mask = cpu_frustum_culling ? m_frustum.test_spheres4(spheres) : 0xFu;
+            for(auto j = 0u; j < count; ++j)
+            {
+                if(vec[i + j].lod != m_geometry_lods[*vec[i + j].geometry]) { continue; }
+                if(!(mask & (1u << j))) { continue; }
+                if(cpu_occlusion_culling && m_depth_buffer.is_sphere_occluded(*spheres[j])) { continue; }
+                out.push_back(vec[i + j]);
+            }
+        }
+    });
+
+    // concatenating chunks in order keeps instances sorted
+    InstancesVec visible;
+    visible.reserve(vec.size());
+    for(const auto& c : chunks)
+    {
+        visible.insert(visible.end(), c.begin(), c.end());
+    }
+    return visible;
+}
+
 MeshRenderer::InstancesVec MeshRenderer::extract_mesh_instances(MeshPassType type, PassData& pass)
 {
     std::vector<PassData::MeshInstance> instances;
-    for(const auto& m : pass.meshes_vec)
+    for(const auto& m : pass.instanced_meshes_vec)
     {
-        const auto meshlets = m.mesh->geometry->meshlet_range;
-        for(auto i = 0u; i < meshlets.size; ++i)
+        const auto& geom = m.mesh->geometry.get();
+        for(auto lod = 0u; lod < geom.lod_count; ++lod)
         {
-            instances.emplace_back(m.mesh->geometry, m.mesh->material, m.mesh->material->mesh_pass->effects[(int)type]->pipeline,
-                                   m.gpu_resource, meshlets.offset + i);
+            const auto meshlets = geom.lods[lod].meshlet_range;
+            for(auto i = 0u; i < meshlets.size; ++i)
+            {
+                instances.emplace_back(m.mesh->geometry, m.mesh->material,
+                                       m.mesh->material->mesh_pass->effects[(int)type]->pipeline, m.gpu_resource,
+                                       meshlets.offset + i, lod);
+            }
         }
     }
     return instances;
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <unordered_map>
 #include <eng/common/types.hpp>
 #include <eng/renderer/rendergraph.hpp>
+#include <eng/renderer/mesh/culling.hpp>
 #include <eng/ecs/components.hpp>
 
 namespace eng
@@ -26,6 +28,7 @@ class MeshRenderer
             Handle<Pipeline> pipeline;
             u32 gpu_resource;
             u32 meshlet;
+            u32 lod;
         };
 
         struct InstanceBatch
@@ -35,11 +38,13 @@ class MeshRenderer
             u32 command_count;
         };
 
-        u64 meshes_hash{};
         std::vector<InstacedMeshHandle> meshes_vec;
+        std::vector<InstacedMeshHandle> instanced_meshes_vec; // meshes_vec of the last change of meshes
+        std::vector<MeshInstance> instances; // sorted, before culling
 
-        Handle<Buffer> instance_buf;
-        Handle<Buffer> indirect_buf;
+        // double buffered, as they may be rewritten every frame; [0] is the current one
+        Handle<Buffer> instance_bufs[2];
+        Handle<Buffer> indirect_bufs[2];
         size_t indirect_cmds_offset{};
         std::vector<InstanceBatch> batches_vec;
     };
@@ -63,17 +68,55 @@ class MeshRenderer
     using PassInstancesGroups = std::vector<Range32u>;
 
   public:
+    // Projected size of the geometry's bounding sphere, and the level of detail it would be drawn with
+    // if all of them were resident.
+    struct GeometryDemand
+    {
+        float pixels{};
+        u32 lod{};
+    };
+
     void instance_entity(ecs::EntityId entity);
     void build_passes();
     SetupPassData setup(MeshPassType type, RGBuilder& b) const;
     void draw(MeshPassType type, ICommandBuffer& cmd);
 
+    // Culling and lod selection need rebuilding passes every frame, so with all of them disabled passes are rebuilt
+    // only when meshes change.
+    bool cpu_frustum_culling{ true };
+    bool cpu_occlusion_culling{ false };
+    bool cpu_lod_selection{ true };
+    float lod_pixel_error{ 1.0f }; // coarsest lod whose error projects to at most this many pixels is drawn
+
+    // Indexed by geometry handle; zero pixels for geometries that aren't drawn. Updated when passes are rebuilt.
+    const std::vector<GeometryDemand>& get_geometry_demand() const { return m_geometry_demand; }
+
   private:
+    inline static constexpr size_t MAX_OCCLUDERS_PER_GEOMETRY = 256;
+
     static InstancesVec extract_mesh_instances(MeshPassType type, PassData& pass);
     static void sort_mesh_instances(InstancesVec& vec);
     static BuildPassResult build_pass_from_instances(PassData& pass, const InstancesVec& vec);
+    void prepare_culling();
+    void select_lods(const glm::mat4& proj);
+    InstancesVec cull_instances(const InstancesVec& vec) const;
+    void upload_pass(MeshPassType type, PassData& pass, const InstancesVec& vec);
 
     std::array<PassData, (int)MeshPassType::LAST_ENUM> m_pass_datas_arr;
+    u64 m_meshes_hash{};
+    u32 m_geometry_lods_version{};
+    bool m_culled_last_frame{};
+
+    std::vector<Handle<Geometry>> m_geometries; // unique geometries of all passes
+    std::vector<u32> m_geometry_lods;          // selected lod of each geometry, indexed by the handle
+    std::vector<GeometryDemand> m_geometry_demand;
+    // bounding sphere of the full lod of each geometry
+    std::unordered_map<Handle<Geometry>, glm::vec4> m_geometry_spheres_map;
+
+    Frustum m_frustum{};
+    SoftwareDepthBuffer m_depth_buffer;
+    // biggest triangles of each geometry, used as occluders
+    std::unordered_map<Handle<Geometry>, std::vector<physics::Triangle>> m_occluders_map;
 };
 
 } // namespace gfx
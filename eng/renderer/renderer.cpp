@@ -51,6 +51,20 @@ ImageBlockData get_block_data(ImageFormat format)
     {
         return { 8, { 1, 1, 1 } };
     }
+    case ImageFormat::BC1_RGBA_UNORM:
+    case ImageFormat::BC1_RGBA_SRGB:
+    case ImageFormat::BC4_UNORM:
+    {
+        return { 8, { 4, 4, 1 } };
+    }
+    case ImageFormat::BC3_UNORM:
+    case ImageFormat::BC3_SRGB:
+    case ImageFormat::BC5_UNORM:
+    case ImageFormat::BC7_UNORM:
+    case ImageFormat::BC7_SRGB:
+    {
+        return { 16, { 4, 4, 1 } };
+    }
     default:
     {
         ENG_ASSERT(false && "Bad format.");
@@ -59,6 +73,43 @@ ImageBlockData get_block_data(ImageFormat format)
     }
 }
 
+// First fit; ranges that don't fit anywhere go at the end, which is moved.
+static u64 allocate_range(std::vector<Range64u>& free_ranges, u64 size, usize& end)
+{
+    for(auto it = free_ranges.begin(); it != free_ranges.end(); ++it)
+    {
+        if(it->size < size) { continue; }
+        const auto offset = it->offset;
+        it->offset += size;
+        it->size -= size;
+        if(it->size == 0) { free_ranges.erase(it); }
+        return offset;
+    }
+    const auto offset = (u64)end;
+    end += size;
+    return offset;
+}
+
+// Keeps free ranges sorted and merges the neighbouring ones.
+static void free_range(std::vector<Range64u>& free_ranges, Range64u range)
+{
+    if(range.size == 0) { return; }
+    auto it = free_ranges.insert(std::lower_bound(free_ranges.begin(), free_ranges.end(), range), range);
+    if(auto next = it + 1; next != free_ranges.end() && it->offset + it->size == next->offset)
+    {
+        it->size += next->size;
+        free_ranges.erase(next);
+    }
+    if(it != free_ranges.begin())
+    {
+        if(auto prev = it - 1; prev->offset + prev->size == it->offset)
+        {
+            prev->size += it->size;
+            free_ranges.erase(it);
+        }
+    }
+}
+
 void Renderer::BuildGeometryContext::add_descriptor(Handle<Geometry> geometry, const GeometryDescriptor& desc)
 {
     auto& batch = batches.emplace_back();
@@ -68,7 +119,15 @@ void Renderer::BuildGeometryContext::add_descriptor(Handle<Geometry> geometry, c
     batch.index_format = desc.index_format;
     batch.indices.insert(batch.indices.end(), desc.indices.begin(), desc.indices.end());
     batch.meshlets.insert(batch.meshlets.end(), desc.meshlets.begin(), desc.meshlets.end());
+    batch.meshlet_lods.insert(batch.meshlet_lods.end(), desc.meshlet_lods.begin(), desc.meshlet_lods.end());
+    for(const auto& lod : desc.lods)
+    {
+        batch.lod_indices.emplace_back(lod.indices.begin(), lod.indices.end());
+        batch.lod_errors.push_back(lod.error);
+    }
     batch.geom_ready_signal = desc.signal;
+    batch.resident_lod = desc.resident_lod;
+    if(desc.bvh) { batch.bvh = *desc.bvh; }
 
     if(desc.attributes.size())
     {
@@ -552,6 +611,20 @@ void Renderer::update()
         }
         current_data->retired_resources.erase(current_data->retired_resources.begin(), remove_until);
     }
+    if(bufs.retired_lods.size() > 0)
+    {
+        auto remove_until = bufs.retired_lods.begin();
+        for(const auto& rl : bufs.retired_lods)
+        {
+            if(current_frame - rl.frame < frame_delay) { break; }
+            ++remove_until;
+            free_range(bufs.free_vertices, rl.vertices);
+            free_range(bufs.free_indices, rl.indices);
+            free_range(bufs.free_meshlets, rl.meshlets);
+            std::fill_n(meshlets.begin() + rl.meshlets.offset, rl.meshlets.size, Meshlet{});
+        }
+        bufs.retired_lods.erase(bufs.retired_lods.begin(), remove_until);
+    }
 
     {
         std::vector<fs::Path> changed_paths;
@@ -1195,6 +1268,116 @@ Handle<Geometry> Renderer::make_geometry(const GeometryDescriptor& batch)
     return ret_handle;
 }
 
+// cpu bvh for scene queries over the full level of detail; meshlet indices are local to meshlet's vertices,
+// so they are made global first.
+static physics::BVH build_meshlets_bvh(std::span<const float> positions, std::span<const u16> indices, std::span<const Meshlet> meshlets)
+{
+    if(positions.empty() || meshlets.empty()) { return {}; }
+    std::vector<u32> bvh_indices;
+    bvh_indices.reserve(indices.size());
+    for(const auto& mlt : meshlets)
+    {
+        for(auto i = 0u; i < mlt.index_count; ++i)
+        {
+            bvh_indices.push_back(mlt.vertex_offset + indices[mlt.index_offset + i]);
+        }
+    }
+    return physics::BVH{ std::as_bytes(positions), 3 * sizeof(float), std::as_bytes(std::span{ bvh_indices }), IndexFormat::U32 };
+}
+
+// Vertices and indices of a level of detail. Its meshlets are one after another, with indices of each one
+// padded to 4, as meshletize_geometry makes them.
+struct LODBlock
+{
+    Range64u vertices;
+    Range64u indices;
+};
+
+static LODBlock get_lod_block(std::span<const Meshlet> meshlets, Range32u range)
+{
+    if(range.size == 0) { return {}; }
+    const auto& first = meshlets[range.offset];
+    const auto& last = meshlets[range.offset + range.size - 1];
+    return LODBlock{ .vertices = { (u64)first.vertex_offset, (u64)(last.vertex_offset + last.vertex_count - first.vertex_offset) },
+                     .indices = { first.index_offset, align_up2(last.index_offset + last.index_count, 4) - first.index_offset } };
+}
+
+// Removes levels of detail finer than lod from the data, leaving their meshlet ranges empty. Returns the finest
+// level left.
+static u32 drop_finer_lods(assets::ParsedGeometryData& data, u32 lod)
+{
+    if(data.lods.empty()) { return 0; }
+    lod = std::min(lod, (u32)data.lods.size() - 1);
+    if(lod == 0) { return 0; }
+    const auto first_meshlet = data.lods[lod].meshlet_range.offset;
+    const auto block = get_lod_block(data.meshlets, data.lods[lod].meshlet_range);
+    const auto att_floats = data.attributes.size() / std::max<usize>(data.positions.size() / 3, 1);
+    data.positions.erase(data.positions.begin(), data.positions.begin() + block.vertices.offset * 3);
+    data.attributes.erase(data.attributes.begin(), data.attributes.begin() + block.vertices.offset * att_floats);
+    data.indices.erase(data.indices.begin(), data.indices.begin() + block.indices.offset);
+    data.meshlets.erase(data.meshlets.begin(), data.meshlets.begin() + first_meshlet);
+    for(auto& mlt : data.meshlets)
+    {
+        mlt.vertex_offset -= (i32)block.vertices.offset;
+        mlt.index_offset -= (u32)block.indices.offset;
+    }
+    for(auto i = 0u; i < data.lods.size(); ++i)
+    {
+        auto& range = data.lods[i].meshlet_range;
+        range = i < lod ? Range32u{} : Range32u{ range.offset - first_meshlet, range.size };
+    }
+    return lod;
+}
+
+assets::ParsedGeometryData Renderer::process_geometry_batch(BuildGeometryBatch& batch)
+{
+    assets::ParsedGeometryData res{ .vertex_layout = batch.vertex_layout };
+    if(batch.meshlets.empty())
+    {
+        meshletize_geometry(batch, batch.indices, res.positions, res.attributes, res.indices, res.meshlets);
+        res.lods.push_back(GeometryLOD{ .meshlet_range = { 0u, (u32)res.meshlets.size() } });
+        res.bvh = build_meshlets_bvh(res.positions, res.indices, res.meshlets);
+
+        // every level is meshletized on its own and appended after the previous ones
+        for(auto i = 0u; i < batch.lod_indices.size() && res.lods.size() < Geometry::MAX_LODS; ++i)
+        {
+            std::vector<float> positions, attributes;
+            std::vector<u16> indices;
+            std::vector<Meshlet> meshlets;
+            meshletize_geometry(batch, batch.lod_indices[i], positions, attributes, indices, meshlets);
+            if(meshlets.empty()) { continue; }
+            for(auto& mlt : meshlets)
+            {
+                mlt.vertex_offset += (i32)(res.positions.size() / 3);
+                mlt.index_offset += (u32)res.indices.size();
+            }
+            res.lods.push_back(GeometryLOD{ .meshlet_range = { (u32)res.meshlets.size(), (u32)meshlets.size() },
+                                            .error = batch.lod_errors[i] });
+            res.positions.insert(res.positions.end(), positions.begin(), positions.end());
+            res.attributes.insert(res.attributes.end(), attributes.begin(), attributes.end());
+            res.indices.insert(res.indices.end(), indices.begin(), indices.end());
+            res.meshlets.insert(res.meshlets.end(), meshlets.begin(), meshlets.end());
+        }
+        return res;
+    }
+
+    ENG_ASSERT(batch.index_format == IndexFormat::U16);
+    res.positions = std::move(batch.positions);
+    res.attributes = std::move(batch.attributes);
+    res.indices.resize(batch.indices.size() / sizeof(u16));
+    memcpy(res.indices.data(), batch.indices.data(), batch.indices.size());
+    res.meshlets = std::move(batch.meshlets);
+    res.lods = std::move(batch.meshlet_lods);
+    if(res.lods.empty()) { res.lods.push_back(GeometryLOD{ .meshlet_range = { 0u, (u32)res.meshlets.size() } }); }
+    if(res.lods.size() > Geometry::MAX_LODS) { res.lods.resize(Geometry::MAX_LODS); }
+    if(!batch.bvh.empty()) { res.bvh = std::move(batch.bvh); }
+    else
+    {
+        res.bvh = build_meshlets_bvh(res.positions, res.indices, std::span{ res.meshlets }.first(res.lods[0].meshlet_range.size));
+    }
+    return res;
+}
+
 void Renderer::build_pending_geometries()
 {
     if(new_geometries.batches.empty()) { return; }
@@ -1204,10 +1387,8 @@ void Renderer::build_pending_geometries()
     struct JobResult
     {
         Handle<Geometry> geometry;
-        std::vector<float> positions;
-        std::vector<float> attributes;
-        std::vector<u16> indices;
-        std::vector<Meshlet> meshlets;
+        assets::ParsedGeometryData data;
+        u32 resident_lod{};
     };
     std::vector<JobResult> results(new_geometries.batches.size());
     {
@@ -1222,36 +1403,17 @@ void Renderer::build_pending_geometries()
                     const auto bidx = batch_idx.fetch_add(1);
                     if(bidx >= new_geometries.batches.size()) { return; }
                     auto& batch = new_geometries.batches[bidx];
-
                     auto& res = results[bidx];
                     res.geometry = batch.geom;
-                    if(batch.meshlets.empty())
-                    {
-                        meshletize_geometry(batch, res.positions, res.attributes, res.indices, res.meshlets);
-                        if(batch.geom_ready_signal)
-                        {
-                            batch.geom_ready_signal->set_value(assets::ParsedGeometryData{ .vertex_layout = batch.vertex_layout,
-                                                                                           .positions = res.positions,
-                                                                                           .attributes = res.attributes,
-                                                                                           .indices = res.indices,
-                                                                                           .meshlets = res.meshlets });
-                        }
-                    }
-                    else
-                    {
-                        ENG_ASSERT(batch.index_format == IndexFormat::U16);
-                        res.positions = std::move(batch.positions);
-                        res.attributes = std::move(batch.attributes);
-                        res.indices.resize(batch.indices.size() / sizeof(u16));
-                        memcpy(res.indices.data(), batch.indices.data(), batch.indices.size());
-                        res.meshlets = std::move(batch.meshlets);
-                    }
+                    res.data = process_geometry_batch(batch);
+                    if(batch.geom_ready_signal) { batch.geom_ready_signal->set_value(res.data); }
+                    res.resident_lod = drop_finer_lods(res.data, batch.resident_lod);
                 }
             } };
         }
     }
 
-    JobResult final_result{};
+    assets::ParsedGeometryData final_result{};
     std::vector<glm::vec4> bspheres;
     size_t total_pos{};
     size_t total_att{};
@@ -1259,10 +1421,10 @@ void Renderer::build_pending_geometries()
     size_t total_mlt{};
     for(const auto& res : results)
     {
-        total_pos += res.positions.size();
-        total_att += res.attributes.size();
-        total_idx += res.indices.size();
-        total_mlt += res.meshlets.size();
+        total_pos += res.data.positions.size();
+        total_att += res.data.attributes.size();
+        total_idx += res.data.indices.size();
+        total_mlt += res.data.meshlets.size();
     }
     final_result.positions.reserve(total_pos);
     final_result.attributes.reserve(total_att);
@@ -1270,10 +1432,10 @@ void Renderer::build_pending_geometries()
     bspheres.reserve(total_mlt);
     for(const auto& res : results)
     {
-        final_result.positions.insert(final_result.positions.end(), res.positions.begin(), res.positions.end());
-        final_result.attributes.insert(final_result.attributes.end(), res.attributes.begin(), res.attributes.end());
-        final_result.indices.insert(final_result.indices.end(), res.indices.begin(), res.indices.end());
-        for(const auto& mlt : res.meshlets)
+        final_result.positions.insert(final_result.positions.end(), res.data.positions.begin(), res.data.positions.end());
+        final_result.attributes.insert(final_result.attributes.end(), res.data.attributes.begin(), res.data.attributes.end());
+        final_result.indices.insert(final_result.indices.end(), res.data.indices.begin(), res.data.indices.end());
+        for(const auto& mlt : res.data.meshlets)
         {
             bspheres.push_back(mlt.bounding_sphere);
         }
@@ -1288,20 +1450,116 @@ void Renderer::build_pending_geometries()
     staging->copy(bufs.bspheres.get(), bspheres, STAGING_APPEND);
     for(auto& res : results)
     {
-        res.geometry->meshlet_range = { .offset = (u32)meshlets.size(), .size = (u32)res.meshlets.size() };
-        for(auto& mlt : res.meshlets)
+        auto& geom = res.geometry.get();
+        geom.lod_count = (u32)res.data.lods.size();
+        geom.resident_lod = res.resident_lod;
+        for(auto i = 0u; i < geom.lod_count; ++i)
+        {
+            geom.lods[i] = res.data.lods[i];
+            if(i >= geom.resident_lod) { geom.lods[i].meshlet_range.offset += (u32)meshlets.size(); }
+        }
+        geom.meshlet_range = geom.lods[0].meshlet_range;
+        for(auto& mlt : res.data.meshlets)
         {
             mlt.vertex_offset += bufs.vertex_count;
             mlt.index_offset += bufs.index_count;
         }
-        meshlets.insert(meshlets.end(), res.meshlets.begin(), res.meshlets.end());
-        bufs.vertex_count += res.positions.size() / 3;
-        bufs.index_count += res.indices.size();
+        meshlets.insert(meshlets.end(), res.data.meshlets.begin(), res.data.meshlets.end());
+        bufs.vertex_count += res.data.positions.size() / 3;
+        bufs.index_count += res.data.indices.size();
+        get_engine().scene->tlas.add_blas(res.geometry, std::move(res.data.bvh));
     }
 
     new_geometries = {};
 }
 
+void Renderer::stream_in_geometry_lods(Handle<Geometry> geometry, const assets::ParsedGeometryData& data, u32 lod)
+{
+    auto& geom = geometry.get();
+    const auto vertex_count = data.positions.size() / 3;
+    if(lod >= geom.resident_lod || vertex_count == 0) { return; }
+    const auto att_floats = data.attributes.size() / vertex_count;
+    const auto upload = [this](Handle<Buffer>& buf, const void* src, usize offset, usize size) {
+        resize_buffer(buf, size, offset, true);
+        staging->copy(buf.get(), src, offset, size);
+    };
+    for(auto l = lod; l < geom.resident_lod; ++l)
+    {
+        const auto range = data.lods[l].meshlet_range;
+        if(range.size == 0) { continue; }
+        auto block = get_lod_block(data.meshlets, range);
+        block.indices.size = std::min(block.indices.size, data.indices.size() - block.indices.offset);
+        const auto vtx = allocate_range(bufs.free_vertices, block.vertices.size, bufs.vertex_count);
+        const auto idx = allocate_range(bufs.free_indices, block.indices.size, bufs.index_count);
+        auto meshlet_count = meshlets.size();
+        const auto mlt = allocate_range(bufs.free_meshlets, range.size, meshlet_count);
+        meshlets.resize(meshlet_count);
+
+        std::vector<glm::vec4> bspheres(range.size);
+        for(auto i = 0u; i < range.size; ++i)
+        {
+            auto m = data.meshlets[range.offset + i];
+            m.vertex_offset = (i32)(m.vertex_offset - block.vertices.offset + vtx);
+            m.index_offset = (u32)(m.index_offset - block.indices.offset + idx);
+            meshlets[mlt + i] = m;
+            bspheres[i] = m.bounding_sphere;
+        }
+        upload(bufs.positions, &data.positions[block.vertices.offset * 3], vtx * 3 * sizeof(float),
+               block.vertices.size * 3 * sizeof(float));
+        if(att_floats > 0)
+        {
+            upload(bufs.attributes, &data.attributes[block.vertices.offset * att_floats], vtx * att_floats * sizeof(float),
+                   block.vertices.size * att_floats * sizeof(float));
+        }
+        upload(bufs.indices, &data.indices[block.indices.offset], idx * sizeof(u16), block.indices.size * sizeof(u16));
+        upload(bufs.bspheres, bspheres.data(), mlt * sizeof(glm::vec4), bspheres.size() * sizeof(glm::vec4));
+        geom.lods[l].meshlet_range = Range32u{ (u32)mlt, range.size };
+    }
+    geom.resident_lod = lod;
+    geom.meshlet_range = geom.lods[0].meshlet_range;
+    ++geometry_lods_version;
+}
+
+void Renderer::stream_out_geometry_lods(Handle<Geometry> geometry, u32 lod)
+{
+    auto& geom = geometry.get();
+    if(geom.lod_count == 0) { return; }
+    lod = std::min(lod, geom.lod_count - 1);
+    if(lod <= geom.resident_lod) { return; }
+    for(auto l = geom.resident_lod; l < lod; ++l)
+    {
+        auto& range = geom.lods[l].meshlet_range;
+        if(range.size == 0) { continue; }
+        // frames in flight may still draw them, so the ranges are freed frame_delay frames later
+        const auto block = get_lod_block(meshlets, range);
+        bufs.retired_lods.push_back(GeometryBuffers::RetiredLOD{ .frame = current_frame,
+                                                                  .vertices = block.vertices,
+                                                                  .indices = block.indices,
+                                                                  .meshlets = { range.offset, range.size } });
+        range = {};
+    }
+    geom.resident_lod = lod;
+    geom.meshlet_range = geom.lods[0].meshlet_range;
+    ++geometry_lods_version;
+}
+
+void Renderer::replace_image(Handle<Image> old_image, Handle<Image> new_image)
+{
+    for(auto i = 0u; i < materials.size(); ++i)
+    {
+        auto& mat = materials[i];
+        auto replaced = false;
+        for(auto* txt : { &mat.base_color_texture, &mat.normal_texture, &mat.metallic_roughness_texture })
+        {
+            if(txt->image != old_image) { continue; }
+            *txt = ImageView::init(new_image, txt->format, txt->type);
+            replaced = true;
+        }
+        if(replaced) { new_materials.push_back(Handle<Material>{ i }); }
+    }
+    queue_destroy(old_image);
+}
+
 void Renderer::build_pending_blases()
 {
     if(new_blases.empty()) { return; }
@@ -1387,24 +1645,23 @@ void Renderer::build_pending_blases()
     new_blases.clear();
 }
 
-void Renderer::meshletize_geometry(const BuildGeometryBatch& batch, std::vector<float>& out_positions, std::vector<float>& out_attributes,
+void Renderer::meshletize_geometry(const BuildGeometryBatch& batch, std::span<const std::byte> batch_indices,
+                                   std::vector<float>& out_positions, std::vector<float>& out_attributes,
                                    std::vector<u16>& out_indices, std::vector<Meshlet>& out_meshlets)
 {
-    auto& context = new_geometries;
-
     static constexpr auto max_verts = 64u;
     static constexpr auto max_tris = 124u;
     static constexpr auto cone_weight = 0.0f;
 
-    if(batch.indices.empty())
+    if(batch_indices.empty())
     {
         ENG_WARN("Batch has no indices");
         return;
     }
 
     // get indices to meshletize
-    std::vector<u32> indices(batch.indices.size() / sizeof(u32));
-    copy_indices(std::as_writable_bytes(std::span{ indices }), std::span{ batch.indices }, IndexFormat::U32, batch.index_format);
+    std::vector<u32> indices(batch_indices.size() / get_index_size(batch.index_format));
+    copy_indices(std::as_writable_bytes(std::span{ indices }), batch_indices, IndexFormat::U32, batch.index_format);
 
     // get positions to meshletize
     const std::vector<float>& positions = batch.positions;
@@ -1477,11 +1734,9 @@ void Renderer::meshletize_geometry(const BuildGeometryBatch& batch, std::vector<
 Handle<Mesh> Renderer::make_mesh(const MeshDescriptor& batch)
 {
     Mesh mesh{ .geometry = batch.geometry, .material = batch.material };
-    const auto found_it = std::find(meshes.begin(), meshes.end(), mesh);
-    if(found_it != meshes.end()) { return Handle<Mesh>{ (u32)std::distance(meshes.begin(), found_it) }; }
-    const u32 idx = meshes.size();
-    meshes.push_back(mesh);
-    return Handle<Mesh>{ idx };
+    auto [it, inserted] = mesh_handles_map.emplace(mesh, Handle<Mesh>{ (u32)meshes.size() });
+    if(inserted) { meshes.push_back(mesh); }
+    return it->second;
 }
 
 void Renderer::make_blas(Handle<Geometry> geom)
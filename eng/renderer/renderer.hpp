@@ -49,8 +49,27 @@ struct Meshlet
     glm::vec4 bounding_sphere{};
 };
 
+// Level of detail of a geometry; level 0 is the full one.
+struct GeometryLOD
+{
+    static constexpr auto get_struct_fields()
+    {
+        return std::make_tuple(serialization::StructField{ &GeometryLOD::meshlet_range },
+                               serialization::StructField{ &GeometryLOD::error });
+    }
+    Range32u meshlet_range{}; // relative to the geometry's meshlets, except in Geometry where it's global
+    float error{};            // object space deviation from the full geometry
+};
+
 struct GeometryDescriptor
 {
+    // Lower level of detail, indexing the same vertices as the full geometry.
+    struct LOD
+    {
+        std::span<const std::byte> indices;
+        float error{};
+    };
+
     // usize get_num_indices() const { return indices.size_bytes() / get_index_size(gfx::IndexFormat::U16); }
     usize get_num_vertices() const { return vertices.size_bytes() / get_vertex_layout_size(vertex_layout); }
     Flags<GeometryFlags> flags;
@@ -59,7 +78,11 @@ struct GeometryDescriptor
     std::span<const float> vertices; // if attributes is non-empty, vertices is just positions (float3)
     std::span<const float> attributes;
     std::span<const std::byte> indices;
+    std::span<const LOD> lods;         // optional, meshletized separately; ignored if meshlets are given
     std::span<const Meshlet> meshlets; // optional
+    std::span<const GeometryLOD> meshlet_lods; // optional, lods of the given meshlets; without them all are level 0
+    const physics::BVH* bvh{};         // optional, prebuilt bvh over meshletized positions; skips building it
+    u32 resident_lod{}; // finer levels of detail are not uploaded; see Renderer::stream_in_geometry_lods
     assets::ParsedGeometryReadySignal* signal{};
 };
 
@@ -109,7 +132,7 @@ struct DescriptorResource
 
 struct ImageBlockData
 {
-    u32 bytes_per_texel;
+    u32 bytes_per_texel; // bytes per block for block compressed formats
     u32_3 texel_extent;
 };
 
@@ -320,7 +343,11 @@ struct Geometry
 {
     auto operator<=>(const Geometry& a) const { return meshlet_range <=> a.meshlet_range; }
     auto operator==(const Geometry& a) const { return meshlet_range == a.meshlet_range; }
-    Range32u meshlet_range{}; // position inside meshlet buffer
+    inline static constexpr u32 MAX_LODS = 8;
+    Range32u meshlet_range{}; // position inside meshlet buffer; same as lods[0].meshlet_range
+    std::array<GeometryLOD, MAX_LODS> lods{};
+    u32 lod_count{};
+    u32 resident_lod{}; // finest level of detail in geometry buffers; finer ones have empty meshlet ranges
     Handle<Buffer> blas_buffer{};
     struct Metadata
     {
@@ -797,6 +824,18 @@ class Renderer
         IndexFormat index_type{ IndexFormat::U16 };
         usize vertex_count{};
         usize index_count{};
+        // ranges of streamed out levels of detail, reused by the ones streamed in later
+        struct RetiredLOD
+        {
+            u64 frame{};
+            Range64u vertices;
+            Range64u indices;
+            Range64u meshlets;
+        };
+        std::vector<Range64u> free_vertices;
+        std::vector<Range64u> free_indices;
+        std::vector<Range64u> free_meshlets;
+        std::vector<RetiredLOD> retired_lods; // become free after frame_delay frames
         // usize transform_count{};
         // usize light_count{};
 
@@ -855,6 +894,11 @@ class Renderer
         std::vector<float> attributes;
         std::vector<std::byte> indices;
         std::vector<Meshlet> meshlets;
+        std::vector<GeometryLOD> meshlet_lods;
+        std::vector<std::vector<std::byte>> lod_indices;
+        std::vector<float> lod_errors;
+        physics::BVH bvh;
+        u32 resident_lod{};
         assets::ParsedGeometryReadySignal* geom_ready_signal{};
     };
 
@@ -897,8 +941,20 @@ class Renderer
     Handle<Geometry> make_geometry(const GeometryDescriptor& info);
     void build_pending_geometries();
     void build_pending_blases();
-    void meshletize_geometry(const BuildGeometryBatch& batch, std::vector<float>& out_positions, std::vector<float>& out_attributes,
-                             std::vector<u16>& out_indices, std::vector<Meshlet>& out_meshlets);
+    static void meshletize_geometry(const BuildGeometryBatch& batch, std::span<const std::byte> indices,
+                                    std::vector<float>& out_positions, std::vector<float>& out_attributes,
+                                    std::vector<u16>& out_indices, std::vector<Meshlet>& out_meshlets);
+    // Meshletizes the batch with all its levels of detail and builds cpu bvh, unless they were provided. Touches no
+    // renderer state, so headless imports use it too. Doesn't signal geom_ready_signal.
+    static assets::ParsedGeometryData process_geometry_batch(BuildGeometryBatch& batch);
+    // Uploads levels of detail from lod up to the resident one. data is the same that the geometry was made from;
+    // levels are stored one after another in it, so each one is a separate block of vertices, indices and meshlets.
+    void stream_in_geometry_lods(Handle<Geometry> geometry, const assets::ParsedGeometryData& data, u32 lod);
+    // Frees levels of detail finer than lod. Geometry::meshlet_range is empty while level 0 is streamed out,
+    // so blas can't be built for it.
+    void stream_out_geometry_lods(Handle<Geometry> geometry, u32 lod);
+    // Makes materials sampling old_image sample new_image, and destroys old_image.
+    void replace_image(Handle<Image> old_image, Handle<Image> new_image);
     Handle<Mesh> make_mesh(const MeshDescriptor& info);
     void make_blas(Handle<Geometry> geom);
     Handle<ShaderEffect> make_shader_effect(const ShaderEffect& info);
@@ -937,6 +993,7 @@ class Renderer
     std::vector<Meshlet> meshlets;
     std::vector<Material> materials;
     std::vector<Mesh> meshes;
+    std::unordered_map<Mesh, Handle<Mesh>> mesh_handles_map; // meshes are unique
     std::vector<ShaderEffect> shader_effects;
     HandleFlatSet<MeshPass> mesh_passes;
     MeshRenderer mesh_renderer;
@@ -946,6 +1003,7 @@ class Renderer
     std::vector<Handle<Shader>> new_shaders;
     std::vector<Handle<Pipeline>> new_pipelines;
     std::vector<Handle<Material>> new_materials;
+    u32 geometry_lods_version{}; // changes when levels of detail of any geometry are streamed in or out
     std::vector<ecs::EntityId> new_transforms;
     std::vector<ecs::EntityId> new_lights;
 
@@ -205,8 +205,9 @@ size_t StagingBuffer::copy(Image& dst, const void* const src, u32 layer, u32 mip
     ENG_ASSERT(extent.y > 0);
     ENG_ASSERT(extent.z == 1);
 
-    glm::u64vec3 blocks = glm::u64vec3{ extent.x, extent.y, extent.z } /
-                          glm::u64vec3{ block_data.texel_extent.x, block_data.texel_extent.y, block_data.texel_extent.z };
+    // partial blocks at mip edges still take a whole block
+    const glm::u64vec3 texel_extent{ block_data.texel_extent.x, block_data.texel_extent.y, block_data.texel_extent.z };
+    glm::u64vec3 blocks = (glm::u64vec3{ extent.x, extent.y, extent.z } + texel_extent - 1ull) / texel_extent;
     const auto row_bytes = size_t(blocks.x) * size_t(block_data.bytes_per_texel);
     const auto src_bytes = size_t(blocks.x) * size_t(blocks.y) * size_t(blocks.z) * size_t(block_data.bytes_per_texel);
 
@@ -176,6 +176,14 @@ enum class ImageFormat : u8
     R32FG32F,
     R16FG16FB16FA16F,
     R32FG32FB32FA32F,
+    BC1_RGBA_UNORM,
+    BC1_RGBA_SRGB,
+    BC3_UNORM,
+    BC3_SRGB,
+    BC4_UNORM,
+    BC5_UNORM,
+    BC7_UNORM,
+    BC7_SRGB,
     LAST_ENUM,
 };
 
@@ -429,6 +437,7 @@ struct DescriptorSet;
 struct DescriptorSetMetadataVk;
 struct Geometry;
 struct GeometryDescriptor;
+struct GeometryLOD;
 struct GeometryMetadataVk;
 struct IDescriptorSetAllocator;
 struct Image;
@@ -612,7 +621,7 @@ inline size_t copy_indices(std::span<std::byte> dst, std::span<const std::byte>
 
 inline Flags<ImageAspect> get_aspect_from_format(ImageFormat format)
 {
-    static_assert((int)ImageFormat::LAST_ENUM == 13);
+    static_assert((int)ImageFormat::LAST_ENUM == 21);
     switch(format)
     {
     case ImageFormat::R8G8B8A8_UNORM:
@@ -623,6 +632,14 @@ inline Flags<ImageAspect> get_aspect_from_format(ImageFormat format)
     case ImageFormat::R32FG32F:
     case ImageFormat::R16FG16FB16FA16F:
     case ImageFormat::R32FG32FB32FA32F:
+    case ImageFormat::BC1_RGBA_UNORM:
+    case ImageFormat::BC1_RGBA_SRGB:
+    case ImageFormat::BC3_UNORM:
+    case ImageFormat::BC3_SRGB:
+    case ImageFormat::BC4_UNORM:
+    case ImageFormat::BC5_UNORM:
+    case ImageFormat::BC7_UNORM:
+    case ImageFormat::BC7_SRGB:
         return ImageAspect::COLOR;
 
     case ImageFormat::D16_UNORM:
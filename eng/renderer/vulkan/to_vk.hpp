@@ -50,7 +50,7 @@ inline VkSamplerAddressMode to_vk(const ImageAddressing& a)
 
 inline VkFormat to_vk(const ImageFormat& a)
 {
-    static_assert((int)ImageFormat::LAST_ENUM == 13);
+    static_assert((int)ImageFormat::LAST_ENUM == 21);
     switch(a)
     {
     case ImageFormat::UNDEFINED:
@@ -105,6 +105,38 @@ inline VkFormat to_vk(const ImageFormat& a)
     {
         return VK_FORMAT_R32G32B32A32_SFLOAT;
     }
+    case ImageFormat::BC1_RGBA_UNORM:
+    {
+        return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    }
+    case ImageFormat::BC1_RGBA_SRGB:
+    {
+        return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    }
+    case ImageFormat::BC3_UNORM:
+    {
+        return VK_FORMAT_BC3_UNORM_BLOCK;
+    }
+    case ImageFormat::BC3_SRGB:
+    {
+        return VK_FORMAT_BC3_SRGB_BLOCK;
+    }
+    case ImageFormat::BC4_UNORM:
+    {
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+    }
+    case ImageFormat::BC5_UNORM:
+    {
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    }
+    case ImageFormat::BC7_UNORM:
+    {
+        return VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    case ImageFormat::BC7_SRGB:
+    {
+        return VK_FORMAT_BC7_SRGB_BLOCK;
+    }
     default:
     {
         ENG_ASSERT(false, "Unhandled case.");
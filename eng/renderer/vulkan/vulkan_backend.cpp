@@ -508,6 +508,7 @@ void RendererBackendVk::init()
     dev_2_features.features.vertexPipelineStoresAndAtomics = true;
     dev_2_features.features.fragmentStoresAndAtomics = true;
     dev_2_features.features.independentBlend = true;
+    dev_2_features.features.textureCompressionBC = true;
 
     auto dev_vk12_features = vk::VkPhysicalDeviceVulkan12Features{};
     dev_vk12_features.drawIndirectCount = true;
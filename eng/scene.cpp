@@ -67,6 +67,14 @@ ecs::EntityId Scene::instance_asset(const assets::Asset& asset)
     return e;
 }
 
+void Scene::update()
+{
+    // instances that only moved keep their place in the tree, just the bounds are refitted
+    if(!tlas.update() && tlas.has_moved_instances()) { tlas.refit(); }
+    // after the tlas, as proxy bounds come from its blases
+    if(update_broadphase) { broadphase.update(); }
+}
+
 } // namespace eng
 
 // void Scene::ui_draw_manipulate()
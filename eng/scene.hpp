@@ -12,6 +12,8 @@
 #include <eng/common/handle.hpp>
 #include <eng/ecs/ecs.hpp>
 #include <eng/physics/bvh.hpp>
+#include <eng/physics/broadphase.hpp>
+#include <eng/physics/tlas.hpp>
 #include <eng/common/indexed_hierarchy.hpp>
 
 namespace eng
@@ -26,9 +28,13 @@ class Scene
 {
   public:
     ecs::EntityId instance_asset(const assets::Asset& asset);
+    void update();
 
   public:
     std::vector<ecs::EntityId> scene;
+    physics::TLAS tlas;
+    physics::Broadphase broadphase{ physics::Broadphase::Type::AABB_TREE }; // overlapping pairs of mesh entities
+    bool update_broadphase{ false }; // nothing consumes the pairs yet, so they are found only for whoever turns it on
 };
 
 } // namespace eng
\ No newline at end of file
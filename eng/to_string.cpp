@@ -16,6 +16,14 @@ std::string to_string(const ImageFormat& a)
     {
         case ImageFormat::R8G8B8A8_UNORM: { return "R8G8B8A8_UNORM"; }
         case ImageFormat::R8G8B8A8_SRGB: { return "R8G8B8A8_SRGB"; }
+        case ImageFormat::BC1_RGBA_UNORM: { return "BC1_RGBA_UNORM"; }
+        case ImageFormat::BC1_RGBA_SRGB: { return "BC1_RGBA_SRGB"; }
+        case ImageFormat::BC3_UNORM: { return "BC3_UNORM"; }
+        case ImageFormat::BC3_SRGB: { return "BC3_SRGB"; }
+        case ImageFormat::BC4_UNORM: { return "BC4_UNORM"; }
+        case ImageFormat::BC5_UNORM: { return "BC5_UNORM"; }
+        case ImageFormat::BC7_UNORM: { return "BC7_UNORM"; }
+        case ImageFormat::BC7_SRGB: { return "BC7_SRGB"; }
         default: { ENG_ERROR("Unhandled case"); return ""; }
     }
 }
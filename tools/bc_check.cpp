@@ -0,0 +1,113 @@
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <fmt/format.h>
+#include <stb/stb_image.h>
+#include <eng/assets/texture_compression.hpp>
+
+/*
+    Quality check of the block compression encoders, entirely on the cpu. Encodes images in every BC format,
+    decodes them back and fails if PSNR against the source, over channels the format stores, is below the floor
+    of that format.
+
+    eng_bc_check [image files]...
+        without files, a generated reference image is checked; it has smooth gradients, hard edges and noise,
+        so every encoder gets both easy and hard blocks. Floors are set a few dB under what the encoders reach on it.
+*/
+
+using namespace eng;
+
+struct FormatCheck
+{
+    compression::BCFormat format;
+    const char* name;
+    u32 channel_mask; // bit 0 is red
+    float min_psnr;   // dB
+    bool opaque;      // checked on an opaque copy, as the importer picks the format only for opaque images
+};
+
+// clang-format off
+inline static constexpr FormatCheck FORMAT_CHECKS[]{
+    { compression::BCFormat::BC1, "BC1", 0x7, 35.0f, true },
+    { compression::BCFormat::BC3, "BC3", 0xF, 36.0f, false },
+    { compression::BCFormat::BC4, "BC4", 0x1, 48.0f, false },
+    { compression::BCFormat::BC5, "BC5", 0x3, 48.0f, false },
+    { compression::BCFormat::BC7, "BC7", 0xF, 36.0f, false },
+};
+// clang-format on
+
+struct Image
+{
+    std::vector<std::byte> rgba8;
+    u32 width{};
+    u32 height{};
+};
+
+// Odd size, so partial blocks at the edges are checked too.
+static Image make_reference_image(u32 width = 250, u32 height = 250)
+{
+    Image img{ std::vector<std::byte>((usize)width * height * 4), width, height };
+    std::mt19937 rng{ 1234 };
+    std::uniform_int_distribution<int> noise{ -6, 6 };
+    const auto channel = [&noise, &rng](float value) { return (std::byte)std::clamp((int)value + noise(rng), 0, 255); };
+    for(auto y = 0u; y < height; ++y)
+    {
+        for(auto x = 0u; x < width; ++x)
+        {
+            const auto u = (float)x / (float)(width - 1);
+            const auto v = (float)y / (float)(height - 1);
+            const auto checker = ((x / 16) + (y / 16)) % 2 == 0 ? 48.0f : 0.0f;
+            const auto r = std::hypot(u - 0.5f, v - 0.5f);
+            auto* texel = &img.rgba8[((usize)y * width + x) * 4];
+            texel[0] = channel(u * 207.0f + checker);
+            texel[1] = channel(v * 207.0f + checker);
+            texel[2] = channel((1.0f - u) * 127.0f + (1.0f - v) * 80.0f + checker);
+            texel[3] = channel(std::clamp(1.0f - r * 1.5f, 0.0f, 1.0f) * 255.0f);
+        }
+    }
+    return img;
+}
+
+static bool check_image(std::string_view name, const Image& img)
+{
+    auto opaque_rgba8 = img.rgba8;
+    for(auto i = 3ull; i < opaque_rgba8.size(); i += 4)
+    {
+        opaque_rgba8[i] = (std::byte)255;
+    }
+
+    auto passed = true;
+    for(const auto& check : FORMAT_CHECKS)
+    {
+        const auto& src = check.opaque ? opaque_rgba8 : img.rgba8;
+        const auto blocks = compression::bc_encode(check.format, src, img.width, img.height);
+        const auto decoded = compression::bc_decode(check.format, blocks, img.width, img.height);
+        const auto psnr = compression::compute_psnr(src, decoded, check.channel_mask);
+        const auto ok = psnr >= check.min_psnr;
+        fmt::print("{} {}: {:.2f} dB (min {:.2f}) {}\n", name, check.name, psnr, check.min_psnr, ok ? "ok" : "FAILED");
+        passed &= ok;
+    }
+    return passed;
+}
+
+int main(int argc, char** argv)
+{
+    auto passed = true;
+    if(argc < 2) { passed = check_image("reference", make_reference_image()); }
+    for(auto i = 1; i < argc; ++i)
+    {
+        int width, height, channels;
+        auto* data = stbi_load(argv[i], &width, &height, &channels, 4);
+        if(!data)
+        {
+            fmt::print(stderr, "Couldn't load {}\n", argv[i]);
+            return 1;
+        }
+        Image img{ std::vector<std::byte>((usize)width * height * 4), (u32)width, (u32)height };
+        std::memcpy(img.rgba8.data(), data, img.rgba8.size());
+        stbi_image_free(data);
+        passed &= check_image(argv[i], img);
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <fmt/format.h>
+#include <eng/physics/broadphase.hpp>
+
+/*
+    Broadphase benchmark. Moves proxies with random velocities through a cube sized for a constant density,
+    and times moving them and finding pairs every frame, for both broadphases. find_pairs runs its parallel path,
+    so the numbers scale with the hardware threads reported at the start.
+
+    eng_broadphase_bench [--frames <count>] [proxy counts]...
+        --frames <count>    timed frames per run; default is 100
+        proxy counts default to 10000 50000 100000
+*/
+
+using namespace eng;
+
+inline static constexpr float PROXIES_PER_UNIT3 = 0.05f;
+inline static constexpr float MAX_SPEED = 0.1f; // units per frame
+
+struct BenchProxy
+{
+    physics::ProxyId id;
+    glm::vec3 position{};
+    glm::vec3 half_size{};
+    glm::vec3 velocity{};
+};
+
+struct BenchResult
+{
+    double move_ms{};
+    double find_pairs_ms{};
+    usize pairs{};
+};
+
+static BenchResult run(physics::IBroadphase& bp, u32 proxy_count, u32 frames)
+{
+    using clock = std::chrono::steady_clock;
+    const auto side = std::cbrt((float)proxy_count / PROXIES_PER_UNIT3);
+    std::mt19937 rng{ 1234 }; // same proxies and movement for both broadphases
+    std::uniform_real_distribution<float> pos_dist{ 0.0f, side };
+    std::uniform_real_distribution<float> size_dist{ 0.25f, 1.0f };
+    std::uniform_real_distribution<float> vel_dist{ -MAX_SPEED, MAX_SPEED };
+
+    std::vector<BenchProxy> proxies(proxy_count);
+    for(auto i = 0u; i < proxy_count; ++i)
+    {
+        auto& p = proxies[i];
+        p.position = { pos_dist(rng), pos_dist(rng), pos_dist(rng) };
+        p.half_size = { size_dist(rng), size_dist(rng), size_dist(rng) };
+        p.velocity = { vel_dist(rng), vel_dist(rng), vel_dist(rng) };
+        p.id = bp.insert(ecs::EntityId{ i, 0 }, physics::AABB{ p.position - p.half_size, p.position + p.half_size });
+    }
+
+    std::vector<physics::Pair> pairs;
+    bp.find_pairs(pairs); // first sort or traversal after inserting everything is not timed
+    BenchResult result{};
+    for(auto f = 0u; f < frames; ++f)
+    {
+        const auto move_start = clock::now();
+        for(auto& p : proxies)
+        {
+            p.position += p.velocity;
+            // bounce off the cube walls, so the density stays the same
+            for(auto axis = 0; axis < 3; ++axis)
+            {
+                if(p.position[axis] < 0.0f || p.position[axis] > side) { p.velocity[axis] = -p.velocity[axis]; }
+            }
+            bp.move(p.id, physics::AABB{ p.position - p.half_size, p.position + p.half_size }, p.velocity);
+        }
+        const auto find_start = clock::now();
+        bp.find_pairs(pairs);
+        const auto find_end = clock::now();
+        result.move_ms += std::chrono::duration<double, std::milli>(find_start - move_start).count();
+        result.find_pairs_ms += std::chrono::duration<double, std::milli>(find_end - find_start).count();
+        result.pairs += pairs.size();
+    }
+    result.move_ms /= frames;
+    result.find_pairs_ms /= frames;
+    result.pairs /= frames;
+    return result;
+}
+
+static int print_usage()
+{
+    fmt::print(stderr, "usage: eng_broadphase_bench [--frames <count>] [proxy counts]...\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    u32 frames = 100;
+    std::vector<u32> counts;
+    for(auto i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if(arg == "--frames" && i + 1 < argc) { frames = (u32)std::stoul(argv[++i]); }
+        else if(!arg.empty() && arg[0] != '-') { counts.push_back((u32)std::stoul(argv[i])); }
+        else { return print_usage(); }
+    }
+    if(frames == 0) { return print_usage(); }
+    if(counts.empty()) { counts = { 10'000, 50'000, 100'000 }; }
+
+    fmt::print("{} hardware threads, {} frames per run\n", std::thread::hardware_concurrency(), frames);
+    fmt::print("{:>16} {:>10} {:>12} {:>16} {:>12}\n", "broadphase", "proxies", "move ms", "find_pairs ms", "pairs");
+    for(const auto count : counts)
+    {
+        physics::DynamicAABBTree tree;
+        physics::SortAndSweep sap;
+        const auto tree_result = run(tree, count, frames);
+        const auto sap_result = run(sap, count, frames);
+        for(const auto& [name, r] : { std::pair{ "aabb tree", tree_result }, std::pair{ "sort and sweep", sap_result } })
+        {
+            fmt::print("{:>16} {:>10} {:>12.3f} {:>16.3f} {:>12}\n", name, count, r.move_ms, r.find_pairs_ms, r.pairs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <execution>
+#include <filesystem>
+#include <string_view>
+#include <fmt/format.h>
+#include <eng/assets/asset_manager.hpp>
+#include <eng/assets/compression.hpp>
+#include <eng/assets/loaders.hpp>
+#include <eng/assets/serialization.hpp>
+#include <eng/fs/fs.hpp>
+#include <eng/fs/pack.hpp>
+
+/*
+    Headless asset cooker. Imports gltf files the same way the engine does on first load, and writes them
+    into a single engb container, without ever initializing the engine or the renderer.
+
+    eng_cook [options] <.gltf/.glb files or directories>...
+    eng_cook --compact <.engb file>
+    eng_cook --pack <.engp file> [--root <dir>] [--uncompressed] <files or directories>...
+        -o <file>           output container; default is <root>/assets/cooked.engb
+        --root <dir>        directory that virtual paths ('/assets/...') are relative to; default is '../',
+                            the same as FileSystem::init
+        --lods <count>      levels of detail per geometry, including the full one
+        --float-vertices    don't quantize vertices
+        --uncompressed      don't compress assets; they are bigger, but image data is read without copies
+
+    Directories are searched recursively. Assets are cooked in parallel, but written in the order of their paths,
+    so the same inputs make the same container.
+
+    --compact drops assets replaced by newer ones from a container the engine has been appending to, and exits.
+    The engine must not be running, as the container is rewritten.
+
+    --pack writes all the files, not only gltf ones, into a pack archive under their virtual paths, instead of
+    cooking anything. FileSystem mounts archives from the assets directory over the loose files.
+*/
+
+using namespace eng;
+
+struct CookedAsset
+{
+    fs::Path virtual_path;
+    fs::Path file_path;
+    std::vector<std::byte> bytes; // as stored in the container; empty if cooking failed
+    usize uncompressed_size{};
+    serialization::engb::SourceStamp source;
+};
+
+static bool is_gltf(const fs::Path& path) { return path.extension() == ".gltf" || path.extension() == ".glb"; }
+
+static int print_usage()
+{
+    fmt::print(stderr, "usage: eng_cook [-o <file>] [--root <dir>] [--lods <count>] [--float-vertices] [--uncompressed] "
+                       "<files or directories>...\n"
+                       "       eng_cook --compact <file>\n"
+                       "       eng_cook --pack <file> [--root <dir>] [--uncompressed] <files or directories>...\n");
+    return 1;
+}
+
+static int compact(const fs::Path& path)
+{
+    auto file = std::make_shared<fs::File>();
+    if(!file->open(path, fs::OpenMode::TRY_READ_WRITE_BYTES_BEG))
+    {
+        fmt::print(stderr, "Couldn't open {}\n", path.string());
+        return 1;
+    }
+    const auto size = file->get_size();
+    serialization::engb::Container container{ file };
+    if(!container.compact())
+    {
+        fmt::print(stderr, "Couldn't compact {}\n", path.string());
+        return 1;
+    }
+    fmt::print("Compacted {} from {} to {} bytes\n", path.string(), size, file->get_size());
+    return 0;
+}
+
+static int pack(const fs::Path& path, std::span<const CookedAsset> files, bool compress)
+{
+    std::vector<fs::engp::PackInput> inputs;
+    inputs.reserve(files.size());
+    for(const auto& f : files)
+    {
+        inputs.push_back(fs::engp::PackInput{ .virtual_path = f.virtual_path, .file_path = f.file_path });
+    }
+    if(!fs::engp::write_pack(path, inputs, compress))
+    {
+        fmt::print(stderr, "Couldn't write pack archive {}\n", path.string());
+        return 1;
+    }
+    fmt::print("Packed {} files into {} ({} bytes)\n", inputs.size(), path.string(), std::filesystem::file_size(path));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    fs::Path root = "../";
+    fs::Path out_path;
+    Flags<assets::ImportSettings> import_settings =
+        assets::ImportSettings::HEADLESS_BIT | assets::ImportSettings::QUANTIZE_VERTICES_BIT;
+    assets::LODSettings lod_settings{};
+    auto compress = true;
+    fs::Path pack_path;
+    std::vector<fs::Path> inputs;
+    for(auto i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        const auto has_value = i + 1 < argc;
+        if(arg == "--compact" && has_value) { return compact(argv[++i]); }
+        else if(arg == "--pack" && has_value) { pack_path = argv[++i]; }
+        else if(arg == "-o" && has_value) { out_path = argv[++i]; }
+        else if(arg == "--root" && has_value) { root = argv[++i]; }
+        else if(arg == "--lods" && has_value) { lod_settings.count = std::max(std::atoi(argv[++i]), 1); }
+        else if(arg == "--float-vertices") { import_settings.clear(assets::ImportSettings::QUANTIZE_VERTICES_BIT); }
+        else if(arg == "--uncompressed") { compress = false; }
+        else if(arg.starts_with("-")) { return print_usage(); }
+        else { inputs.push_back(arg); }
+    }
+    if(inputs.empty()) { return print_usage(); }
+    if(out_path.empty()) { out_path = root / "assets" / "cooked.engb"; }
+
+    // archives aren't packed into each other
+    const auto is_input = [&pack_path](const fs::Path& path) {
+        return pack_path.empty() ? is_gltf(path) : path.extension() != ".engp";
+    };
+    std::vector<fs::Path> files;
+    for(const auto& input : inputs)
+    {
+        if(std::filesystem::is_directory(input))
+        {
+            for(const auto& it : std::filesystem::recursive_directory_iterator{ input })
+            {
+                if(it.is_regular_file() && is_input(it.path())) { files.push_back(it.path()); }
+            }
+        }
+        else if(is_input(input)) { files.push_back(input); }
+        else { fmt::print(stderr, "Skipping {}: not a gltf file\n", input.string()); }
+    }
+
+    // assets are looked up by hash of the virtual path they are requested with, so it has to be made the same way
+    const auto abs_root = std::filesystem::weakly_canonical(std::filesystem::absolute(root));
+    std::vector<CookedAsset> cooked;
+    for(const auto& file : files)
+    {
+        const auto rel = std::filesystem::weakly_canonical(std::filesystem::absolute(file)).lexically_relative(abs_root);
+        if(rel.empty() || *rel.begin() == "..")
+        {
+            fmt::print(stderr, "Skipping {}: not inside root directory {}\n", file.string(), root.string());
+            continue;
+        }
+        cooked.push_back(CookedAsset{ .virtual_path = "/" + rel.generic_string(), .file_path = file });
+    }
+    std::sort(cooked.begin(), cooked.end(), [](const auto& a, const auto& b) { return a.virtual_path < b.virtual_path; });
+    cooked.erase(std::unique(cooked.begin(), cooked.end(),
+                             [](const auto& a, const auto& b) { return a.virtual_path == b.virtual_path; }),
+                 cooked.end());
+
+    if(!pack_path.empty()) { return pack(pack_path, cooked, compress); }
+
+    std::for_each(std::execution::par, cooked.begin(), cooked.end(), [&](CookedAsset& ca) {
+        auto asset = assets::AssetLoaderGLTF::load_from_file(ca.file_path, import_settings, lod_settings);
+        if(!asset || asset->geometry_data_futures.empty())
+        {
+            fmt::print(stderr, "Couldn't import {}\n", ca.virtual_path.string());
+            return;
+        }
+        asset->path = ca.virtual_path;
+        ca.source = serialization::engb::SourceStamp::init(ca.file_path, true).value_or(serialization::engb::SourceStamp{});
+        ca.bytes = assets::serialize_asset(*asset);
+        ca.uncompressed_size = ca.bytes.size();
+        if(compress) { ca.bytes = compression::compress_chunked(ca.bytes); }
+        fmt::print("Cooked {} ({} bytes, {} stored)\n", ca.virtual_path.string(), ca.uncompressed_size, ca.bytes.size());
+    });
+
+    auto file = std::make_shared<fs::File>();
+    if(!file->open(out_path, fs::OpenMode::READ_WRITE_BYTES_CREATE_DISCARD))
+    {
+        fmt::print(stderr, "Couldn't open {} for writing\n", out_path.string());
+        return 1;
+    }
+    auto failed = 0u;
+    {
+        serialization::engb::Container container{ file };
+        for(const auto& ca : cooked)
+        {
+            if(ca.bytes.empty())
+            {
+                ++failed;
+                continue;
+            }
+            const auto flags = compress ? serialization::engb::ListFlags::CONTENT_COMPRESSED_BIT
+                                        : Flags<serialization::engb::ListFlags>{};
+            container.add_asset(assets::Asset::VERSION, assets::Asset::get_schema_hash(), ENG_HASH(ca.virtual_path.string()),
+                                flags, ca.bytes, serialization::engb::AssetMetadata{ .uncompressed_size = ca.uncompressed_size },
+                                ca.source);
+        }
+        container.write_to_file();
+    }
+
+    fmt::print("Written {} of {} assets to {}\n", cooked.size() - failed, cooked.size(), out_path.string());
+    return failed == 0 ? 0 : 1;
+}